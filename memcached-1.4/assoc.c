@@ -12,6 +12,7 @@
  */
 
 #include "memcached.h"
+#include "assoc_match.h"
 #include <sys/stat.h>
 #include <sys/socket.h>
 #include <sys/signal.h>
@@ -58,28 +59,369 @@ static unsigned int hash_items = 0;
 static bool expanding = false; //hashչʱ1assoc_expand
 static bool started_expanding = false;
 
+/*
+ * Shrinking (-o hash_shrink_load) is expansion run backwards: old bucket N
+ * and N + hashsize(hashpower) are folded into new bucket N. Both share the
+ * low bits the item locks are picked by, so one lock still covers a step.
+ */
+static bool shrinking = false;
+static bool started_shrinking = false;
+
+/* Never shrink below the size we started at. */
+static unsigned int hashpower_min = HASHPOWER_DEFAULT;
+
+/* Shrink once hash_items drops below this; 0 when shrinking is off. */
+static unsigned int shrink_below = 0;
+
 /*
  * During expansion we migrate values with bucket granularity; this is how
  * far we've gotten so far. Ranges from 0 .. hashsize(hashpower - 1) - 1.
+ * While shrinking it counts new buckets filled, 0 .. hashsize(hashpower) - 1.
  */
 static unsigned int expand_bucket = 0;
 
+/*
+ * Workers only hold the item lock for the bucket they're working on, so the
+ * table swap in assoc_expand() can't wait for them. It's bracketed by
+ * table_seq instead: picking a bucket for hv happens inside a read section,
+ * which retries if a swap raced with it.
+ *
+ * Once picked, a bucket stays valid for as long as the caller holds its
+ * item lock. A swap turns the primary table into the old one bucket for
+ * bucket, and the old table is only freed after every bucket has been
+ * migrated, each under its own item lock.
+ */
+static volatile unsigned int table_seq = 0;
+
+#ifdef HAVE_GCC_ATOMICS
+#define table_barrier() __sync_synchronize()
+#else
+static pthread_mutex_t table_barrier_lock = PTHREAD_MUTEX_INITIALIZER;
+#define table_barrier() do { \
+    pthread_mutex_lock(&table_barrier_lock); \
+    pthread_mutex_unlock(&table_barrier_lock); \
+} while (0)
+#endif
+
+static inline unsigned int table_read_begin(void) {
+    unsigned int seq;
+
+    /* A swap is only a handful of stores, so just spin it out. */
+    while ((seq = table_seq) & 1)
+        ;
+    table_barrier();
+    return seq;
+}
+
+static inline bool table_read_retry(const unsigned int seq) {
+    table_barrier();
+    return table_seq != seq;
+}
+
+static inline void table_write_begin(void) {
+    table_seq++;
+    table_barrier();
+}
+
+static inline void table_write_end(void) {
+    table_barrier();
+    table_seq++;
+}
+
+/*
+ * assoc_prefetch() peeks into buckets without the item lock, just to issue
+ * prefetches. Any item pointer it reads there may be stale by the time it's
+ * used, which is harmless for a prefetch, but the table itself has to stay
+ * allocated, so assoc_migrate_done() waits for peekers before freeing it.
+ */
+static volatile unsigned int table_peekers = 0;
+
+static inline void table_peek_begin(void) {
+#ifdef HAVE_GCC_ATOMICS
+    __sync_add_and_fetch(&table_peekers, 1);
+#else
+    pthread_mutex_lock(&table_barrier_lock);
+    table_peekers++;
+    pthread_mutex_unlock(&table_barrier_lock);
+#endif
+}
+
+static inline void table_peek_end(void) {
+#ifdef HAVE_GCC_ATOMICS
+    __sync_sub_and_fetch(&table_peekers, 1);
+#else
+    pthread_mutex_lock(&table_barrier_lock);
+    table_peekers--;
+    pthread_mutex_unlock(&table_barrier_lock);
+#endif
+}
+
+#ifdef __GNUC__
+#define prefetch_line(p) __builtin_prefetch(p)
+#else
+#define prefetch_line(p)
+#endif
+
+/* Returns the head of the chain hv belongs to. */
+static item **_hashtable_head(const uint32_t hv) {
+    item **head;
+    unsigned int oldbucket, seq;
+
+    do {
+        seq = table_read_begin();
+        if (expanding &&
+            (oldbucket = (hv & hashmask(hashpower - 1))) >= expand_bucket)
+        {
+            head = &old_hashtable[oldbucket];
+        } else if (shrinking &&
+            (hv & hashmask(hashpower)) >= expand_bucket)
+        {
+            head = &old_hashtable[hv & hashmask(hashpower + 1)];
+        } else {
+            head = &primary_hashtable[hv & hashmask(hashpower)];
+        }
+    } while (table_read_retry(seq));
+    return head;
+}
+
+/*
+ * Bucketed engine (-o hash_engine=bucketed).
+ *
+ * Each bucket is a single 64 byte cache line holding a handful of one byte
+ * tags followed by the matching item pointers. A lookup compares the tags
+ * first and only dereferences the items whose tag matches, instead of
+ * walking h_next through every item header in the chain. The tag word is
+ * compared in one go with SSE2 where the CPU has it (see assoc_match.h).
+ *
+ * Items which don't fit into the line are chained off the bucket's overflow
+ * pointer via h_next. Everything a bucket owns is reachable from its index
+ * alone, so the item lock for hv still covers the whole bucket and expansion
+ * migrates with bucket granularity exactly like the chained table does.
+ */
+#define ASSOC_BUCKET_SLOTS 6
+/* Grow once we average this many items per bucket. */
+#define ASSOC_BUCKET_LOAD 3
+
+typedef struct {
+    /* Only the first ASSOC_BUCKET_SLOTS are used. 0 marks an empty slot,
+     * which also keeps the unused tail from ever matching. */
+    uint8_t tags[ASSOC_TAG_BYTES];
+    item *slots[ASSOC_BUCKET_SLOTS];
+    item *overflow;
+} assoc_bucket;
+
+static bool bucketed = false;
+static assoc_bucket *primary_buckets = 0;
+static assoc_bucket *old_buckets = 0;
+
+/* Size of one bucket for whichever engine is in use. */
+static size_t bucket_bytes = sizeof(void *);
+
+static assoc_match_func bucket_match = assoc_match_scalar;
+
+/* The low bits of hv select the bucket, so they're identical for everything
+ * sharing one. The multiply folds the remaining bits into the top byte. */
+static inline uint8_t bucket_tag(const uint32_t hv) {
+    uint8_t tag = (hv * 0x9E3779B1) >> 24;
+    return tag ? tag : 1;
+}
+
+static void *assoc_alloc_table(const unsigned int power) {
+    void *table = NULL;
+
+    if (!bucketed)
+        return calloc(hashsize(power), sizeof(void *));
+    if (posix_memalign(&table, 64, hashsize(power) * bucket_bytes) != 0)
+        return NULL;
+    memset(table, 0, hashsize(power) * bucket_bytes);
+    return table;
+}
+
+static assoc_bucket *_bucket_for(const uint32_t hv) {
+    assoc_bucket *b;
+    unsigned int oldbucket, seq;
+
+    do {
+        seq = table_read_begin();
+        if (expanding &&
+            (oldbucket = (hv & hashmask(hashpower - 1))) >= expand_bucket)
+        {
+            b = &old_buckets[oldbucket];
+        } else if (shrinking &&
+            (hv & hashmask(hashpower)) >= expand_bucket)
+        {
+            b = &old_buckets[hv & hashmask(hashpower + 1)];
+        } else {
+            b = &primary_buckets[hv & hashmask(hashpower)];
+        }
+    } while (table_read_retry(seq));
+    return b;
+}
+
+/* With -o item_hash a differing cached hash rules an item out before the
+ * key compare has to touch the key. */
+#define ITEM_hash_differs(it, hv) \
+    (((it)->it_flags & ITEM_HASHED) && (it)->hv != (hv))
+
+static item *bucket_find(const assoc_bucket *b, const char *key,
+                         const size_t nkey, const uint32_t hv, int *depth) {
+    uint32_t mask = bucket_match(b->tags, bucket_tag(hv));
+    item *it;
+    int i;
+
+    for (i = 0; mask; i++, mask >>= 1) {
+        if (!(mask & 1))
+            continue;
+        it = b->slots[i];
+        ++*depth;
+        if ((nkey == it->nkey) && !ITEM_hash_differs(it, hv) &&
+            (memcmp(key, ITEM_key(it), nkey) == 0))
+            return it;
+    }
+    for (it = b->overflow; it; it = it->h_next) {
+        ++*depth;
+        if ((nkey == it->nkey) && !ITEM_hash_differs(it, hv) &&
+            (memcmp(key, ITEM_key(it), nkey) == 0))
+            return it;
+    }
+    return NULL;
+}
+
+static void bucket_insert(assoc_bucket *b, item *it, const uint8_t tag) {
+    int i;
+
+    for (i = 0; i < ASSOC_BUCKET_SLOTS; i++) {
+        if (b->tags[i] == 0) {
+            b->tags[i] = tag;
+            b->slots[i] = it;
+            it->h_next = 0;
+            return;
+        }
+    }
+    it->h_next = b->overflow;
+    b->overflow = it;
+}
+
+/* Returns true if the key was found and removed. */
+static bool bucket_delete(assoc_bucket *b, const char *key,
+                          const size_t nkey, const uint32_t hv) {
+    uint32_t mask = bucket_match(b->tags, bucket_tag(hv));
+    item **pos;
+    int i;
+
+    for (i = 0; mask; i++, mask >>= 1) {
+        item *it = b->slots[i];
+        if ((mask & 1) && (nkey == it->nkey) &&
+            (memcmp(key, ITEM_key(it), nkey) == 0)) {
+            b->tags[i] = 0;
+            b->slots[i] = NULL;
+            return true;
+        }
+    }
+    pos = &b->overflow;
+    while (*pos && ((nkey != (*pos)->nkey) || memcmp(key, ITEM_key(*pos), nkey))) {
+        pos = &(*pos)->h_next;
+    }
+    if (*pos) {
+        item *nxt = (*pos)->h_next;
+        (*pos)->h_next = 0;
+        *pos = nxt;
+        return true;
+    }
+    return false;
+}
+
+/* Moves everything in an old bucket over to the primary table. */
+static void bucket_migrate(assoc_bucket *b) {
+    item *it, *next;
+    uint32_t hv;
+    int i;
+
+    for (i = 0; i < ASSOC_BUCKET_SLOTS; i++) {
+        if (b->tags[i] == 0)
+            continue;
+        it = b->slots[i];
+        hv = ITEM_hash(it);
+        bucket_insert(&primary_buckets[hv & hashmask(hashpower)], it,
+                      bucket_tag(hv));
+    }
+    for (it = b->overflow; NULL != it; it = next) {
+        next = it->h_next;
+        hv = ITEM_hash(it);
+        bucket_insert(&primary_buckets[hv & hashmask(hashpower)], it,
+                      bucket_tag(hv));
+    }
+    memset(b, 0, sizeof(*b));
+}
+
+/* Folds an old bucket into the one it maps to in the smaller table. Slotted
+ * items keep their tags; only overflowed ones need rehashing. */
+static void bucket_fold(assoc_bucket *dst, assoc_bucket *b) {
+    item *it, *next;
+    int i;
+
+    for (i = 0; i < ASSOC_BUCKET_SLOTS; i++) {
+        if (b->tags[i] != 0)
+            bucket_insert(dst, b->slots[i], b->tags[i]);
+    }
+    for (it = b->overflow; NULL != it; it = next) {
+        next = it->h_next;
+        bucket_insert(dst, it, bucket_tag(ITEM_hash(it)));
+    }
+    memset(b, 0, sizeof(*b));
+}
+
+/* Item counts at which the table grows or shrinks at the current size. */
+static unsigned int assoc_expand_above(void) {
+    return bucketed ? hashsize(hashpower) * ASSOC_BUCKET_LOAD
+                    : (hashsize(hashpower) * 3) / 2;
+}
+
+static void assoc_set_shrink_below(void) {
+    if (settings.hash_shrink_load > 0 && hashpower > hashpower_min) {
+        shrink_below = hashsize(hashpower) * settings.hash_shrink_load;
+    } else {
+        shrink_below = 0;
+    }
+}
+
 //ĬϲΪ0.mainãĬֵΪ0
-void assoc_init(const int hashtable_init) {
+void assoc_init(const int hashtable_init, const enum assoc_engine_type type) {
+    void *table;
+
     if (hashtable_init) {
         hashpower = hashtable_init;
+    }
+    hashpower_min = hashpower;
+    assoc_set_shrink_below();
+    switch (type) {
+        case ASSOC_BUCKETED:
+            bucketed = true;
+            bucket_bytes = sizeof(assoc_bucket);
+            bucket_match = assoc_match_select(&settings.hash_tag_match);
+            settings.hash_engine = "bucketed";
+            break;
+        default:
+            settings.hash_tag_match = "none";
+            settings.hash_engine = "chained";
+            break;
     }
 	//ΪϣҪʹö̬ڴ䡣ϣ洢һ
 	//ָ룬ʡռ䡣
 	//hashsize(hashpower)ǹϣĳ
-    primary_hashtable = calloc(hashsize(hashpower), sizeof(void *));
-    if (! primary_hashtable) {
+    table = assoc_alloc_table(hashpower);
+    if (! table) {
         fprintf(stderr, "Failed to init hashtable.\n");
         exit(EXIT_FAILURE);//ϣmemcachedĻʧֻ˳
     }
+    if (bucketed) {
+        primary_buckets = table;
+    } else {
+        primary_hashtable = table;
+    }
     STATS_LOCK();
     stats.hash_power_level = hashpower;
-    stats.hash_bytes = hashsize(hashpower) * sizeof(void *);
+    stats.hash_bytes = hashsize(hashpower) * bucket_bytes;
     STATS_UNLOCK();
 }
 
@@ -89,23 +431,24 @@ void assoc_init(const int hashtable_init) {
 //ָkeyĳ       ڿٲҸkeyӦitemassoc_find   itemhashassoc_insert
 item *assoc_find(const char *key, const size_t nkey, const uint32_t hv) {
     item *it;
-    unsigned int oldbucket;
 
-    if (expanding &&
-        (oldbucket = (hv & hashmask(hashpower - 1))) >= expand_bucket)
-    {
-        it = old_hashtable[oldbucket];
-    } else {
-    	//ɹϣֵжkeyĸͰ
-        it = primary_hashtable[hv & hashmask(hashpower)];
+    if (bucketed) {
+        int depth = 0;
+        it = bucket_find(_bucket_for(hv), key, nkey, hv, &depth);
+        MEMCACHED_ASSOC_FIND(key, nkey, depth);
+        return it;
     }
 
+	//ɹϣֵжkeyĸͰ
+    it = *_hashtable_head(hv);
+
 	//ѾȷkeyĸͰģӦͰĳͻ
     item *ret = NULL;
     int depth = 0;
     while (it) {
 		//ͬ²ŵmemcmpȽϣЧ
-        if ((nkey == it->nkey) && (memcmp(key, ITEM_key(it), nkey) == 0)) {
+        if ((nkey == it->nkey) && !ITEM_hash_differs(it, hv) &&
+            (memcmp(key, ITEM_key(it), nkey) == 0)) {
             ret = it;
             break;
         }
@@ -116,23 +459,97 @@ item *assoc_find(const char *key, const size_t nkey, const uint32_t hv) {
     return ret;
 }
 
+/* Longest chain assoc_find_unlocked() walks before leaving it to the lock. */
+#define ASSOC_UNLOCKED_DEPTH 32
+
+/*
+ * assoc_find() for -o seqlock_gets readers, which hold no item lock. The
+ * bucket may change under us, so the caller validates whatever we return
+ * against the stripe's sequence counter. A slot can be seen with its tag
+ * already set and its pointer not yet, hence the NULL check, and a chain
+ * rewritten mid-walk could send us around in circles, hence the depth cap.
+ * Returns false if the walk gave up.
+ */
+bool assoc_find_unlocked(const char *key, const size_t nkey, const uint32_t hv,
+                         item **found) {
+    item *it;
+    int depth = 0;
+
+    if (bucketed) {
+        const assoc_bucket *b = _bucket_for(hv);
+        uint32_t mask = bucket_match(b->tags, bucket_tag(hv));
+        int i;
+
+        for (i = 0; mask; i++, mask >>= 1) {
+            if (!(mask & 1) || (it = b->slots[i]) == NULL)
+                continue;
+            if ((nkey == it->nkey) && !ITEM_hash_differs(it, hv) &&
+                (memcmp(key, ITEM_key(it), nkey) == 0)) {
+                *found = it;
+                return true;
+            }
+        }
+        it = b->overflow;
+    } else {
+        it = *_hashtable_head(hv);
+    }
+
+    for (; it; it = it->h_next) {
+        if (++depth > ASSOC_UNLOCKED_DEPTH)
+            return false;
+        if ((nkey == it->nkey) && !ITEM_hash_differs(it, hv) &&
+            (memcmp(key, ITEM_key(it), nkey) == 0)) {
+            *found = it;
+            return true;
+        }
+    }
+    *found = NULL;
+    return true;
+}
+
+/*
+ * Warms the cache for a batch of lookups (see item_get_batch()). All of the
+ * bucket lines are requested before any of them is read, then whatever items
+ * those buckets point at are requested as well, so that the assoc_find()
+ * calls which follow mostly hit.
+ */
+void assoc_prefetch(const uint32_t *hv, const int count) {
+    void *where[ITEM_GET_BATCH];
+    int i, j;
+
+    assert(count <= ITEM_GET_BATCH);
+    table_peek_begin();
+    for (i = 0; i < count; i++) {
+        where[i] = bucketed ? (void *)_bucket_for(hv[i])
+                            : (void *)_hashtable_head(hv[i]);
+        prefetch_line(where[i]);
+    }
+    for (i = 0; i < count; i++) {
+        if (bucketed) {
+            const assoc_bucket *b = where[i];
+            uint32_t mask = bucket_match(b->tags, bucket_tag(hv[i]));
+
+            if (mask == 0)
+                prefetch_line(b->overflow);
+            for (j = 0; mask; j++, mask >>= 1) {
+                if (mask & 1)
+                    prefetch_line(b->slots[j]);
+            }
+        } else {
+            prefetch_line(*(item **)where[i]);
+        }
+    }
+    table_peek_end();
+}
+
 /* returns the address of the item pointer before the key.  if *item == 0,
    the item wasn't found */
 //itemǰh_nextԱַʧôͷسͻ
 //һڵh_nextԱַΪһڵh_nextֵΪNULLͨԷֵ
 //ʹ*㼴֪ûвҳɹ
 static item** _hashitem_before (const char *key, const size_t nkey, const uint32_t hv) {
-    item **pos;
-    unsigned int oldbucket;
-
-    if (expanding && //չϣ
-        (oldbucket = (hv & hashmask(hashpower - 1))) >= expand_bucket)
-    {
-        pos = &old_hashtable[oldbucket];
-    } else {
-    	//ҵϣжӦͰλ
-        pos = &primary_hashtable[hv & hashmask(hashpower)];
-    }
+	//ҵϣжӦͰλ
+    item **pos = _hashtable_head(hv);
 
 	//Ͱĳͻitem
     while (*pos && ((nkey != (*pos)->nkey) || memcmp(key, ITEM_key(*pos), nkey))) {
@@ -145,60 +562,114 @@ static item** _hashitem_before (const char *key, const size_t nkey, const uint32
 /* grows the hashtable to the next power of 2. */
 //ϣı
 static void assoc_expand(void) {
-    old_hashtable = primary_hashtable;
+    void *table;
 
 	//һ¹ϣold_hashtableָɹϣ
-    primary_hashtable = calloc(hashsize(hashpower + 1), sizeof(void *));
-    if (primary_hashtable) {
+    table = assoc_alloc_table(hashpower + 1);
+    if (table) {
         if (settings.verbose > 1)
             fprintf(stderr, "Hash table expansion starting\n");
+        table_write_begin();
+        if (bucketed) {
+            old_buckets = primary_buckets;
+            primary_buckets = table;
+        } else {
+            old_hashtable = primary_hashtable;
+            primary_hashtable = table;
+        }
         hashpower++;
-		//Ѿչ״̬
-        expanding = true;
 		//0ͰʼǨ
         expand_bucket = 0;
+		//Ѿչ״̬
+        expanding = true;
+        table_write_end();
         STATS_LOCK();
         stats.hash_power_level = hashpower;
-        stats.hash_bytes += hashsize(hashpower) * sizeof(void *);
+        stats.hash_bytes += hashsize(hashpower) * bucket_bytes;
         stats.hash_is_expanding = 1;
+        stats.hash_expand_buckets = 0;
         STATS_UNLOCK();
+        assoc_set_shrink_below();
     } else {
-        primary_hashtable = old_hashtable;
         /* Bad news, but we can keep running. */
     }
 }
 
 //assoc_insertñitem˹ϣ1.5Ż 
 static void assoc_start_expand(void) {
-    if (started_expanding)
+    if (started_expanding || started_shrinking)
         return;
 
     started_expanding = true;
     pthread_cond_signal(&maintenance_cond);
 }
 
+/* halves the hashtable, same swap as assoc_expand() */
+static void assoc_shrink(void) {
+    void *table;
+
+    pthread_mutex_lock(&hash_items_counter_lock);
+    if (hash_items >= shrink_below) {
+        /* Filled back up while we were waking. */
+        pthread_mutex_unlock(&hash_items_counter_lock);
+        return;
+    }
+    pthread_mutex_unlock(&hash_items_counter_lock);
+
+    table = assoc_alloc_table(hashpower - 1);
+    if (! table)
+        return;
+    if (settings.verbose > 1)
+        fprintf(stderr, "Hash table shrink starting\n");
+    table_write_begin();
+    if (bucketed) {
+        old_buckets = primary_buckets;
+        primary_buckets = table;
+    } else {
+        old_hashtable = primary_hashtable;
+        primary_hashtable = table;
+    }
+    hashpower--;
+    expand_bucket = 0;
+    shrinking = true;
+    table_write_end();
+    STATS_LOCK();
+    stats.hash_power_level = hashpower;
+    stats.hash_bytes += hashsize(hashpower) * bucket_bytes;
+    stats.hash_is_expanding = 1;
+    stats.hash_expand_buckets = 0;
+    STATS_UNLOCK();
+    assoc_set_shrink_below();
+}
+
+static void assoc_start_shrink(void) {
+    if (started_expanding || started_shrinking)
+        return;
+
+    started_shrinking = true;
+    pthread_cond_signal(&maintenance_cond);
+}
+
 /* Note: this isn't an assoc_update.  The key must not already exist to call this */
 //hvitemֵĹϣֵڿٲҸkeyӦitemassoc_find   itemhashassoc_insert
 int assoc_insert(item *it, const uint32_t hv) {
-    unsigned int oldbucket; // hashΪassoc_insert  lruеĺΪitem_link_q
+    // hashΪassoc_insert  lruеĺΪitem_link_q
 
 //    assert(assoc_find(ITEM_key(it), it->nkey) == 0);  /* shouldn't have duplicately named things defined */
 	//ʹͷ巨һitem
 	//һοֱӿelse
-    if (expanding &&
-        (oldbucket = (hv & hashmask(hashpower - 1))) >= expand_bucket)
-    {
-        it->h_next = old_hashtable[oldbucket];
-        old_hashtable[oldbucket] = it;
+    if (bucketed) {
+        bucket_insert(_bucket_for(hv), it, bucket_tag(hv));
     } else {
     	//ʹͷ巨ϣ
-        it->h_next = primary_hashtable[hv & hashmask(hashpower)];
-        primary_hashtable[hv & hashmask(hashpower)] = it;
+        item **head = _hashtable_head(hv);
+        it->h_next = *head;
+        *head = it;
     }
 
     pthread_mutex_lock(&hash_items_counter_lock);
     hash_items++;//ϣitemһ
-    if (! expanding && hash_items > (hashsize(hashpower) * 3) / 2) {
+    if (! expanding && ! shrinking && hash_items > assoc_expand_above()) {
         assoc_start_expand();
     }
     pthread_mutex_unlock(&hash_items_counter_lock);
@@ -207,15 +678,33 @@ int assoc_insert(item *it, const uint32_t hv) {
     return 1;
 }
 
+static void hash_items_decr(void) {
+    pthread_mutex_lock(&hash_items_counter_lock);
+    hash_items--;
+    if (! expanding && ! shrinking && hash_items < shrink_below) {
+        assoc_start_shrink();
+    }
+    pthread_mutex_unlock(&hash_items_counter_lock);
+}
+
 void assoc_delete(const char *key, const size_t nkey, const uint32_t hv) {
+    if (bucketed) {
+        if (bucket_delete(_bucket_for(hv), key, nkey, hv)) {
+            hash_items_decr();
+            MEMCACHED_ASSOC_DELETE(key, nkey, hash_items);
+            return;
+        }
+        /* As below, callers don't delete things they can't find. */
+        assert(0);
+        return;
+    }
+
 	//õǰh_nextԱַ
     item **before = _hashitem_before(key, nkey, hv);
 
     if (*before) {//ҳɹ
         item *nxt;
-        pthread_mutex_lock(&hash_items_counter_lock);
-        hash_items--;
-        pthread_mutex_unlock(&hash_items_counter_lock);
+        hash_items_decr();
         /* The DTrace probe cannot be triggered as the last instruction
          * due to possible tail-optimization by the compiler
          */
@@ -240,78 +729,155 @@ static volatile int do_run_maintenance_thread = 1;
 #define DEFAULT_HASH_BULK_MOVE 1
 int hash_bulk_move = DEFAULT_HASH_BULK_MOVE;
 
+/* Moves old bucket `moving` into the larger primary table. */
+static void assoc_expand_bucket(const unsigned int moving) {
+    item *it, *next;
+    int bucket;
+
+    if (bucketed) {
+        bucket_migrate(&old_buckets[moving]);
+        return;
+    }
+    for (it = old_hashtable[moving]; NULL != it; it = next) {
+        next = it->h_next;
+        bucket = ITEM_hash(it) & hashmask(hashpower);
+        it->h_next = primary_hashtable[bucket];
+        primary_hashtable[bucket] = it;
+    }
+
+    old_hashtable[moving] = NULL;
+}
+
+/* Folds both old buckets mapping to new bucket `moving` into it. */
+static void assoc_shrink_bucket(const unsigned int moving) {
+    const unsigned int upper = moving + hashsize(hashpower);
+    item **tail;
+
+    if (bucketed) {
+        bucket_fold(&primary_buckets[moving], &old_buckets[moving]);
+        bucket_fold(&primary_buckets[moving], &old_buckets[upper]);
+        return;
+    }
+    /* Everything in either chain belongs here, so just splice them. */
+    tail = &old_hashtable[moving];
+    while (*tail)
+        tail = &(*tail)->h_next;
+    *tail = old_hashtable[upper];
+    primary_hashtable[moving] = old_hashtable[moving];
+    old_hashtable[moving] = NULL;
+    old_hashtable[upper] = NULL;
+}
+
+static void assoc_migrate_done(void) {
+    /* Size of the table we're done with. */
+    const unsigned int old_power = expanding ? hashpower - 1 : hashpower + 1;
+
+    /* Every bucket has moved, so nothing new can find the old table. Wait
+     * out any assoc_prefetch() which got there before that. */
+    table_barrier();
+    while (table_peekers)
+        ;
+    /* Likewise any seqlock_gets reader still walking it. */
+    item_read_quiesce();
+
+    if (bucketed) {
+        free(old_buckets);
+        old_buckets = NULL;
+    } else {
+        free(old_hashtable);
+        old_hashtable = NULL;
+    }
+    STATS_LOCK();
+    stats.hash_bytes -= hashsize(old_power) * bucket_bytes;
+    stats.hash_is_expanding = 0;
+    stats.hash_expand_buckets = expand_bucket;
+    if (expanding) {
+        stats.hash_expansions++;
+    } else {
+        stats.hash_shrinks++;
+    }
+    STATS_UNLOCK();
+    if (settings.verbose > 1)
+        fprintf(stderr, "Hash table %s done\n", expanding ? "expansion" : "shrink");
+    expanding = false;
+    shrinking = false;
+}
+
 //Ǩ̻߳ص
 static void *assoc_maintenance_thread(void *arg) {
 
+    mutex_lock(&maintenance_lock);
 	//do_run_maintenance_thread ȫֱʼֵΪ1stop_assoc_mainternance_thread
 	//лᱻֵ0֮Ǩ߳
     while (do_run_maintenance_thread) {
         int ii = 0;
+        bool shrunk = false;
 
         /* There is only one expansion thread, so no need to global lock. */
-         //
 		//itemǨ
-        for (ii = 0; ii < hash_bulk_move && expanding; ++ii) {
-            item *it, *next;
-            int bucket;
-            void *item_lock = NULL;
+        for (ii = 0; ii < hash_bulk_move && (expanding || shrinking); ++ii) {
+            unsigned int moving = expand_bucket;
 
             /* bucket = hv & hashmask(hashpower) =>the bucket of hash table
              * is the lowest N bits of the hv, and the bucket of item_locks is
              *  also the lowest M bits of hv, and N is greater than M.
-             *  So we can process expanding with only one item_lock. cool! */
-            if ((item_lock = item_trylock(expand_bucket))) {
-                    for (it = old_hashtable[expand_bucket]; NULL != it; it = next) {
-                        next = it->h_next;
-                        bucket = hash(ITEM_key(it), it->nkey) & hashmask(hashpower);
-                        it->h_next = primary_hashtable[bucket];
-                        primary_hashtable[bucket] = it;
-                    }
-
-                    old_hashtable[expand_bucket] = NULL;
-
-                    expand_bucket++;
-                    if (expand_bucket == hashsize(hashpower - 1)) {
-                        expanding = false;
-                        free(old_hashtable);
-                        STATS_LOCK();
-                        stats.hash_bytes -= hashsize(hashpower - 1) * sizeof(void *);
-                        stats.hash_is_expanding = 0;
-                        STATS_UNLOCK();
-                        if (settings.verbose > 1)
-                            fprintf(stderr, "Hash table expansion done\n");
-                    }
-
+             *  So we can process expanding with only one item_lock. cool!
+             * Every bucket touched by one step shares those low bits, in
+             * either direction, so the same lock covers all of them. */
+            item_lock(moving);
+            if (expanding) {
+                assoc_expand_bucket(moving);
             } else {
-                usleep(10*1000);
+                assoc_shrink_bucket(moving);
             }
-
-            if (item_lock) {
-                item_trylock_unlock(item_lock);
-                item_lock = NULL;
+            /* Must move on before dropping the lock, or the next holder would
+             * still be sent to the (now empty) old bucket. Readers holding
+             * any other bucket's lock see expand_bucket either side of this
+             * one, which sends them to the same table. */
+            expand_bucket++;
+            item_unlock(moving);
+
+            if ((expand_bucket & 1023) == 0) {
+                STATS_LOCK();
+                stats.hash_expand_buckets = expand_bucket;
+                STATS_UNLOCK();
+            }
+            if (expand_bucket == hashsize(expanding ? hashpower - 1 : hashpower)) {
+                shrunk = shrinking;
+                assoc_migrate_done();
             }
         }
 
 		//ҪǨ
-        if (!expanding) {
+        if (!expanding && !shrinking) {
             /* We are done expanding.. just wait for next invocation */
 			// 
             started_expanding = false;
+            started_shrinking = false;
+            /* Deletes stop triggering a shrink while one runs, so a table
+             * emptied all at once would stop one size down. Keep halving
+             * while it's still under hash_shrink_load. */
+            if (shrunk) {
+                pthread_mutex_lock(&hash_items_counter_lock);
+                started_shrinking = hash_items < shrink_below;
+                pthread_mutex_unlock(&hash_items_counter_lock);
+            }
 			//Ḳֱ̌߳worker̲߳ݺitemѾ1.5ϣС
 			//ʱworker̵߳assoc_start_expandúpthread_cond_signalǨ߳
-            pthread_cond_wait(&maintenance_cond, &maintenance_lock);
-            /* assoc_expand() swaps out the hash table entirely, so we need
-             * all threads to not hold any references related to the hash
-             * table while this happens.
-             * This is instead of a more complex, possibly slower algorithm to
-             * allow dynamic hash table expansion without causing significant
-             * wait times.
-             */
-            pause_threads(PAUSE_ALL_THREADS);
-            assoc_expand();//ĹϣexpandingΪtrue
-            pause_threads(RESUME_ALL_THREADS);
+            if (!started_shrinking)
+                pthread_cond_wait(&maintenance_cond, &maintenance_lock);
+            /* The tables are swapped under table_seq, so worker threads
+             * keep running; see the comment above table_seq. */
+            if (!do_run_maintenance_thread)
+                break;
+            if (started_shrinking) {
+                assoc_shrink();
+            } else if (started_expanding) {
+                assoc_expand();//ĹϣexpandingΪtrue
+            }
         }
     }
+    mutex_unlock(&maintenance_lock);
     return NULL;
 }
 
@@ -1,6 +1,13 @@
 /* associative array */
-void assoc_init(const int hashpower_init);
+enum assoc_engine_type {
+    ASSOC_CHAINED=0, ASSOC_BUCKETED
+};
+
+void assoc_init(const int hashpower_init, const enum assoc_engine_type type);
 item *assoc_find(const char *key, const size_t nkey, const uint32_t hv);
+bool assoc_find_unlocked(const char *key, const size_t nkey, const uint32_t hv,
+                         item **found);
+void assoc_prefetch(const uint32_t *hv, const int count);
 int assoc_insert(item *item, const uint32_t hv);
 void assoc_delete(const char *key, const size_t nkey, const uint32_t hv);
 void do_assoc_move_next_bucket(void);
@@ -0,0 +1,124 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ * Tag matching for the bucketed hash engine.
+ *
+ * A bucket starts with an 8 byte word of one byte tags. These return a bit
+ * mask with bit N set for every slot N whose tag equals the one we're after,
+ * so the caller only has to memcmp() the keys of the slots that matched.
+ *
+ * Kept free of memcached.h so devtools/bench_tagmatch.c can time the
+ * implementations against each other.
+ */
+#ifndef ASSOC_MATCH_H
+#define ASSOC_MATCH_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#define ASSOC_TAG_BYTES 8
+
+typedef uint32_t (*assoc_match_func)(const uint8_t *tags, const uint8_t tag);
+
+static inline uint32_t assoc_match_scalar(const uint8_t *tags, const uint8_t tag) {
+    uint32_t mask = 0;
+    int i;
+
+    for (i = 0; i < ASSOC_TAG_BYTES; i++) {
+        if (tags[i] == tag)
+            mask |= 1 << i;
+    }
+    return mask;
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_ASSOC_MATCH_SSE2 1
+#include <emmintrin.h>
+
+/* One compare across the whole tag word. */
+__attribute__((target("sse2")))
+static inline uint32_t assoc_match_sse2(const uint8_t *tags, const uint8_t tag) {
+    __m128i word = _mm_loadl_epi64((const __m128i *)tags);
+    __m128i cmp = _mm_cmpeq_epi8(word, _mm_set1_epi8((char)tag));
+    return _mm_movemask_epi8(cmp) & ((1 << ASSOC_TAG_BYTES) - 1);
+}
+#endif
+
+#define ASSOC_CALIBRATE_BUCKETS 256
+#define ASSOC_CALIBRATE_PROBES (1 << 18)
+
+/* Microseconds fn takes for the calibration probes. It's called through a
+ * pointer, the way bucket_find() calls it. */
+static inline uint64_t assoc_match_time(assoc_match_func fn,
+                                        const uint8_t *table) {
+    assoc_match_func volatile match = fn;
+    struct timeval start, end;
+    uint32_t state = 12345, hits = 0;
+    int i;
+
+    gettimeofday(&start, NULL);
+    for (i = 0; i < ASSOC_CALIBRATE_PROBES; i++) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        hits += match(table + (state % ASSOC_CALIBRATE_BUCKETS) * 64,
+                      (state >> 24) | 1);
+    }
+    gettimeofday(&end, NULL);
+    /* Keeps the loop from being thrown away. */
+    if (hits == 0xffffffff)
+        return 0;
+    return (uint64_t)(end.tv_sec - start.tv_sec) * 1000000
+        + end.tv_usec - start.tv_usec;
+}
+
+/*
+ * Picks an implementation by *name: "scalar", "sse2", or "auto" for
+ * whichever is fastest here. Which one wins depends on the CPU, so "auto"
+ * times them on a small, cached table of tag words, best of three runs
+ * each. *name is set to the one picked.
+ */
+static inline assoc_match_func assoc_match_select(const char **name) {
+#ifdef HAVE_ASSOC_MATCH_SSE2
+    uint64_t t_scalar = UINT64_MAX, t_sse2 = UINT64_MAX, t;
+    uint32_t state = 42;
+    uint8_t *table;
+    int i;
+
+    __builtin_cpu_init();
+    if (!__builtin_cpu_supports("sse2") || strcmp(*name, "scalar") == 0) {
+        *name = "scalar";
+        return assoc_match_scalar;
+    }
+    if (strcmp(*name, "sse2") == 0)
+        return assoc_match_sse2;
+
+    table = calloc(ASSOC_CALIBRATE_BUCKETS, 64);
+    if (table == NULL) {
+        *name = "sse2";
+        return assoc_match_sse2;
+    }
+    for (i = 0; i < ASSOC_CALIBRATE_BUCKETS * 64; i++) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        table[i] = (state >> 24) | 1;
+    }
+    for (i = 0; i < 3; i++) {
+        if ((t = assoc_match_time(assoc_match_scalar, table)) < t_scalar)
+            t_scalar = t;
+        if ((t = assoc_match_time(assoc_match_sse2, table)) < t_sse2)
+            t_sse2 = t;
+    }
+    free(table);
+    if (t_sse2 < t_scalar) {
+        *name = "sse2";
+        return assoc_match_sse2;
+    }
+#endif
+    *name = "scalar";
+    return assoc_match_scalar;
+}
+
+#endif /* ASSOC_MATCH_H */
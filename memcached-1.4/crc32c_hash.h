@@ -0,0 +1,27 @@
+#ifndef CRC32C_HASH_H
+#define    CRC32C_HASH_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef    __cplusplus
+extern "C" {
+#endif
+
+/* Table driven, works everywhere. */
+uint32_t crc32c_hash(const void *key, size_t length);
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define HAVE_CRC32C_SSE42 1
+/* Same result using the SSE4.2 crc32 instruction. Only call these after
+ * checking __builtin_cpu_supports("sse4.2"). */
+uint32_t crc32c_hash_sse42(const void *key, size_t length);
+void crc32c_hash_sse42_batch(const char * const *keys, const size_t *lengths,
+                             uint32_t *hv, const int count);
+#endif
+
+#ifdef    __cplusplus
+}
+#endif
+
+#endif    /* CRC32C_HASH_H */
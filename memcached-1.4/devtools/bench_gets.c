@@ -0,0 +1,229 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ * Load generator for the get path of a running memcached.
+ *
+ * Stores a set of small keys, then runs client threads, each on its own
+ * connection, sending one request at a time: gets, with a share of sets
+ * mixed in, over keys picked at random. Reports requests per second, so
+ * running it against a server with and without -o seqlock_gets compares the
+ * two read paths end to end. devtools/bench_seqlock.sh does that for 4
+ * through 64 client threads.
+ *
+ *   cc -O2 -pthread -o bench_gets devtools/bench_gets.c
+ *   ./bench_gets [host] [port] [threads] [seconds] [keys] [read_pct]
+ */
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#define MAX_THREADS 256
+#define VALUE_LEN 32
+
+static const char *host = "127.0.0.1";
+static const char *port = "11211";
+static int nkeys = 1000;
+static int read_pct = 95;
+static volatile int stop = 0;
+
+typedef struct {
+    pthread_t tid;
+    uint32_t seed;
+    uint64_t gets;
+    uint64_t sets;
+    uint64_t errors;
+} client;
+
+static double now(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static uint32_t rnd(uint32_t *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+static int connect_server(void) {
+    struct addrinfo hints, *ai, *p;
+    int fd = -1, one = 1;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host, port, &hints, &ai) != 0)
+        return -1;
+    for (p = ai; p != NULL; p = p->ai_next) {
+        fd = socket(p->ai_family, p->ai_socktype, p->ai_protocol);
+        if (fd < 0)
+            continue;
+        if (connect(fd, p->ai_addr, p->ai_addrlen) == 0)
+            break;
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(ai);
+    if (fd >= 0)
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+static int send_all(const int fd, const char *buf, size_t len) {
+    ssize_t n;
+
+    while (len > 0) {
+        if ((n = write(fd, buf, len)) <= 0) {
+            if (n < 0 && errno == EINTR)
+                continue;
+            return -1;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/* Reads until the reply ends with end. There's only ever one request
+ * outstanding, so that's the whole reply. */
+static int read_reply(const int fd, char *buf, const size_t size,
+                      const char *end) {
+    const size_t elen = strlen(end);
+    size_t used = 0;
+    ssize_t n;
+
+    for (;;) {
+        if ((n = read(fd, buf + used, size - used)) <= 0) {
+            if (n < 0 && errno == EINTR)
+                continue;
+            return -1;
+        }
+        used += n;
+        if (used >= elen && memcmp(buf + used - elen, end, elen) == 0)
+            return 0;
+        if (used == size)
+            return -1;
+    }
+}
+
+static void *client_thread(void *arg) {
+    client *me = arg;
+    char req[128], buf[512], value[VALUE_LEN + 1];
+    int fd, len;
+    uint32_t key;
+
+    memset(value, 'v', VALUE_LEN);
+    value[VALUE_LEN] = '\0';
+    if ((fd = connect_server()) < 0) {
+        me->errors++;
+        return NULL;
+    }
+    while (!stop) {
+        key = rnd(&me->seed) % nkeys;
+        if ((int)(rnd(&me->seed) % 100) < read_pct) {
+            len = snprintf(req, sizeof(req), "get bench:%u\r\n", key);
+            if (send_all(fd, req, len) != 0
+                || read_reply(fd, buf, sizeof(buf), "END\r\n") != 0)
+                break;
+            me->gets++;
+        } else {
+            len = snprintf(req, sizeof(req), "set bench:%u 0 0 %d\r\n%s\r\n",
+                           key, VALUE_LEN, value);
+            if (send_all(fd, req, len) != 0
+                || read_reply(fd, buf, sizeof(buf), "\r\n") != 0
+                || strncmp(buf, "STORED", 6) != 0)
+                break;
+            me->sets++;
+        }
+    }
+    if (!stop)
+        me->errors++;
+    close(fd);
+    return NULL;
+}
+
+/* Stores every key, a batch of noreply sets at a time. */
+static int fill(void) {
+    char buf[64 * 1024], value[VALUE_LEN + 1];
+    size_t used = 0;
+    int fd, i;
+
+    memset(value, 'v', VALUE_LEN);
+    value[VALUE_LEN] = '\0';
+    if ((fd = connect_server()) < 0)
+        return -1;
+    for (i = 0; i < nkeys; i++) {
+        used += snprintf(buf + used, sizeof(buf) - used,
+                         "set bench:%d 0 0 %d noreply\r\n%s\r\n",
+                         i, VALUE_LEN, value);
+        if (used > sizeof(buf) - 128) {
+            if (send_all(fd, buf, used) != 0)
+                break;
+            used = 0;
+        }
+    }
+    used += snprintf(buf + used, sizeof(buf) - used, "version\r\n");
+    if (send_all(fd, buf, used) != 0
+        || read_reply(fd, buf, sizeof(buf), "\r\n") != 0) {
+        close(fd);
+        return -1;
+    }
+    close(fd);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    static client clients[MAX_THREADS];
+    int threads = argc > 3 ? atoi(argv[3]) : 4;
+    int seconds = argc > 4 ? atoi(argv[4]) : 5;
+    uint64_t gets = 0, sets = 0, errors = 0;
+    double start, secs;
+    int i;
+
+    if (argc > 1)
+        host = argv[1];
+    if (argc > 2)
+        port = argv[2];
+    if (argc > 5)
+        nkeys = atoi(argv[5]);
+    if (argc > 6)
+        read_pct = atoi(argv[6]);
+    if (threads < 1 || threads > MAX_THREADS || seconds < 1 || nkeys < 1) {
+        fprintf(stderr, "usage: %s [host] [port] [threads] [seconds] [keys] "
+                "[read_pct]\n", argv[0]);
+        return 1;
+    }
+    if (fill() != 0) {
+        fprintf(stderr, "couldn't store the keys on %s:%s\n", host, port);
+        return 1;
+    }
+
+    start = now();
+    for (i = 0; i < threads; i++) {
+        clients[i].seed = 2463534242u + i * 7919;
+        pthread_create(&clients[i].tid, NULL, client_thread, &clients[i]);
+    }
+    sleep(seconds);
+    stop = 1;
+    for (i = 0; i < threads; i++) {
+        pthread_join(clients[i].tid, NULL);
+        gets += clients[i].gets;
+        sets += clients[i].sets;
+        errors += clients[i].errors;
+    }
+    secs = now() - start;
+    printf("%3d threads %10.0f req/s  %10.0f gets/s  %8.0f sets/s  "
+           "(%llu errors)\n", threads, (gets + sets) / secs, gets / secs,
+           sets / secs, (unsigned long long)errors);
+    return errors != 0;
+}
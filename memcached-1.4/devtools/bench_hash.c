@@ -0,0 +1,183 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ * Benchmark for the -o hash_algorithm choices.
+ *
+ * Builds a few key sets shaped like real traffic, then for every hash
+ * reports throughput (one key at a time, and through the batch entry point
+ * where one exists) and how evenly the keys spread over a power of two
+ * bucket count, the way assoc.c masks them.
+ *
+ *   cc -O2 -I. -DHAVE_CONFIG_H -o bench_hash devtools/bench_hash.c \
+ *       jenkins_hash.c murmur3_hash.c wyhash_hash.c crc32c_hash.c
+ *   ./bench_hash [keys] [hashpower]
+ */
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "jenkins_hash.h"
+#include "murmur3_hash.h"
+#include "wyhash_hash.h"
+#include "crc32c_hash.h"
+
+typedef uint32_t (*hash_func)(const void *key, size_t length);
+typedef void (*hash_batch_func)(const char * const *keys, const size_t *lengths,
+                                uint32_t *hv, const int count);
+
+#define BATCH 16
+#define ROUNDS 20
+
+/* Keeps the timed loops from being optimised away. */
+static volatile uint32_t sink;
+
+static double now(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static uint32_t rnd(uint32_t *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+/* Session style keys: a fixed prefix and a sequential id, about 30 bytes. */
+static int make_session(char *buf, size_t i, uint32_t *state) {
+    (void)state;
+    return sprintf(buf, "session:user:%010zu:v2", i);
+}
+
+/* Object cache keys: a path with a couple of random components, 60-130. */
+static int make_object(char *buf, size_t i, uint32_t *state) {
+    return sprintf(buf, "obj/tenant-%u/catalog/products/%08x%08x/"
+                   "variants/%zu/render?locale=en_US&w=%u",
+                   rnd(state) % 64, rnd(state), rnd(state), i,
+                   rnd(state) % 2000);
+}
+
+/* Opaque keys from clients that hash their own, 200 random letters. */
+static int make_blob(char *buf, size_t i, uint32_t *state) {
+    int n;
+    (void)i;
+    for (n = 0; n < 200; n++)
+        buf[n] = 'a' + rnd(state) % 26;
+    buf[n] = '\0';
+    return n;
+}
+
+static struct {
+    const char *name;
+    int (*make)(char *buf, size_t i, uint32_t *state);
+} keysets[] = {
+    { "session", make_session },
+    { "object", make_object },
+    { "blob", make_blob },
+};
+
+static struct {
+    const char *name;
+    hash_func hash;
+    hash_batch_func batch;
+} hashes[] = {
+    { "jenkins", jenkins_hash, NULL },
+    { "murmur3", MurmurHash3_x86_32, NULL },
+    { "wyhash", wyhash_hash, NULL },
+    { "crc32c", crc32c_hash, NULL },
+#ifdef HAVE_CRC32C_SSE42
+    { "crc32c-hw", crc32c_hash_sse42, crc32c_hash_sse42_batch },
+#endif
+};
+
+static void run(const char *name, hash_func hash, hash_batch_func batch,
+                char **keys, size_t *lengths, size_t nkeys, size_t bytes,
+                unsigned int hashpower) {
+    size_t nbuckets = (size_t)1 << hashpower, i, empty = 0, most = 0;
+    uint32_t *counts = calloc(nbuckets, sizeof(uint32_t));
+    uint32_t hv[BATCH];
+    double start, single, batched = 0, expect, chi = 0;
+    int r;
+
+    start = now();
+    for (r = 0; r < ROUNDS; r++) {
+        for (i = 0; i < nkeys; i++)
+            sink += hash(keys[i], lengths[i]);
+    }
+    single = now() - start;
+
+    if (batch) {
+        start = now();
+        for (r = 0; r < ROUNDS; r++) {
+            for (i = 0; i + BATCH <= nkeys; i += BATCH) {
+                batch((const char * const *)keys + i, lengths + i, hv, BATCH);
+                sink += hv[0];
+            }
+        }
+        batched = now() - start;
+    }
+
+    for (i = 0; i < nkeys; i++)
+        counts[hash(keys[i], lengths[i]) & (nbuckets - 1)]++;
+    expect = (double)nkeys / nbuckets;
+    for (i = 0; i < nbuckets; i++) {
+        chi += (counts[i] - expect) * (counts[i] - expect) / expect;
+        if (counts[i] == 0)
+            empty++;
+        if (counts[i] > most)
+            most = counts[i];
+    }
+
+    printf("  %-10s %8.1f MB/s %6.1f ns/key", name,
+           bytes * ROUNDS / single / 1048576, single * 1e9 / nkeys / ROUNDS);
+    if (batch) {
+        printf("  batch %6.1f ns/key", batched * 1e9 / nkeys / ROUNDS);
+    } else {
+        printf("  %19s", "");
+    }
+    /* chi^2 / buckets is ~1.0 for a uniform hash. */
+    printf("  chi2/n %5.3f  empty %5.2f%%  max %zu\n",
+           chi / nbuckets, 100.0 * empty / nbuckets, most);
+    free(counts);
+}
+
+int main(int argc, char **argv) {
+    size_t nkeys = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+    unsigned int hashpower = argc > 2 ? atoi(argv[2]) : 18;
+    size_t *lengths = malloc(nkeys * sizeof(size_t));
+    char **keys = malloc(nkeys * sizeof(char *));
+    char buf[256];
+    size_t s, h, i, bytes;
+
+#ifdef HAVE_CRC32C_SSE42
+    __builtin_cpu_init();
+    if (!__builtin_cpu_supports("sse4.2"))
+        hashes[sizeof(hashes) / sizeof(hashes[0]) - 1].hash = NULL;
+#endif
+
+    for (s = 0; s < sizeof(keysets) / sizeof(keysets[0]); s++) {
+        uint32_t state = 2463534242U;
+
+        for (i = 0, bytes = 0; i < nkeys; i++) {
+            lengths[i] = keysets[s].make(buf, i, &state);
+            keys[i] = strdup(buf);
+            bytes += lengths[i];
+        }
+        printf("%s keys: %zu, %.1f bytes average, %u buckets\n",
+               keysets[s].name, nkeys, (double)bytes / nkeys, 1U << hashpower);
+        for (h = 0; h < sizeof(hashes) / sizeof(hashes[0]); h++) {
+            if (hashes[h].hash == NULL)
+                continue;
+            run(hashes[h].name, hashes[h].hash, hashes[h].batch,
+                keys, lengths, nkeys, bytes, hashpower);
+        }
+        for (i = 0; i < nkeys; i++)
+            free(keys[i]);
+    }
+    free(keys);
+    free(lengths);
+    return 0;
+}
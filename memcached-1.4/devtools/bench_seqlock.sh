@@ -0,0 +1,40 @@
+#!/bin/sh
+#
+# Times the get path with and without -o seqlock_gets, from 4 to 64 client
+# threads, using devtools/bench_gets against a memcached started for each
+# run. A small, hot key set puts the clients on the same item lock stripes.
+#
+#   cc -O2 -pthread -o bench_gets devtools/bench_gets.c
+#   devtools/bench_seqlock.sh [server threads] [seconds] [keys] [read_pct]
+#
+# MEMCACHED and BENCH_GETS override where the binaries are looked for.
+
+MEMCACHED=${MEMCACHED:-./memcached}
+BENCH_GETS=${BENCH_GETS:-./bench_gets}
+WORKERS=${1:-4}
+SECONDS_PER_RUN=${2:-5}
+KEYS=${3:-1000}
+READ_PCT=${4:-95}
+PORT=11499
+
+USER_OPT=
+if [ "$(id -u)" = 0 ]; then
+    USER_OPT="-u root"
+fi
+
+for mode in mutex seqlock; do
+    if [ $mode = seqlock ]; then
+        OPTS="-o seqlock_gets"
+    else
+        OPTS=
+    fi
+    echo "$mode: $MEMCACHED -t $WORKERS $OPTS"
+    for clients in 4 8 16 32 64; do
+        $MEMCACHED $USER_OPT -p $PORT -U 0 -t $WORKERS -c 1024 $OPTS >/dev/null 2>&1 &
+        pid=$!
+        sleep 1
+        $BENCH_GETS 127.0.0.1 $PORT $clients $SECONDS_PER_RUN $KEYS $READ_PCT
+        kill $pid
+        wait $pid 2>/dev/null
+    done
+done
@@ -0,0 +1,558 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ * Trace replay for -o lru_engine.
+ *
+ * Replays a key trace against models of the eviction policies memcached can
+ * run, on one slab class of fixed size items, and reports each one's hit
+ * ratio and how many requests a second the model gets through on one core.
+ * A miss stores the key, as a cache-aside client would.
+ *
+ *   list       the old LRU: every hit relinks the item to the head
+ *   segmented  -o lru_maintainer: HOT/WARM/COLD, hits only set ACTIVE, the
+ *              maintainer moves active items up out of COLD
+ *   clock      -o lru_engine=clock: a hand over the slab's chunks, hits set
+ *              ACTIVE, the hand gives active items a second chance
+ *   sampled    -o lru_engine=sampled: evict the least recently used of N
+ *              random chunks
+ *
+ * list+admit and segmented+admit add -o lru_admission: every request bumps
+ * its key in a count-min sketch, and a miss is only stored if the key has
+ * been asked for at least as often as the item it would evict.
+ *
+ * list+cost and segmented+cost add -o lru_cost: each key gets a recompute
+ * cost, and an item at the tail goes round again while fewer than -w
+ * requests per unit of its cost have passed since its last access. -p
+ * percent of the keys cost -C units to recompute, the rest 1. Next to the
+ * hit ratio each policy reports the share of the trace's total recompute
+ * cost its misses paid.
+ *
+ * The trace is a file with a key per line ("get <key>" and "set <key>" lines
+ * work too), or without -f a Zipf distributed one, optionally with one-off
+ * scan keys mixed in.
+ *
+ *   cc -O2 -o lru_replay devtools/lru_replay.c -lm
+ *   ./lru_replay [-f trace] [-c items] [-n requests] [-k keys] [-a alpha]
+ *                [-s scan_pct] [-S samples] [-p cost_pct] [-C cost] [-w weight]
+ */
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#define NIL UINT32_MAX
+
+enum { HOT, WARM, COLD };
+
+typedef struct {
+    uint64_t key;
+    uint32_t prev;
+    uint32_t next;
+    uint32_t time;      /* request number of the last hit or store */
+    uint8_t lru;
+    uint8_t active;
+    uint8_t cost;
+} sim_item;
+
+typedef struct {
+    uint32_t head;
+    uint32_t tail;
+    uint32_t size;
+} sim_list;
+
+typedef struct {
+    const char *name;
+    void (*hit)(const uint32_t slot);
+    void (*store)(const uint32_t slot);
+    uint32_t (*victim)(void);   /* next eviction, left in place */
+    uint32_t (*evict)(void);
+    int admit;
+} policy;
+
+#define SKETCH_ROWS 4
+#define SKETCH_MAX 15
+#define COST_CANDIDATES 5
+
+static sim_item *items;
+static uint32_t capacity;
+static uint32_t used;
+static uint32_t now;
+static uint32_t *table;         /* slot + 1, 0 for empty */
+static uint32_t table_mask;
+static sim_list lists[3];
+static uint32_t hand;
+static unsigned int samples = 5;
+static uint64_t rnd_state = 88172645463325252ULL;
+static uint8_t *sketch[SKETCH_ROWS];
+static uint32_t sketch_mask;
+static uint32_t sketch_adds;
+static unsigned int cost_pct = 10;
+static unsigned int cost_high = 100;
+static uint32_t cost_weight;
+
+static double now_secs(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static uint64_t rnd(void) {
+    rnd_state ^= rnd_state << 13;
+    rnd_state ^= rnd_state >> 7;
+    rnd_state ^= rnd_state << 17;
+    return rnd_state;
+}
+
+static uint64_t mix(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+/* Linear probing, with backward shift deletion. */
+static uint32_t table_find(const uint64_t key) {
+    uint32_t i = mix(key) & table_mask;
+    for (; table[i] != 0; i = (i + 1) & table_mask) {
+        if (items[table[i] - 1].key == key)
+            return table[i] - 1;
+    }
+    return NIL;
+}
+
+static void table_insert(const uint64_t key, const uint32_t slot) {
+    uint32_t i = mix(key) & table_mask;
+    while (table[i] != 0)
+        i = (i + 1) & table_mask;
+    table[i] = slot + 1;
+}
+
+static void table_delete(const uint64_t key) {
+    uint32_t i = mix(key) & table_mask, j, home;
+    while (items[table[i] - 1].key != key)
+        i = (i + 1) & table_mask;
+    for (j = (i + 1) & table_mask; table[j] != 0; j = (j + 1) & table_mask) {
+        home = mix(items[table[j] - 1].key) & table_mask;
+        /* Move j back into the hole unless its home lies after the hole. */
+        if (((j - home) & table_mask) >= ((j - i) & table_mask)) {
+            table[i] = table[j];
+            i = j;
+        }
+    }
+    table[i] = 0;
+}
+
+static void list_push(const int l, const uint32_t slot) {
+    sim_list *list = &lists[l];
+    sim_item *it = &items[slot];
+    it->lru = l;
+    it->prev = NIL;
+    it->next = list->head;
+    if (list->head != NIL)
+        items[list->head].prev = slot;
+    list->head = slot;
+    if (list->tail == NIL)
+        list->tail = slot;
+    list->size++;
+}
+
+static void list_unlink(const uint32_t slot) {
+    sim_item *it = &items[slot];
+    sim_list *list = &lists[it->lru];
+    if (it->prev != NIL)
+        items[it->prev].next = it->next;
+    else
+        list->head = it->next;
+    if (it->next != NIL)
+        items[it->next].prev = it->prev;
+    else
+        list->tail = it->prev;
+    list->size--;
+}
+
+/* list */
+static void list_hit(const uint32_t slot) {
+    list_unlink(slot);
+    list_push(HOT, slot);
+}
+
+static void list_store(const uint32_t slot) {
+    list_push(HOT, slot);
+}
+
+static uint32_t list_victim(void) {
+    return lists[HOT].tail;
+}
+
+static uint32_t list_evict(void) {
+    uint32_t slot = lists[HOT].tail;
+    list_unlink(slot);
+    return slot;
+}
+
+/* segmented, with the default 32% HOT and 32% WARM */
+static void seg_hit(const uint32_t slot) {
+    items[slot].active = 1;
+}
+
+static void seg_juggle(void) {
+    const uint32_t limit = capacity * 32 / 100;
+    uint32_t slot;
+    int l;
+    for (l = HOT; l <= WARM; l++) {
+        while (lists[l].size > limit) {
+            slot = lists[l].tail;
+            list_unlink(slot);
+            list_push(COLD, slot);
+        }
+    }
+}
+
+static void seg_store(const uint32_t slot) {
+    items[slot].active = 0;
+    list_push(HOT, slot);
+    seg_juggle();
+}
+
+static uint32_t seg_victim(void) {
+    uint32_t slot;
+    for (;;) {
+        if ((slot = lists[COLD].tail) == NIL) {
+            /* Everything fit in HOT and WARM. */
+            return lists[WARM].tail != NIL ? lists[WARM].tail : lists[HOT].tail;
+        }
+        if (!items[slot].active)
+            return slot;
+        items[slot].active = 0;
+        list_unlink(slot);
+        list_push(WARM, slot);
+        seg_juggle();
+    }
+}
+
+static uint32_t seg_evict(void) {
+    uint32_t slot = seg_victim();
+    list_unlink(slot);
+    return slot;
+}
+
+/* clock */
+static void clock_hit(const uint32_t slot) {
+    items[slot].active = 1;
+}
+
+static void clock_store(const uint32_t slot) {
+    items[slot].active = 0;
+}
+
+static uint32_t clock_evict(void) {
+    for (;;) {
+        if (hand >= capacity)
+            hand = 0;
+        if (!items[hand].active)
+            return hand++;
+        items[hand++].active = 0;
+    }
+}
+
+/* sampled */
+static void sampled_hit(const uint32_t slot) {
+}
+
+static void sampled_store(const uint32_t slot) {
+}
+
+static uint32_t sampled_evict(void) {
+    uint32_t best = rnd() % capacity, slot;
+    unsigned int i;
+    for (i = 1; i < samples; i++) {
+        slot = rnd() % capacity;
+        if (items[slot].time < items[best].time)
+            best = slot;
+    }
+    return best;
+}
+
+/* cost: items.c's lru_pull_tail() under -o lru_cost. An item at the tail
+ * whose cost still covers the time since its last access goes round again,
+ * the last candidate goes no matter what. */
+static unsigned int key_cost(const uint64_t key) {
+    return mix(key ^ 0x6a09e667f3bcc909ULL) % 100 < cost_pct ? cost_high : 1;
+}
+
+static int cost_spares(const uint32_t slot) {
+    return items[slot].prev != NIL
+        && items[slot].time + (uint64_t)items[slot].cost * cost_weight > now;
+}
+
+static uint32_t list_cost_evict(void) {
+    uint32_t slot = lists[HOT].tail;
+    int tries;
+    for (tries = COST_CANDIDATES; tries > 1 && cost_spares(slot); tries--) {
+        list_unlink(slot);
+        list_push(HOT, slot);
+        slot = lists[HOT].tail;
+    }
+    list_unlink(slot);
+    return slot;
+}
+
+static uint32_t seg_cost_evict(void) {
+    uint32_t slot = seg_victim();
+    int tries;
+    for (tries = COST_CANDIDATES; tries > 1 && items[slot].lru == COLD
+             && cost_spares(slot); tries--) {
+        list_unlink(slot);
+        list_push(COLD, slot);
+        slot = seg_victim();
+    }
+    list_unlink(slot);
+    return slot;
+}
+
+static const policy policies[] = {
+    { "list", list_hit, list_store, list_victim, list_evict, 0 },
+    { "segmented", seg_hit, seg_store, seg_victim, seg_evict, 0 },
+    { "clock", clock_hit, clock_store, NULL, clock_evict, 0 },
+    { "sampled", sampled_hit, sampled_store, NULL, sampled_evict, 0 },
+    { "list+admit", list_hit, list_store, list_victim, list_evict, 1 },
+    { "segmented+admit", seg_hit, seg_store, seg_victim, seg_evict, 1 },
+    { "list+cost", list_hit, list_store, NULL, list_cost_evict, 0 },
+    { "segmented+cost", seg_hit, seg_store, NULL, seg_cost_evict, 0 },
+};
+
+/* Same sketch as items.c, one counter per cached item in each row. */
+static uint32_t sketch_slot(const uint64_t key, const int row) {
+    static const uint32_t seeds[SKETCH_ROWS] = {
+        0x9e3779b1, 0x85ebca6b, 0xc2b2ae35, 0x27d4eb2f
+    };
+    uint32_t h = (uint32_t)key * seeds[row];
+    h ^= h >> 15;
+    return h & sketch_mask;
+}
+
+static unsigned int sketch_estimate(const uint64_t key) {
+    unsigned int est = SKETCH_MAX;
+    int r;
+    for (r = 0; r < SKETCH_ROWS; r++) {
+        if (sketch[r][sketch_slot(key, r)] < est)
+            est = sketch[r][sketch_slot(key, r)];
+    }
+    return est;
+}
+
+static void sketch_record(const uint64_t key) {
+    unsigned int est = sketch_estimate(key);
+    uint32_t i;
+    int r;
+    if (est == SKETCH_MAX)
+        return;
+    for (r = 0; r < SKETCH_ROWS; r++) {
+        if (sketch[r][sketch_slot(key, r)] == est)
+            sketch[r][sketch_slot(key, r)] = est + 1;
+    }
+    if (++sketch_adds >= (sketch_mask + 1) * 10) {
+        for (r = 0; r < SKETCH_ROWS; r++) {
+            for (i = 0; i <= sketch_mask; i++)
+                sketch[r][i] >>= 1;
+        }
+        sketch_adds = 0;
+    }
+}
+
+static void reset(void) {
+    int l;
+    used = 0;
+    now = 0;
+    hand = 0;
+    sketch_adds = 0;
+    memset(table, 0, (table_mask + 1) * sizeof(*table));
+    for (l = 0; l < SKETCH_ROWS; l++)
+        memset(sketch[l], 0, sketch_mask + 1);
+    for (l = HOT; l <= COLD; l++)
+        lists[l].head = lists[l].tail = NIL, lists[l].size = 0;
+}
+
+static int request(const policy *p, const uint64_t key) {
+    uint32_t slot = table_find(key);
+    now++;
+    if (p->admit)
+        sketch_record(key);
+    if (slot != NIL) {
+        items[slot].time = now;
+        p->hit(slot);
+        return 1;
+    }
+    if (used < capacity) {
+        slot = used++;
+    } else {
+        if (p->admit &&
+            sketch_estimate(key) < sketch_estimate(items[p->victim()].key))
+            return 0;
+        slot = p->evict();
+        table_delete(items[slot].key);
+    }
+    items[slot].key = key;
+    items[slot].time = now;
+    items[slot].cost = key_cost(key);
+    table_insert(key, slot);
+    p->store(slot);
+    return 0;
+}
+
+static uint64_t *load_trace(const char *path, size_t *count) {
+    char line[1024], *key;
+    size_t n = 0, size = 1 << 20;
+    uint64_t *trace = malloc(size * sizeof(*trace)), h;
+    FILE *f = fopen(path, "r");
+
+    if (f == NULL || trace == NULL) {
+        perror(path);
+        exit(1);
+    }
+    while (fgets(line, sizeof(line), f) != NULL) {
+        key = line;
+        if (strncmp(key, "get ", 4) == 0 || strncmp(key, "set ", 4) == 0)
+            key += 4;
+        key[strcspn(key, " \t\r\n")] = '\0';
+        if (*key == '\0')
+            continue;
+        /* FNV-1a */
+        for (h = 14695981039346656037ULL; *key; key++)
+            h = (h ^ (unsigned char)*key) * 1099511628211ULL;
+        if (n == size && (trace = realloc(trace, (size *= 2) * sizeof(*trace))) == NULL) {
+            perror("realloc");
+            exit(1);
+        }
+        trace[n++] = h;
+    }
+    fclose(f);
+    *count = n;
+    return trace;
+}
+
+static uint64_t *zipf_trace(const size_t count, const uint32_t keys,
+                            const double alpha, const unsigned int scan_pct) {
+    uint64_t *trace = malloc(count * sizeof(*trace)), scan = 0;
+    double *cdf = malloc(keys * sizeof(*cdf)), sum = 0, r;
+    uint32_t lo, hi, mid, i;
+    size_t n;
+
+    if (trace == NULL || cdf == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    for (i = 0; i < keys; i++)
+        cdf[i] = (sum += 1.0 / pow(i + 1, alpha));
+    for (n = 0; n < count; n++) {
+        if (rnd() % 100 < scan_pct) {
+            /* Read once and never again. */
+            trace[n] = mix(++scan | (1ULL << 63));
+            continue;
+        }
+        r = (rnd() >> 11) * (1.0 / 9007199254740992.0) * sum;
+        for (lo = 0, hi = keys - 1; lo < hi; ) {
+            mid = (lo + hi) / 2;
+            if (cdf[mid] < r)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        trace[n] = mix(lo);
+    }
+    free(cdf);
+    return trace;
+}
+
+int main(int argc, char **argv) {
+    const char *path = NULL;
+    size_t count = 10000000, n, hits;
+    uint64_t cost, missed;
+    uint32_t keys = 1000000;
+    double alpha = 0.9, start, secs;
+    unsigned int scan_pct = 0, i;
+    uint64_t *trace;
+    int c;
+
+    capacity = 100000;
+    cost_weight = 0;
+    while ((c = getopt(argc, argv, "f:c:n:k:a:s:S:p:C:w:")) != -1) {
+        switch (c) {
+        case 'f': path = optarg; break;
+        case 'c': capacity = strtoul(optarg, NULL, 10); break;
+        case 'n': count = strtoull(optarg, NULL, 10); break;
+        case 'k': keys = strtoul(optarg, NULL, 10); break;
+        case 'a': alpha = atof(optarg); break;
+        case 's': scan_pct = atoi(optarg); break;
+        case 'S': samples = atoi(optarg); break;
+        case 'p': cost_pct = atoi(optarg); break;
+        case 'C': cost_high = atoi(optarg); break;
+        case 'w': cost_weight = strtoul(optarg, NULL, 10); break;
+        default:
+            fprintf(stderr, "usage: %s [-f trace] [-c items] [-n requests] "
+                    "[-k keys] [-a alpha] [-s scan_pct] [-S samples] "
+                    "[-p cost_pct] [-C cost] [-w weight]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (capacity < 2 || keys == 0 || samples == 0 || scan_pct > 100
+        || cost_pct > 100 || cost_high < 1 || cost_high > 255) {
+        fprintf(stderr, "bad arguments\n");
+        return 1;
+    }
+    /* By default a costly item is kept for five cache sizes' worth of
+     * requests after its last access. */
+    if (cost_weight == 0)
+        cost_weight = (uint64_t)capacity * 5 / cost_high + 1;
+
+    trace = path ? load_trace(path, &count) : zipf_trace(count, keys, alpha, scan_pct);
+    items = calloc(capacity, sizeof(*items));
+    for (table_mask = 1; table_mask < capacity * 2; table_mask <<= 1)
+        ;
+    table = calloc(table_mask, sizeof(*table));
+    table_mask--;
+    for (sketch_mask = 4096; sketch_mask < capacity; sketch_mask <<= 1)
+        ;
+    for (c = 0; c < SKETCH_ROWS; c++) {
+        if ((sketch[c] = calloc(sketch_mask, 1)) == NULL) {
+            perror("calloc");
+            return 1;
+        }
+    }
+    sketch_mask--;
+    if (items == NULL || table == NULL) {
+        perror("calloc");
+        return 1;
+    }
+
+    if (path)
+        printf("%s: %zu requests, %u items cached\n", path, count, capacity);
+    else
+        printf("zipf %.2f over %u keys, %u%% scans: %zu requests, %u items cached\n",
+               alpha, keys, scan_pct, count, capacity);
+    printf("%u%% of keys cost %u, weight %u requests per unit\n",
+           cost_pct, cost_high, cost_weight);
+    for (cost = 0, n = 0; n < count; n++)
+        cost += key_cost(trace[n]);
+    printf("policy            hit ratio miss cost   Mreq/s\n");
+    for (i = 0; i < sizeof(policies) / sizeof(policies[0]); i++) {
+        reset();
+        hits = 0;
+        missed = 0;
+        start = now_secs();
+        for (n = 0; n < count; n++) {
+            if (request(&policies[i], trace[n]))
+                hits++;
+            else
+                missed += key_cost(trace[n]);
+        }
+        secs = now_secs() - start;
+        printf("%-16s %9.4f %9.4f %8.2f\n", policies[i].name, (double)hits / count,
+               (double)missed / cost, count / secs / 1000000);
+    }
+    return 0;
+}
@@ -3,8 +3,20 @@
 #include "memcached.h"
 #include "jenkins_hash.h"
 #include "murmur3_hash.h"
+#include "wyhash_hash.h"
+#include "crc32c_hash.h"
+
+/* For hash functions without a batch version of their own. */
+static void hash_batch_each(const char * const *keys, const size_t *lengths,
+                            uint32_t *hv, const int count) {
+    int i;
+
+    for (i = 0; i < count; i++)
+        hv[i] = hash(keys[i], lengths[i]);
+}
 
 int hash_init(enum hashfunc_type type) {
+    hash_batch = hash_batch_each;
     switch(type) {
         case JENKINS_HASH:
             hash = jenkins_hash;
@@ -14,6 +26,21 @@ int hash_init(enum hashfunc_type type) {
             hash = MurmurHash3_x86_32;
             settings.hash_algorithm = "murmur3";
             break;
+        case WYHASH_HASH:
+            hash = wyhash_hash;
+            settings.hash_algorithm = "wyhash";
+            break;
+        case CRC32C_HASH:
+            hash = crc32c_hash;
+            settings.hash_algorithm = "crc32c";
+#ifdef HAVE_CRC32C_SSE42
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("sse4.2")) {
+                hash = crc32c_hash_sse42;
+                hash_batch = crc32c_hash_sse42_batch;
+            }
+#endif
+            break;
         default:
             return -1;
     }
@@ -4,11 +4,15 @@
 typedef uint32_t (*hash_func)(const void *key, size_t length);
 hash_func hash;
 
+/* Hashes count keys at once, for multigets. Same values as hash(). */
+typedef void (*hash_batch_func)(const char * const *keys, const size_t *lengths,
+                                uint32_t *hv, const int count);
+hash_batch_func hash_batch;
+
 enum hashfunc_type {
-    JENKINS_HASH=0, MURMUR3_HASH
+    JENKINS_HASH=0, MURMUR3_HASH, WYHASH_HASH, CRC32C_HASH
 };
 
 int hash_init(enum hashfunc_type type);
 
 #endif    /* HASH_H */
-
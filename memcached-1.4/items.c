@@ -13,6 +13,7 @@
 #include <time.h>
 #include <assert.h>
 #include <unistd.h>
+#include <poll.h>
 
 /* Forward Declarations */
 static void item_link_q(item *it);
@@ -49,6 +50,13 @@ typedef struct { //
     uint64_t moves_to_warm;
     uint64_t moves_within_lru;
     uint64_t direct_reclaims;
+    uint64_t bumps_drained;
+    uint64_t admission_rejects;
+    uint64_t inline_moves;     /* HOT/WARM items pushed to COLD by a worker */
+    uint64_t inline_evictions; /* evictions done by a worker */
+    uint64_t reserve_evictions; /* -o lru_reserve: done ahead by the maintainer */
+    uint64_t reserve_misses;   /* allocations that found the reserve empty */
+    uint64_t cost_spared;      /* -o lru_cost: tail items sent round COLD again */
     rel_time_t evicted_time;
 } itemstats_t; //item״̬ͳϢͲ
 
@@ -63,6 +71,17 @@ typedef struct {
     bool run_complete;
 } crawlerstats_t;
 
+/* How fast each class is allocating, sampled from the slab allocator every
+ * LRU_PRESSURE_INTERVAL. Only the maintainer thread writes this. */
+typedef struct {
+    uint64_t allocs; /* slabs_alloc_counts() at the last sample */
+    uint64_t rate;   /* allocations per second, smoothed */
+    bool refilling;  /* -o lru_reserve: evicting up to the high watermark */
+} lru_pressure_t;
+
+static lru_pressure_t lru_pressure[MAX_NUMBER_OF_SLAB_CLASSES];
+static struct timeval lru_pressure_sampled;
+
 //ָÿһLRUͷ  LRUпԲοhttp://blog.csdn.net/luotuo44/article/details/42869325
 //ڶǰıʾʵkeyheadʾûʸkeyΪÿηkeykey-valueӦitemȡŵheadͷdo_item_update
 //lruitemǸtime
@@ -89,17 +108,62 @@ static pthread_mutex_t lru_crawler_stats_lock = PTHREAD_MUTEX_INITIALIZER;
 static pthread_mutex_t lru_maintainer_lock = PTHREAD_MUTEX_INITIALIZER;
 static pthread_mutex_t cas_id_lock = PTHREAD_MUTEX_INITIALIZER;
 
+/*
+ * -o lru_bump_buffers: each worker logs the items it wants relinked into a
+ * ring of its own instead of taking lru_locks[] on a hit. The LRU maintainer
+ * drains the rings. Only the worker moves head and only the maintainer moves
+ * tail. Every item in a ring holds a reference. A full ring drops the bump.
+ */
+#define LRU_BUMP_BUF_SIZE 1024
+
+struct lru_bump_buf {
+    struct lru_bump_buf *next;
+    volatile unsigned int head;
+    volatile unsigned int tail;
+    pthread_mutex_t mutex;      /* guards dropped[] */
+    uint64_t dropped[MAX_NUMBER_OF_SLAB_CLASSES];
+    item *ring[LRU_BUMP_BUF_SIZE];
+};
+
+static lru_bump_buf *bump_bufs;
+static pthread_mutex_t bump_bufs_lock = PTHREAD_MUTEX_INITIALIZER;
+
+enum lru_bump_ret {
+    BUMP_QUEUED, BUMP_SKIPPED, BUMP_DROPPED
+};
+static enum lru_bump_ret lru_bump_async(item *it);
+
+#ifdef HAVE_GCC_ATOMICS
+#define bump_barrier() __sync_synchronize()
+#else
+#define bump_barrier()
+#endif
+
 void item_stats_reset(void) {
+    lru_bump_buf *b;
     int i;
     for (i = 0; i < LARGEST_ID; i++) {
         pthread_mutex_lock(&lru_locks[i]);
         memset(&itemstats[i], 0, sizeof(itemstats_t));
         pthread_mutex_unlock(&lru_locks[i]);
     }
+    pthread_mutex_lock(&bump_bufs_lock);
+    for (b = bump_bufs; b != NULL; b = b->next) {
+        pthread_mutex_lock(&b->mutex);
+        memset(b->dropped, 0, sizeof(b->dropped));
+        pthread_mutex_unlock(&b->mutex);
+    }
+    pthread_mutex_unlock(&bump_bufs_lock);
 }
 
+/* lru_pull_tail() flags */
+#define LRU_PULL_EVICT 1  /* evict off COLD's tail if there's nothing to reclaim */
+#define LRU_PULL_INLINE 2 /* called by a worker from do_item_alloc() */
+
 static int lru_pull_tail(const int orig_id, const int cur_lru,
-        const unsigned int total_chunks, const bool do_evict, const uint32_t cur_hv);
+        const unsigned int total_chunks, const int flags, const uint32_t cur_hv);
+static int lru_engine_evict(const int id, const uint32_t cur_hv);
+static void expiry_wheel_stats(ADD_STAT add_stats, void *c);
 static int lru_crawler_start(uint32_t id, uint32_t remaining);
 
 /* Get the next CAS id for a new item. */
@@ -146,6 +210,254 @@ static unsigned int noexp_lru_size(int slabs_clsid) {
 # define DEBUG_REFCNT(it,op) while(0)
 #endif
 
+/*
+ * -o lru_admission: a count-min sketch of how often each key hash has been
+ * asked for. Gets count their key, hit or miss, and when a full class is
+ * about to evict its COLD tail for a new item the newcomer has to be at
+ * least as popular as that tail, otherwise the store is refused and the tail
+ * stays. One-off scans then can't flush out keys that keep getting read.
+ *
+ * Counters are bytes saturating at 15 and bumped without locks; a lost bump
+ * only makes an estimate a little low. Once enough bumps have gone in the
+ * LRU maintainer halves every counter, so keys that were hot a while ago
+ * fade out. That pass covers the whole sketch, so no get waits on it.
+ */
+#define ADMISSION_ROWS 4
+#define ADMISSION_MAX 15
+#define ADMISSION_MIN_WIDTH 4096
+#define ADMISSION_MAX_WIDTH (1 << 22)
+
+static uint8_t *admission_rows[ADMISSION_ROWS];
+static uint32_t admission_mask;
+static volatile unsigned int admission_adds;
+static unsigned int admission_age_at;
+static const uint32_t admission_seeds[ADMISSION_ROWS] = {
+    0x9e3779b1, 0x85ebca6b, 0xc2b2ae35, 0x27d4eb2f
+};
+
+/* About one counter per 512 bytes of cache in each row. */
+int lru_admission_init(const size_t maxbytes) {
+    uint32_t width = ADMISSION_MIN_WIDTH;
+    int r;
+
+    while (width < ADMISSION_MAX_WIDTH && width < maxbytes / 512)
+        width <<= 1;
+    for (r = 0; r < ADMISSION_ROWS; r++) {
+        admission_rows[r] = calloc(width, sizeof(uint8_t));
+        if (admission_rows[r] == NULL)
+            return -1;
+    }
+    admission_mask = width - 1;
+    admission_age_at = width * 10;
+    return 0;
+}
+
+static inline uint32_t admission_slot(const uint32_t hv, const int row) {
+    uint32_t h = hv * admission_seeds[row];
+    h ^= h >> 15;
+    return h & admission_mask;
+}
+
+static unsigned int admission_estimate(const uint32_t hv) {
+    unsigned int est = ADMISSION_MAX;
+    int r;
+    for (r = 0; r < ADMISSION_ROWS; r++) {
+        uint8_t c = admission_rows[r][admission_slot(hv, r)];
+        if (c < est)
+            est = c;
+    }
+    return est;
+}
+
+/* Halves the sketch once enough bumps have gone in. Called by the LRU
+ * maintainer each time it wakes. */
+static void lru_admission_age(void) {
+    unsigned int adds = admission_adds;
+    uint32_t i;
+    int r;
+
+    if (adds < admission_age_at)
+        return;
+    for (r = 0; r < ADMISSION_ROWS; r++) {
+        for (i = 0; i <= admission_mask; i++)
+            admission_rows[r][i] >>= 1;
+    }
+#ifdef HAVE_GCC_ATOMICS
+    /* Keep the bumps that came in while we were at it. */
+    __sync_sub_and_fetch(&admission_adds, adds);
+#else
+    admission_adds = 0;
+#endif
+}
+
+void lru_admission_record(const uint32_t hv) {
+    unsigned int est = admission_estimate(hv);
+    int r;
+
+    if (est == ADMISSION_MAX)
+        return;
+    /* Conservative update: only the counters holding the estimate move. */
+    for (r = 0; r < ADMISSION_ROWS; r++) {
+        uint8_t *c = &admission_rows[r][admission_slot(hv, r)];
+        if (*c == est)
+            *c = est + 1;
+    }
+#ifdef HAVE_GCC_ATOMICS
+    __sync_add_and_fetch(&admission_adds, 1);
+#else
+    /* A lost count only puts off the next halving a little. */
+    admission_adds++;
+#endif
+}
+
+/*
+ * Should an item hashing to new_hv be allowed to push out the tail of
+ * COLD? Expired, flushed or unpopular tails are always fair game. Active
+ * tails are skipped since the LRU pull would move them rather than evict.
+ */
+static bool lru_admit(const int orig_id, const uint32_t new_hv) {
+    int id = orig_id | COLD_LRU;
+    int tries = 5;
+    bool admit = true;
+    item *search;
+
+    pthread_mutex_lock(&lru_locks[id]);
+    for (search = tails[id]; tries > 0 && search != NULL; search = search->prev) {
+        if (search->nbytes == 0 && search->nkey == 0 && search->it_flags == 1)
+            continue;
+        tries--;
+        if (settings.lru_maintainer_thread && (search->it_flags & ITEM_ACTIVE))
+            continue;
+        if ((search->exptime != 0 && search->exptime < current_time)
+            || item_is_flushed(search))
+            break;
+        if (admission_estimate(new_hv) < admission_estimate(ITEM_hash(search))) {
+            itemstats[id].admission_rejects++;
+            admit = false;
+        }
+        break;
+    }
+    pthread_mutex_unlock(&lru_locks[id]);
+    return admit;
+}
+
+/*
+ * -o lru_ghosts: ARC style ghost lists per slab class, holding only the
+ * hashes of keys recently evicted off COLD. A key that was never fetched
+ * goes on the recent list, one that was goes on the frequent list. When a
+ * key is stored again while its ghost is still around, the class would have
+ * had a hit with a different split: a recent ghost means COLD was too small,
+ * so WARM's target shrinks, and a frequent ghost grows it. As in ARC the
+ * step is larger the smaller the list that was hit. HOT keeps hot_lru_pct
+ * and COLD gets what's left.
+ *
+ * A class's table is direct mapped with a slot per chunk the class had
+ * when it first evicted, so a ghost can be pushed out early by another one
+ * landing on its slot. Everything here is under the class's COLD LRU lock.
+ */
+#define GHOST_RECENT 0
+#define GHOST_FREQUENT 1
+#define GHOST_STEP 10           /* target moves in 1/10000ths of the class */
+#define GHOST_MAX_RATIO 10
+#define GHOST_MIN_SLOTS 1024
+#define GHOST_MAX_SLOTS (1 << 22)
+
+typedef struct {
+    uint32_t *slots;            /* hash, low bit is the list; 0 is empty */
+    uint32_t mask;
+    bool failed;                /* couldn't allocate the slots */
+    uint64_t size[2];           /* ghosts on each list */
+    uint64_t hits[2];
+    uint64_t lookups;
+    unsigned int warm_target;   /* WARM's share in 1/10000ths, 0 if unset */
+} lru_ghosts_t;
+
+static lru_ghosts_t lru_ghosts[MAX_NUMBER_OF_SLAB_CLASSES];
+
+static inline uint32_t ghost_tag(const uint32_t hv) {
+    uint32_t tag = hv & ~1U;
+    return tag ? tag : 2;
+}
+
+/* WARM's share of a class in 1/10000ths. Read under the WARM LRU lock
+ * rather than COLD's; a stale value only moves an item a pass late. */
+static unsigned int lru_warm_target(const int clsid) {
+    unsigned int target;
+    if (!settings.lru_ghosts || (target = lru_ghosts[clsid].warm_target) == 0)
+        return settings.warm_lru_pct * 100;
+    return target;
+}
+
+/* An item was evicted off COLD. COLD LRU lock held. */
+static void lru_ghost_add(const int clsid, const uint32_t hv, const int list,
+                          const unsigned int total_chunks) {
+    lru_ghosts_t *g = &lru_ghosts[clsid];
+    uint32_t *slot;
+    uint32_t n;
+
+    if (g->slots == NULL) {
+        if (g->failed)
+            return;
+        for (n = GHOST_MIN_SLOTS; n < GHOST_MAX_SLOTS && n < total_chunks; n <<= 1)
+            ;
+        if ((g->slots = calloc(n, sizeof(uint32_t))) == NULL) {
+            g->failed = true;
+            return;
+        }
+        g->mask = n - 1;
+    }
+    slot = &g->slots[hv & g->mask];
+    if (*slot != 0)
+        g->size[*slot & 1]--;
+    *slot = ghost_tag(hv) | list;
+    g->size[list]++;
+}
+
+/* A key is being linked. If it was evicted not long ago, move the class's
+ * WARM target towards the split that would have kept it. */
+static void lru_ghost_check(const int clsid, const uint32_t hv) {
+    int id = clsid | COLD_LRU;
+    lru_ghosts_t *g = &lru_ghosts[clsid];
+    uint64_t ratio;
+    uint32_t *slot;
+    int list, target, max;
+
+    pthread_mutex_lock(&lru_locks[id]);
+    g->lookups++;
+    if (g->slots == NULL) {
+        pthread_mutex_unlock(&lru_locks[id]);
+        return;
+    }
+    slot = &g->slots[hv & g->mask];
+    if (*slot == 0 || (*slot & ~1U) != ghost_tag(hv)) {
+        pthread_mutex_unlock(&lru_locks[id]);
+        return;
+    }
+    list = *slot & 1;
+    *slot = 0;
+    g->size[list]--;
+    g->hits[list]++;
+
+    ratio = g->size[!list] / (g->size[list] ? g->size[list] : 1);
+    if (ratio < 1)
+        ratio = 1;
+    else if (ratio > GHOST_MAX_RATIO)
+        ratio = GHOST_MAX_RATIO;
+    target = lru_warm_target(clsid);
+    if (list == GHOST_RECENT)
+        target -= ratio * GHOST_STEP;
+    else
+        target += ratio * GHOST_STEP;
+    /* Same bounds as the options: at least 1%, and HOT + WARM <= 80%. */
+    max = (80 - settings.hot_lru_pct) * 100;
+    if (target < 100)
+        target = 100;
+    else if (target > max)
+        target = max;
+    g->warm_target = target;
+    pthread_mutex_unlock(&lru_locks[id]);
+}
+
 /**
  * Generates the variable-sized part of the header for an object.
  *
@@ -167,34 +479,132 @@ static size_t item_make_header(const uint8_t nkey, const int flags, const int nb
 }
 
 /*
-worker߳̽յflush_all󣬻ȫֱsettingsoldest_liveԱ洢յһ̵ʱ(׼ȷ˵
-worker֪߳̽һflush_allһټһ)Ϊsettings.oldest_live =current_time - 1;Ȼ
-item_flush_expiredcache_lockȻdo_item_flush_expiredɹ
-    ɾԲοdo_item_getеif (settings.oldest_live != 0 && settings.oldest_live <= current_time int i;
-do_item_get⣬do_item_allocҲǻᴦʧЧitem
-*/
-//洢slabclass[id]еtunckеݸʽitem_make_header
-/*@null@*/
-//keyflagsexptimeûʹsetadd洢һʱĲ
-//nkeykeyַĳȡnbytesûҪ洢data+2ΪdataβҪ"\r\n"
-//cur_hvǸݼֵkeyõĹϣֵ
-item *do_item_alloc(char *key, const size_t nkey, const int flags,
-                    const rel_time_t exptime, const int nbytes,
-                    const uint32_t cur_hv) { //memcached쳣صĴӡַSERVER_ERROR ,ǿͻ쳣һCLIENT_ERROR
+ * -o large_item_max: a value too big for the largest slab class is kept as a
+ * header item in a chunk of that class, holding the key and the start of the
+ * value, plus a chain of item_chunks from the same class for the rest. The
+ * header is what gets linked, so evicting it from that class's LRU frees
+ * the whole value back to that class.
+ */
+#define ITEM_CHUNK_ROOM (settings.item_size_max - sizeof(item_chunk))
+
+static bool item_chunked_ok(const int nbytes) {
+    return settings.large_item_max != 0
+        && nbytes - 2 <= settings.large_item_max;
+}
+
+/* Value bytes that fit in a chunked item's header, after the chain pointer. */
+static size_t item_head_room(const item *it) {
+    return settings.item_size_max - (ITEM_data(it) - (const char *)it)
+        - sizeof(item_chunk *);
+}
+
+static item_chunk *item_chunks(const item *it) {
+    item_chunk *ch;
+    memcpy(&ch, ITEM_data(it), sizeof(ch));
+    return ch;
+}
+
+static void item_free_chunks(item *it) {
+    item_chunk *ch, *next;
+
+    for (ch = item_chunks(it); ch != NULL; ch = next) {
+        next = ch->next;
+        slabs_free(ch, settings.item_size_max, ch->slabs_clsid);
+    }
+}
+
+/* Bytes of slab memory an item holds, its chunks included. */
+static size_t item_footprint(const item *it) {
+    size_t ntotal = ITEM_ntotal(it);
+    item_chunk *ch;
+
+    if (it->it_flags & ITEM_CHUNKED) {
+        for (ch = item_chunks(it); ch != NULL; ch = ch->next)
+            ntotal += settings.item_size_max;
+    }
+    return ntotal;
+}
+
+/*
+ * Returns a pointer to byte off of an item's value and how many bytes follow
+ * it contiguously, so callers can walk a chunked value piece by piece.
+ */
+char *item_value_at(const item *it, size_t off, size_t *avail) {
+    item_chunk *ch;
+    size_t room;
+
+    if (!(it->it_flags & ITEM_CHUNKED)) {
+        *avail = it->nbytes - off;
+        return ITEM_data(it) + off;
+    }
+    assert(off < (size_t)it->nbytes);
+    room = item_head_room(it);
+    if (off < room) {
+        *avail = room - off;
+        return ITEM_data(it) + sizeof(item_chunk *) + off;
+    }
+    off -= room;
+    for (ch = item_chunks(it); off >= (size_t)ch->nbytes; ch = ch->next)
+        off -= ch->nbytes;
+    *avail = ch->nbytes - off;
+    return ch->data + off;
+}
+
+static void item_value_move(const item *it, size_t off, char *buf,
+                            size_t len, const bool to_item) {
+    while (len > 0) {
+        size_t avail;
+        char *p = item_value_at(it, off, &avail);
+        if (avail > len)
+            avail = len;
+        if (to_item)
+            memcpy(p, buf, avail);
+        else
+            memcpy(buf, p, avail);
+        off += avail;
+        buf += avail;
+        len -= avail;
+    }
+}
+
+void item_value_read(const item *it, size_t off, char *buf, size_t len) {
+    item_value_move(it, off, buf, len, false);
+}
+
+void item_value_write(item *it, size_t off, const char *buf, size_t len) {
+    item_value_move(it, off, (char *)buf, len, true);
+}
+
+void item_value_copy(item *dst, size_t doff, const item *src, size_t soff,
+                     size_t len) {
+    while (len > 0) {
+        size_t davail, savail;
+        char *d = item_value_at(dst, doff, &davail);
+        const char *s = item_value_at(src, soff, &savail);
+        if (davail > len)
+            davail = len;
+        if (davail > savail)
+            davail = savail;
+        memcpy(d, s, davail);
+        doff += davail;
+        soff += davail;
+        len -= davail;
+    }
+}
+
+/* Takes ntotal bytes from class id, pulling from the LRU tail or evicting
+ * as needed. */
+static item *do_item_alloc_pull(char *key, const size_t nkey,
+                                const size_t ntotal, unsigned int id,
+                                const uint32_t cur_hv) {
     int i;
-    uint8_t nsuffix;
     item *it = NULL;
-    char suffix[40];
     unsigned int total_chunks;//Ҫ洢itemҪܿռ
-    size_t ntotal = item_make_header(nkey + 1, flags, nbytes, suffix, &nsuffix);
-    if (settings.use_cas) {
-        ntotal += sizeof(uint64_t);
-    }
-
-	//ݴСжϴĸslab
-    unsigned int id = slabs_clsid(ntotal);
-    if (id == 0) //0ʾκһslab  slabclassǴ1ʼ
-        return 0;
+    uint32_t new_hv = 0;
+    bool rejected = false;
+    /* -o numa places an item on its key's node, not the storing worker's. */
+    const int node = settings.numa ?
+        numa_key_node(cur_hv ? cur_hv : hash(key, nkey)) : -1;
 
     /* If no memory is available, attempt a direct LRU juggle/eviction */
     /* This is a race in order to simplify lru_pull_tail; in cases where
@@ -212,19 +622,35 @@ item *do_item_alloc(char *key, const size_t nkey, const int flags,
      */
     for (i = 0; i < 5; i++) {
         /* Try to reclaim memory first */
-        if (!settings.lru_maintainer_thread) {
-            lru_pull_tail(id, COLD_LRU, 0, false, cur_hv);
+        if (!settings.lru_maintainer_thread &&
+            settings.lru_engine == LRU_ENGINE_LIST) {
+            lru_pull_tail(id, COLD_LRU, 0, LRU_PULL_INLINE, cur_hv);
         }
-        it = slabs_alloc(ntotal, id, &total_chunks, 0);
+        it = slabs_alloc(ntotal, id, &total_chunks, 0, node);
         if (settings.expirezero_does_not_evict)
             total_chunks -= noexp_lru_size(id);
         if (it == NULL) {
-            if (settings.lru_maintainer_thread) {
-                lru_pull_tail(id, HOT_LRU, total_chunks, false, cur_hv);
-                lru_pull_tail(id, WARM_LRU, total_chunks, false, cur_hv);
-                lru_pull_tail(id, COLD_LRU, total_chunks, true, cur_hv);
+            if (settings.lru_admission) {
+                /* The store counts as a request for the key too. */
+                if (i == 0) {
+                    new_hv = cur_hv ? cur_hv : hash(key, nkey);
+                    lru_admission_record(new_hv);
+                }
+                if (!lru_admit(id, new_hv)) {
+                    rejected = true;
+                    break;
+                }
+            }
+            if (settings.lru_engine != LRU_ENGINE_LIST) {
+                lru_engine_evict(id, cur_hv);
+            } else if (settings.lru_maintainer_thread) {
+                lru_pull_tail(id, HOT_LRU, total_chunks, LRU_PULL_INLINE, cur_hv);
+                lru_pull_tail(id, WARM_LRU, total_chunks, LRU_PULL_INLINE, cur_hv);
+                lru_pull_tail(id, COLD_LRU, total_chunks,
+                              LRU_PULL_EVICT | LRU_PULL_INLINE, cur_hv);
             } else {
-                lru_pull_tail(id, COLD_LRU, 0, true, cur_hv);
+                lru_pull_tail(id, COLD_LRU, 0,
+                              LRU_PULL_EVICT | LRU_PULL_INLINE, cur_hv);
             }
         } else {
             break;
@@ -234,16 +660,99 @@ item *do_item_alloc(char *key, const size_t nkey, const int flags,
     if (i > 0) {
         pthread_mutex_lock(&lru_locks[id]);
         itemstats[id].direct_reclaims += i;
+        if (settings.lru_reserve)
+            itemstats[id].reserve_misses++;
         pthread_mutex_unlock(&lru_locks[id]);
     }
 
     if (it == NULL) {
-        pthread_mutex_lock(&lru_locks[id]);
-        itemstats[id].outofmemory++;
-        pthread_mutex_unlock(&lru_locks[id]);
-        return NULL;
+        /* Refused admissions are counted on their own in lru_admit(). */
+        if (!rejected) {
+            pthread_mutex_lock(&lru_locks[id]);
+            itemstats[id].outofmemory++;
+            pthread_mutex_unlock(&lru_locks[id]);
+        }
+    }
+    return it;
+}
+
+/* Chains enough chunks to a new header for the rest of its value. On failure
+ * the chunks taken so far stay chained, for item_free() to give back. */
+static bool do_item_alloc_chunks(item *it, char *key, const size_t nkey,
+                                 const uint32_t cur_hv) {
+    const unsigned int id = ITEM_clsid(it);
+    size_t left = it->nbytes - item_head_room(it);
+    item_chunk *ch, *last = NULL;
+
+    memset(ITEM_data(it), 0, sizeof(item_chunk *));
+    while (left > 0) {
+        ch = (item_chunk *)do_item_alloc_pull(key, nkey, settings.item_size_max,
+                                              id, cur_hv);
+        if (ch == NULL)
+            return false;
+        ch->head = it;
+        ch->next = NULL;
+        ch->prev = last;
+        ch->time = ch->exptime = 0;
+        ch->nbytes = left < ITEM_CHUNK_ROOM ? left : ITEM_CHUNK_ROOM;
+        ch->refcount = 0;
+        ch->nsuffix = 0;
+        ch->slabs_clsid = id;
+        ch->nkey = 0;
+        ch->cost = 0;
+        ch->hv = 0;
+        /* The slab mover follows head once it sees the flag. */
+        chunk_barrier();
+        ch->it_flags = ITEM_CHUNKED;
+        if (last != NULL)
+            last->next = ch;
+        else
+            memcpy(ITEM_data(it), &ch, sizeof(ch));
+        last = ch;
+        left -= ch->nbytes;
+    }
+    return true;
+}
+
+/*
+worker߳̽յflush_all󣬻ȫֱsettingsoldest_liveԱ洢յһ̵ʱ(׼ȷ˵
+worker֪߳̽һflush_allһټһ)Ϊsettings.oldest_live =current_time - 1;Ȼ
+item_flush_expiredcache_lockȻdo_item_flush_expiredɹ
+    ɾԲοdo_item_getеif (settings.oldest_live != 0 && settings.oldest_live <= current_time int i;
+do_item_get⣬do_item_allocҲǻᴦʧЧitem
+*/
+//洢slabclass[id]еtunckеݸʽitem_make_header
+/*@null@*/
+//keyflagsexptimeûʹsetadd洢һʱĲ
+//nkeykeyַĳȡnbytesûҪ洢data+2ΪdataβҪ"\r\n"
+//cur_hvǸݼֵkeyõĹϣֵ
+item *do_item_alloc(char *key, const size_t nkey, const int flags,
+                    const rel_time_t exptime, const int nbytes,
+                    const uint32_t cur_hv) { //memcached쳣صĴӡַSERVER_ERROR ,ǿͻ쳣һCLIENT_ERROR
+    uint8_t nsuffix;
+    item *it = NULL;
+    char suffix[40];
+    bool chunked = false;
+    size_t ntotal = item_make_header(nkey + 1, flags, nbytes, suffix, &nsuffix);
+    if (settings.use_cas) {
+        ntotal += sizeof(uint64_t);
+    }
+
+	//ݴСжϴĸslab
+    unsigned int id = slabs_clsid(ntotal);
+    if (id == 0) { //0ʾκһslab  slabclassǴ1ʼ
+        if (!item_chunked_ok(nbytes))
+            return 0;
+        /* The header takes a whole chunk of the largest class. */
+        chunked = true;
+        ntotal = settings.item_size_max;
+        id = slabs_clsid(ntotal);
     }
 
+    it = do_item_alloc_pull(key, nkey, ntotal, id, cur_hv);
+    if (it == NULL)
+        return NULL;
+
     assert(it->slabs_clsid == 0);
     //assert(it != heads[id]);
 
@@ -272,6 +781,14 @@ item *do_item_alloc(char *key, const size_t nkey, const int flags,
     it->exptime = exptime;
     memcpy(ITEM_suffix(it), suffix, (size_t)nsuffix);
     it->nsuffix = nsuffix;
+    it->cost = 0;
+    if (chunked) {
+        it->it_flags |= ITEM_CHUNKED;
+        if (!do_item_alloc_chunks(it, key, nkey, cur_hv)) {
+            do_item_remove(it);
+            return NULL;
+        }
+    }
     return it;
 }
 
@@ -286,6 +803,10 @@ void item_free(item *it) {
     /* so slab size changer can tell later if item is already free or not */
     clsid = ITEM_clsid(it);
     DEBUG_REFCNT(it, 'F');
+    /* Chunks go first: the slab mover relies on a chunk's header staying
+     * put while the chunk is allocated. */
+    if (it->it_flags & ITEM_CHUNKED)
+        item_free_chunks(it);
     slabs_free(it, ntotal, clsid);
 }
 
@@ -303,7 +824,7 @@ bool item_size_ok(const size_t nkey, const int flags, const int nbytes) {
         ntotal += sizeof(uint64_t);
     }
 
-    return slabs_clsid(ntotal) != 0;
+    return slabs_clsid(ntotal) != 0 || item_chunked_ok(nbytes);
 }
 
 //item뵽LRUеͷ  //item뵽ӦclassidLRUhead   hashΪassoc_insert  lruеĺΪitem_link_q
@@ -311,6 +832,11 @@ static void do_item_link_q(item *it) { /* item is the new head */
     item **head, **tail;
     assert((it->it_flags & ITEM_SLABBED) == 0);
 
+    /* The other engines find their victims in the slab pages. */
+    if (settings.lru_engine != LRU_ENGINE_LIST) {
+        sizes[it->slabs_clsid]++;
+        return;
+    }
     head = &heads[it->slabs_clsid];
     tail = &tails[it->slabs_clsid];
     assert(it != *head);
@@ -336,6 +862,10 @@ static void item_link_q(item *it) {
 //itӶӦLRUɾ  //itemӶӦclassidLRUƳ
 static void do_item_unlink_q(item *it) {
     item **head, **tail;
+    if (settings.lru_engine != LRU_ENGINE_LIST) {
+        sizes[it->slabs_clsid]--;
+        return;
+    }
     head = &heads[it->slabs_clsid];
     tail = &tails[it->slabs_clsid];
 
@@ -370,19 +900,27 @@ int do_item_link(item *it, const uint32_t hv) {
     MEMCACHED_ITEM_LINK(ITEM_key(it), it->nkey, it->nbytes);
     assert((it->it_flags & (ITEM_LINKED|ITEM_SLABBED)) == 0);
     it->it_flags |= ITEM_LINKED;
+    if (settings.item_hash) {
+        it->hv = hv;
+        it->it_flags |= ITEM_HASHED;
+    }
     it->time = current_time;
 
     STATS_LOCK();
-    stats.curr_bytes += ITEM_ntotal(it);
+    stats.curr_bytes += item_footprint(it);
     stats.curr_items += 1;
     stats.total_items += 1;
     STATS_UNLOCK();
 
     /* Allocate a new CAS ID on link. */
     ITEM_set_cas(it, (settings.use_cas) ? get_cas_id() : 0);
+    if (settings.lru_ghosts)
+        lru_ghost_check(ITEM_clsid(it), hv);
     assoc_insert(it, hv); //뵽hashУڿٲ
     item_link_q(it);
     refcount_incr(&it->refcount); //refcount
+    if (settings.expiry_wheel && it->exptime != 0)
+        expiry_wheel_add(it, hv);
 
     return 1;
 }
@@ -393,11 +931,13 @@ void do_item_unlink(item *it, const uint32_t hv) {
     if ((it->it_flags & ITEM_LINKED) != 0) {
         it->it_flags &= ~ITEM_LINKED;
         STATS_LOCK();
-        stats.curr_bytes -= ITEM_ntotal(it);
+        stats.curr_bytes -= item_footprint(it);
         stats.curr_items -= 1;
         STATS_UNLOCK();
         assoc_delete(ITEM_key(it), it->nkey, hv);
         item_unlink_q(it);
+        if (settings.expiry_wheel && it->exptime != 0)
+            expiry_wheel_del(it, hv);
         do_item_remove(it);
     }
 }
@@ -408,11 +948,13 @@ void do_item_unlink_nolock(item *it, const uint32_t hv) {
     if ((it->it_flags & ITEM_LINKED) != 0) {
         it->it_flags &= ~ITEM_LINKED;
         STATS_LOCK();
-        stats.curr_bytes -= ITEM_ntotal(it);
+        stats.curr_bytes -= item_footprint(it);
         stats.curr_items -= 1;
         STATS_UNLOCK();
         assoc_delete(ITEM_key(it), it->nkey, hv);
         do_item_unlink_q(it);
+        if (settings.expiry_wheel && it->exptime != 0)
+            expiry_wheel_del(it, hv);
         do_item_remove(it);
     }
 }
@@ -463,6 +1005,12 @@ memcached
 //һitemʱ䣬Ҫһʱ֮  ·ʱ
 void do_item_update(item *it) {
     MEMCACHED_ITEM_UPDATE(ITEM_key(it), it->nkey, it->nbytes);
+    /* A hit on a COLD item sends it up to WARM however recent it is. */
+    if (settings.lru_bump_buffers && settings.lru_maintainer_thread &&
+        (it->slabs_clsid & (3<<6)) == COLD_LRU &&
+        (it->it_flags & ITEM_LINKED) != 0) {
+        lru_bump_async(it);
+    }
     if (it->time < current_time - ITEM_UPDATE_INTERVAL) {
         /*
             //ĴԿupdateǺʱġitemƵʣ  
@@ -473,8 +1021,15 @@ void do_item_update(item *it) {
         assert((it->it_flags & ITEM_SLABBED) == 0);
 
         if ((it->it_flags & ITEM_LINKED) != 0) {
-            it->time = current_time;
-            if (!settings.lru_maintainer_thread) {
+            if (settings.lru_maintainer_thread ||
+                settings.lru_engine != LRU_ENGINE_LIST) {
+                it->time = current_time;
+            } else if (settings.lru_bump_buffers) {
+                /* Leave the time alone on a drop so the next hit tries again. */
+                if (lru_bump_async(it) != BUMP_DROPPED)
+                    it->time = current_time;
+            } else {
+                it->time = current_time;
                 item_unlink_q(it);
                 item_link_q(it);
             }
@@ -482,6 +1037,51 @@ void do_item_update(item *it) {
     }
 }
 
+lru_bump_buf *lru_bump_buf_create(void) {
+    lru_bump_buf *b = calloc(1, sizeof(lru_bump_buf));
+    if (b == NULL)
+        return NULL;
+    pthread_mutex_init(&b->mutex, NULL);
+    pthread_mutex_lock(&bump_bufs_lock);
+    b->next = bump_bufs;
+    bump_bufs = b;
+    pthread_mutex_unlock(&bump_bufs_lock);
+    return b;
+}
+
+/* Called with the item lock held, from do_item_update(). Without the
+ * segmented LRU a bump is a relink to the head; with it, only hits on COLD
+ * items are bumped, up to WARM. */
+static enum lru_bump_ret lru_bump_async(item *it) {
+    lru_bump_buf *b;
+    unsigned int head;
+
+    if ((it->it_flags & ITEM_BUMPED) != 0)
+        return BUMP_SKIPPED;
+    if ((b = worker_bump_buf()) == NULL) {
+        /* Not a worker; do it the old way. */
+        if (!settings.lru_maintainer_thread) {
+            item_unlink_q(it);
+            item_link_q(it);
+        }
+        return BUMP_SKIPPED;
+    }
+    head = b->head;
+    if (head - b->tail >= LRU_BUMP_BUF_SIZE) {
+        pthread_mutex_lock(&b->mutex);
+        b->dropped[ITEM_clsid(it)]++;
+        pthread_mutex_unlock(&b->mutex);
+        return BUMP_DROPPED;
+    }
+    refcount_incr(&it->refcount);
+    it->it_flags |= ITEM_BUMPED;
+    b->ring[head % LRU_BUMP_BUF_SIZE] = it;
+    /* The slot has to be visible before the maintainer sees the new head. */
+    bump_barrier();
+    b->head = head + 1;
+    return BUMP_QUEUED;
+}
+
 //itemnew_item
 int do_item_replace(item *it, item *new_it, const uint32_t hv) {
     MEMCACHED_ITEM_REPLACE(ITEM_key(it), it->nkey, it->nbytes,
@@ -571,6 +1171,7 @@ void item_stats_totals(ADD_STAT add_stats, void *c) {
             totals.moves_to_warm += itemstats[i].moves_to_warm;
             totals.moves_within_lru += itemstats[i].moves_within_lru;
             totals.direct_reclaims += itemstats[i].direct_reclaims;
+            totals.admission_rejects += itemstats[i].admission_rejects;
             pthread_mutex_unlock(&lru_locks[i]);
         }
     }
@@ -598,6 +1199,12 @@ void item_stats_totals(ADD_STAT add_stats, void *c) {
         APPEND_STAT("direct_reclaims", "%llu",
                     (unsigned long long)totals.direct_reclaims);
     }
+    if (settings.lru_admission) {
+        APPEND_STAT("admission_rejects", "%llu",
+                    (unsigned long long)totals.admission_rejects);
+    }
+    if (settings.expiry_wheel)
+        expiry_wheel_stats(add_stats, c);
 }
 
 
@@ -631,7 +1238,20 @@ END
 */
 void item_stats(ADD_STAT add_stats, void *c) {
     itemstats_t totals;
+    uint64_t bumps_dropped[MAX_NUMBER_OF_SLAB_CLASSES];
+    lru_bump_buf *b;
     int n;
+
+    memset(bumps_dropped, 0, sizeof(bumps_dropped));
+    pthread_mutex_lock(&bump_bufs_lock);
+    for (b = bump_bufs; b != NULL; b = b->next) {
+        pthread_mutex_lock(&b->mutex);
+        for (n = 0; n < MAX_NUMBER_OF_SLAB_CLASSES; n++)
+            bumps_dropped[n] += b->dropped[n];
+        pthread_mutex_unlock(&b->mutex);
+    }
+    pthread_mutex_unlock(&bump_bufs_lock);
+
     for (n = 0; n < MAX_NUMBER_OF_SLAB_CLASSES; n++) {
         memset(&totals, 0, sizeof(itemstats_t));
         int x;
@@ -660,6 +1280,13 @@ void item_stats(ADD_STAT add_stats, void *c) {
             totals.moves_to_warm += itemstats[i].moves_to_warm;
             totals.moves_within_lru += itemstats[i].moves_within_lru;
             totals.direct_reclaims += itemstats[i].direct_reclaims;
+            totals.bumps_drained += itemstats[i].bumps_drained;
+            totals.admission_rejects += itemstats[i].admission_rejects;
+            totals.inline_moves += itemstats[i].inline_moves;
+            totals.inline_evictions += itemstats[i].inline_evictions;
+            totals.reserve_evictions += itemstats[i].reserve_evictions;
+            totals.reserve_misses += itemstats[i].reserve_misses;
+            totals.cost_spared += itemstats[i].cost_spared;
             size += sizes[i];
             lru_size_map[x] = sizes[i];
             if (lru_type_map[x] == COLD_LRU && tails[i] != NULL)
@@ -708,6 +1335,54 @@ void item_stats(ADD_STAT add_stats, void *c) {
                                 "%llu", (unsigned long long)totals.moves_within_lru);
             APPEND_NUM_FMT_STAT(fmt, n, "direct_reclaims",
                                 "%llu", (unsigned long long)totals.direct_reclaims);
+            APPEND_NUM_FMT_STAT(fmt, n, "inline_moves",
+                                "%llu", (unsigned long long)totals.inline_moves);
+            APPEND_NUM_FMT_STAT(fmt, n, "inline_evictions",
+                                "%llu", (unsigned long long)totals.inline_evictions);
+            APPEND_NUM_FMT_STAT(fmt, n, "alloc_rate",
+                                "%llu", (unsigned long long)lru_pressure[n].rate);
+        }
+        if (settings.lru_bump_buffers) {
+            APPEND_NUM_FMT_STAT(fmt, n, "bumps_drained",
+                                "%llu", (unsigned long long)totals.bumps_drained);
+            APPEND_NUM_FMT_STAT(fmt, n, "bumps_dropped",
+                                "%llu", (unsigned long long)bumps_dropped[n]);
+        }
+        if (settings.lru_admission) {
+            APPEND_NUM_FMT_STAT(fmt, n, "admission_rejects",
+                                "%llu", (unsigned long long)totals.admission_rejects);
+        }
+        if (settings.lru_reserve) {
+            APPEND_NUM_FMT_STAT(fmt, n, "reserve_evictions",
+                                "%llu", (unsigned long long)totals.reserve_evictions);
+            APPEND_NUM_FMT_STAT(fmt, n, "reserve_misses",
+                                "%llu", (unsigned long long)totals.reserve_misses);
+        }
+        if (settings.lru_cost) {
+            APPEND_NUM_FMT_STAT(fmt, n, "cost_spared",
+                                "%llu", (unsigned long long)totals.cost_spared);
+        }
+        if (settings.lru_ghosts) {
+            lru_ghosts_t g;
+            unsigned int warm;
+            pthread_mutex_lock(&lru_locks[n|COLD_LRU]);
+            g = lru_ghosts[n];
+            pthread_mutex_unlock(&lru_locks[n|COLD_LRU]);
+            warm = g.warm_target ? g.warm_target : settings.warm_lru_pct * 100;
+            APPEND_NUM_FMT_STAT(fmt, n, "target_hot_pct", "%d", settings.hot_lru_pct);
+            APPEND_NUM_FMT_STAT(fmt, n, "target_warm_pct", "%.2f", warm / 100.0);
+            APPEND_NUM_FMT_STAT(fmt, n, "target_cold_pct", "%.2f",
+                                100 - settings.hot_lru_pct - warm / 100.0);
+            APPEND_NUM_FMT_STAT(fmt, n, "ghosts_recent",
+                                "%llu", (unsigned long long)g.size[GHOST_RECENT]);
+            APPEND_NUM_FMT_STAT(fmt, n, "ghosts_frequent",
+                                "%llu", (unsigned long long)g.size[GHOST_FREQUENT]);
+            APPEND_NUM_FMT_STAT(fmt, n, "ghost_hits_recent",
+                                "%llu", (unsigned long long)g.hits[GHOST_RECENT]);
+            APPEND_NUM_FMT_STAT(fmt, n, "ghost_hits_frequent",
+                                "%llu", (unsigned long long)g.hits[GHOST_FREQUENT]);
+            APPEND_NUM_FMT_STAT(fmt, n, "ghost_hit_rate", "%.2f", g.lookups ?
+                                (g.hits[0] + g.hits[1]) * 100.0 / g.lookups : 0.0);
         }
     }
 
@@ -849,6 +1524,8 @@ item *do_item_touch(const char *key, size_t nkey, uint32_t exptime,
     item *it = do_item_get(key, nkey, hv);
     if (it != NULL) {
         it->exptime = exptime;
+        if (settings.expiry_wheel)
+            expiry_wheel_add(it, hv);
     }
     return it;
 }
@@ -858,7 +1535,7 @@ item *do_item_touch(const char *key, size_t nkey, uint32_t exptime,
 /* Returns number of items remove, expired, or evicted.
  * Callable from worker threads or the LRU maintainer thread */
 static int lru_pull_tail(const int orig_id, const int cur_lru,
-        const unsigned int total_chunks, const bool do_evict, const uint32_t cur_hv) {
+        const unsigned int total_chunks, const int flags, const uint32_t cur_hv) {
     item *it = NULL;
     int id = orig_id;
     int removed = 0;
@@ -884,7 +1561,7 @@ static int lru_pull_tail(const int orig_id, const int cur_lru,
             tries++;
             continue;
         }
-        uint32_t hv = hash(ITEM_key(search), search->nkey);
+        uint32_t hv = ITEM_hash(search);
         /* Attempt to hash item lock the "search" item. If locked, no
          * other callers can incr the refcount. Also skip ourselves. */
         if (hv == cur_hv || (hold_lock = item_trylock(hv)) == NULL)
@@ -930,11 +1607,15 @@ static int lru_pull_tail(const int orig_id, const int cur_lru,
          */
         switch (cur_lru) {
             case HOT_LRU:
-                limit = total_chunks * settings.hot_lru_pct / 100;
             case WARM_LRU:
-                limit = total_chunks * settings.warm_lru_pct / 100;
+                if (cur_lru == HOT_LRU)
+                    limit = total_chunks * settings.hot_lru_pct / 100;
+                else
+                    limit = (uint64_t)total_chunks * lru_warm_target(orig_id) / 10000;
                 if (sizes[id] > limit) {
                     itemstats[id].moves_to_cold++;
+                    if (flags & LRU_PULL_INLINE)
+                        itemstats[id].inline_moves++;
                     move_to_lru = COLD_LRU;
                     do_item_unlink_q(search);
                     it = search;
@@ -954,18 +1635,40 @@ static int lru_pull_tail(const int orig_id, const int cur_lru,
                 break;
             case COLD_LRU:
                 it = search; /* No matter what, we're stopping */
-                if (do_evict) {
+                if (flags & LRU_PULL_EVICT) {
                     if (settings.evict_to_free == 0) {
                         /* Don't think we need a counter for this. It'll OOM.  */
                         break;
                     }
+                    /* -o lru_cost: each unit of cost buys lru_cost seconds
+                     * since the last access. Send an item still inside
+                     * them round COLD again; the last try evicts anyway. */
+                    if (settings.lru_cost && search->cost && tries > 1
+                        && next_it != NULL && search->time
+                        + (uint64_t)search->cost * settings.lru_cost > current_time) {
+                        itemstats[id].cost_spared++;
+                        do_item_unlink_q(search);
+                        do_item_link_q(search);
+                        do_item_remove(search);
+                        item_trylock_unlock(hold_lock);
+                        it = NULL;
+                        continue;
+                    }
                     itemstats[id].evicted++;
+                    if (flags & LRU_PULL_INLINE)
+                        itemstats[id].inline_evictions++;
+                    else
+                        itemstats[id].reserve_evictions++;
                     itemstats[id].evicted_time = current_time - search->time;
                     if (search->exptime != 0)
                         itemstats[id].evicted_nonzero++;
                     if ((search->it_flags & ITEM_FETCHED) == 0) {
                         itemstats[id].evicted_unfetched++;
                     }
+                    if (settings.lru_ghosts) {
+                        lru_ghost_add(orig_id, hv, (search->it_flags & ITEM_FETCHED) ?
+                                      GHOST_FREQUENT : GHOST_RECENT, total_chunks);
+                    }
                     do_item_unlink_nolock(search, hv);
                     removed++;
                     if (settings.slab_automove == 2) {
@@ -1000,22 +1703,93 @@ static int lru_pull_tail(const int orig_id, const int cur_lru,
     return removed;
 }
 
+#define LRU_PRESSURE_INTERVAL 100000
+#define LRU_JUGGLE_MIN_BATCH 1000
+#define LRU_JUGGLE_MAX_BATCH 50000
+
+static void lru_pressure_sample(void) {
+    uint64_t counts[MAX_NUMBER_OF_SLAB_CLASSES];
+    struct timeval now;
+    uint64_t us, rate;
+    int i;
+
+    gettimeofday(&now, NULL);
+    us = (uint64_t)(now.tv_sec - lru_pressure_sampled.tv_sec) * 1000000
+        + now.tv_usec - lru_pressure_sampled.tv_usec;
+    if (us < LRU_PRESSURE_INTERVAL)
+        return;
+    slabs_alloc_counts(counts);
+    for (i = POWER_SMALLEST; i < MAX_NUMBER_OF_SLAB_CLASSES; i++) {
+        rate = (counts[i] - lru_pressure[i].allocs) * 1000000 / us;
+        lru_pressure[i].rate = (lru_pressure[i].rate + rate) / 2;
+        lru_pressure[i].allocs = counts[i];
+    }
+    lru_pressure_sampled = now;
+}
+
+/*
+ * -o lru_reserve=<pct>: keep that share of every full class's chunks free by
+ * evicting off COLD ahead of demand, so slabs_alloc() nearly always works
+ * first time and workers stay out of lru_pull_tail(). Refilling starts when
+ * the free chunks drop below the low watermark, half the reserve, and goes
+ * on until they're back at the high one. Returns the evictions done.
+ */
+static int lru_reserve_fill(const int slabs_clsid, unsigned int *chunks_free,
+                            const unsigned int total_chunks, const uint64_t batch) {
+    lru_pressure_t *p = &lru_pressure[slabs_clsid];
+    unsigned int high = (uint64_t)total_chunks * settings.lru_reserve / 100;
+    unsigned int low;
+    uint64_t i;
+    int evicted = 0, r;
+
+    if (high < 2)
+        high = 2;
+    low = high / 2;
+    if (*chunks_free < low)
+        p->refilling = true;
+    if (!p->refilling)
+        return 0;
+
+    for (i = 0; i < batch && *chunks_free < high; i++) {
+        r = lru_pull_tail(slabs_clsid, COLD_LRU, total_chunks, LRU_PULL_EVICT, 0);
+        if (r == 0) {
+            /* COLD's dry or its tail is busy; top it up from HOT/WARM. */
+            if (lru_pull_tail(slabs_clsid, HOT_LRU, total_chunks, 0, 0) == 0 &&
+                lru_pull_tail(slabs_clsid, WARM_LRU, total_chunks, 0, 0) == 0)
+                break;
+            continue;
+        }
+        /* An evicted item someone still holds is freed when they let go;
+         * the recount below catches up. */
+        *chunks_free += r;
+        evicted += r;
+    }
+    *chunks_free = slabs_available_chunks(slabs_clsid, NULL, NULL, NULL);
+    if (*chunks_free >= high)
+        p->refilling = false;
+    return evicted;
+}
+
 /* Loop up to N times:
  * If too many items are in HOT_LRU, push to COLD_LRU
  * If too many items are in WARM_LRU, push to COLD_LRU
  * If too many items are in COLD_LRU, poke COLD_LRU tail
- * 1000 loops with 1ms min sleep gives us under 1m items shifted/sec. The
- * locks can't handle much more than that. Leaving a TODO for how to
- * autoadjust in the future.
+ * The number of loops covers twice the allocations expected until the next
+ * wakeup, going by how many the class saw while we slept, and is never less
+ * than the 1000 we always used to run. With the memory limit hit, *wake is
+ * lowered to when half of the class's free chunks and COLD items will have
+ * been used up at that rate, so workers find something to evict on COLD's
+ * tail instead of shuffling HOT and WARM themselves.
  */
-static int lru_maintainer_juggle(const int slabs_clsid) {
+static int lru_maintainer_juggle(const int slabs_clsid, const useconds_t slept,
+                                 useconds_t *wake) {
     int i;
     int did_moves = 0;
     bool mem_limit_reached = false;
     unsigned int total_chunks = 0;
     unsigned int chunks_perslab = 0;
     unsigned int chunks_free = 0;
-    /* TODO: if free_chunks below high watermark, increase aggressiveness */
+    uint64_t rate, batch, headroom;
     chunks_free = slabs_available_chunks(slabs_clsid, &mem_limit_reached,
             &total_chunks, &chunks_perslab);
     if (settings.expirezero_does_not_evict)
@@ -1029,21 +1803,104 @@ static int lru_maintainer_juggle(const int slabs_clsid) {
         slabs_reassign(slabs_clsid, SLAB_GLOBAL_PAGE_POOL);
     }
 
+    rate = lru_pressure[slabs_clsid].rate;
+    batch = rate * slept / 1000000 * 2;
+    if (batch < LRU_JUGGLE_MIN_BATCH)
+        batch = LRU_JUGGLE_MIN_BATCH;
+    else if (batch > LRU_JUGGLE_MAX_BATCH)
+        batch = LRU_JUGGLE_MAX_BATCH;
+
     /* Juggle HOT/WARM up to N times */
-    for (i = 0; i < 1000; i++) {
+    for (i = 0; i < batch; i++) {
         int do_more = 0;
-        if (lru_pull_tail(slabs_clsid, HOT_LRU, total_chunks, false, 0) ||
-            lru_pull_tail(slabs_clsid, WARM_LRU, total_chunks, false, 0)) {
+        if (lru_pull_tail(slabs_clsid, HOT_LRU, total_chunks, 0, 0) ||
+            lru_pull_tail(slabs_clsid, WARM_LRU, total_chunks, 0, 0)) {
             do_more++;
         }
-        do_more += lru_pull_tail(slabs_clsid, COLD_LRU, total_chunks, false, 0);
+        do_more += lru_pull_tail(slabs_clsid, COLD_LRU, total_chunks, 0, 0);
         if (do_more == 0)
             break;
         did_moves++;
     }
+
+    if (settings.lru_reserve && mem_limit_reached) {
+        did_moves += lru_reserve_fill(slabs_clsid, &chunks_free, total_chunks, batch);
+        /* Back before the reserve is gone, not COLD. */
+        headroom = chunks_free;
+    } else {
+        pthread_mutex_lock(&lru_locks[slabs_clsid|COLD_LRU]);
+        headroom = chunks_free + sizes[slabs_clsid|COLD_LRU];
+        pthread_mutex_unlock(&lru_locks[slabs_clsid|COLD_LRU]);
+    }
+    if (mem_limit_reached && rate != 0) {
+        if (headroom * 1000000 / rate / 2 < *wake)
+            *wake = headroom * 1000000 / rate / 2;
+    }
     return did_moves;
 }
 
+/*
+ * Direct eviction for -o lru_engine=clock|sampled, from do_item_alloc().
+ * Takes candidates from slabs_evict_candidate() until one goes: expired ones
+ * are reclaimed, and under CLOCK an ACTIVE one loses its flag and is passed
+ * over, the second chance a hit in the HOT/WARM LRUs would have given it.
+ */
+#define LRU_ENGINE_TRIES 500
+
+static int lru_engine_evict(const int id, const uint32_t cur_hv) {
+    const unsigned int samples =
+        settings.lru_engine == LRU_ENGINE_SAMPLED ? settings.lru_samples : 0;
+    void *hold_lock = NULL;
+    item *search;
+    uint32_t hv;
+    int tries, lru_id;
+
+    for (tries = 0; tries < LRU_ENGINE_TRIES; tries++) {
+        search = slabs_evict_candidate(id, samples, cur_hv, &hv, &hold_lock);
+        if (search == NULL)
+            continue;
+        lru_id = search->slabs_clsid;
+        if ((search->exptime != 0 && search->exptime < current_time)
+            || item_is_flushed(search)) {
+            pthread_mutex_lock(&lru_locks[lru_id]);
+            itemstats[lru_id].reclaimed++;
+            if ((search->it_flags & ITEM_FETCHED) == 0) {
+                itemstats[lru_id].expired_unfetched++;
+            }
+            pthread_mutex_unlock(&lru_locks[lru_id]);
+        } else if (samples == 0 && (search->it_flags & ITEM_ACTIVE) != 0) {
+            search->it_flags &= ~ITEM_ACTIVE;
+            do_item_remove(search);
+            item_trylock_unlock(hold_lock);
+            continue;
+        } else if (settings.evict_to_free == 0) {
+            do_item_remove(search);
+            item_trylock_unlock(hold_lock);
+            return 0;
+        } else {
+            pthread_mutex_lock(&lru_locks[lru_id]);
+            itemstats[lru_id].evicted++;
+            itemstats[lru_id].evicted_time = current_time - search->time;
+            if (search->exptime != 0)
+                itemstats[lru_id].evicted_nonzero++;
+            if ((search->it_flags & ITEM_FETCHED) == 0) {
+                itemstats[lru_id].evicted_unfetched++;
+            }
+            pthread_mutex_unlock(&lru_locks[lru_id]);
+            if (settings.slab_automove == 2) {
+                slabs_reassign(-1, id);
+            }
+        }
+        /* refcnt 2 -> 1; we don't hold the LRU lock, unlike the tail pull */
+        do_item_unlink(search, hv);
+        /* refcnt 1 -> 0 -> item_free */
+        do_item_remove(search);
+        item_trylock_unlock(hold_lock);
+        return 1;
+    }
+    return 0;
+}
+
 /* Will crawl all slab classes a minimum of once per hour */
 #define MAX_MAINTCRAWL_WAIT 60 * 60
 
@@ -1107,10 +1964,386 @@ static void lru_maintainer_crawler_check(void) {
     }
 }
 
-static pthread_t lru_maintainer_tid;
+/*
+ * -o expiry_wheel: a hierarchical timing wheel of items with an exptime, so
+ * the maintainer can free exactly the items that expire each second instead
+ * of waiting for them to reach an LRU tail or for a crawl. Level 0 has a
+ * slot per second for the next 256 seconds, each level above 64 slots each
+ * covering a whole turn of the level below. When level 0 wraps around, the
+ * due slot of the level above is cascaded down into it.
+ *
+ * An item has at most one entry. The wheel is split into stripes by hash,
+ * each with its own lock, slots and an index of its entries by item, so a
+ * touch moves the item's entry and unlinking the item takes it out. Stripe
+ * locks nest inside item locks; the maintainer only trylocks items.
+ */
+#define WHEEL_LEVELS 4
+#define WHEEL_BITS0 8
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS0 (1 << WHEEL_BITS0)
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_STRIPE_BITS 4
+#define WHEEL_STRIPES (1 << WHEEL_STRIPE_BITS)
+
+typedef struct _wheel_entry wheel_entry;
+struct _wheel_entry {
+    wheel_entry *next;      /* in its slot */
+    wheel_entry *prev;
+    wheel_entry **slot;
+    wheel_entry *h_next;    /* in its stripe's index */
+    item *it;
+    uint32_t hv;
+    rel_time_t exptime;
+};
+
+typedef struct {
+    pthread_mutex_t lock;
+    wheel_entry *slots0[WHEEL_SLOTS0];
+    wheel_entry *slotsn[WHEEL_LEVELS - 1][WHEEL_SLOTS];
+    wheel_entry *due;       /* second being reclaimed by the maintainer */
+    wheel_entry **index;    /* by item, bucketed on the hash above the stripe */
+    uint32_t index_size;
+    wheel_entry *free;      /* unused entries, kept for reuse */
+    rel_time_t now;         /* next second to be reclaimed */
+    uint64_t entries;
+    uint64_t free_entries;
+    uint64_t dropped;       /* couldn't allocate an entry */
+} wheel_stripe;
+
+static wheel_stripe wheels[WHEEL_STRIPES];
+
+static struct {
+    uint64_t reclaimed;
+    uint64_t last_reclaims; /* in the last whole second */
+    uint64_t cur_reclaims;
+    rel_time_t cur_time;
+} wheel_stats;
+static pthread_mutex_t wheel_stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void expiry_wheel_init(void) {
+    int i;
+    for (i = 0; i < WHEEL_STRIPES; i++)
+        pthread_mutex_init(&wheels[i].lock, NULL);
+}
+
+/* The slot an exptime belongs in right now. Stripe lock held. */
+static wheel_entry **wheel_slot_for(wheel_stripe *s, rel_time_t exptime) {
+    uint32_t delta;
+    int shift, l;
+
+    if ((int32_t)(exptime - s->now) < 0)
+        exptime = s->now;
+    delta = exptime - s->now;
+    if (delta < WHEEL_SLOTS0)
+        return &s->slots0[exptime & (WHEEL_SLOTS0 - 1)];
+    for (l = 0; l < WHEEL_LEVELS - 1; l++) {
+        shift = WHEEL_BITS0 + l * WHEEL_BITS;
+        if (delta < (1U << (shift + WHEEL_BITS)))
+            break;
+    }
+    if (l == WHEEL_LEVELS - 1) {
+        /* Too far out; park it in the last slot and it'll come round again. */
+        l--;
+        shift = WHEEL_BITS0 + l * WHEEL_BITS;
+        exptime = s->now + (1U << (shift + WHEEL_BITS)) - 1;
+    }
+    return &s->slotsn[l][(exptime >> shift) & (WHEEL_SLOTS - 1)];
+}
+
+static void wheel_link(wheel_stripe *s, wheel_entry *e) {
+    wheel_entry **slot = wheel_slot_for(s, e->exptime);
+    e->slot = slot;
+    e->prev = NULL;
+    e->next = *slot;
+    if (*slot)
+        (*slot)->prev = e;
+    *slot = e;
+}
+
+static void wheel_unlink(wheel_entry *e) {
+    if (e->prev)
+        e->prev->next = e->next;
+    else
+        *e->slot = e->next;
+    if (e->next)
+        e->next->prev = e->prev;
+}
+
+/* Where the item's entry hangs off the index, NULL if it has none. */
+static wheel_entry **wheel_find(wheel_stripe *s, const item *it, const uint32_t hv) {
+    wheel_entry **pos;
+
+    if (s->index == NULL)
+        return NULL;
+    pos = &s->index[(hv >> WHEEL_STRIPE_BITS) & (s->index_size - 1)];
+    while (*pos != NULL && (*pos)->it != it)
+        pos = &(*pos)->h_next;
+    return *pos != NULL ? pos : NULL;
+}
+
+static void wheel_index_grow(wheel_stripe *s) {
+    uint32_t size = s->index_size ? s->index_size * 2 : 256;
+    uint32_t i, b;
+    wheel_entry **index, *e, *next;
+
+    index = calloc(size, sizeof(wheel_entry *));
+    if (index == NULL)
+        return; /* Chains just get longer. */
+    for (i = 0; i < s->index_size; i++) {
+        for (e = s->index[i]; e != NULL; e = next) {
+            next = e->h_next;
+            b = (e->hv >> WHEEL_STRIPE_BITS) & (size - 1);
+            e->h_next = index[b];
+            index[b] = e;
+        }
+    }
+    free(s->index);
+    s->index = index;
+    s->index_size = size;
+}
+
+/* Takes an entry out of the index and its slot. Stripe lock held. */
+static void wheel_drop(wheel_stripe *s, wheel_entry **pos) {
+    wheel_entry *e = *pos;
+    *pos = e->h_next;
+    wheel_unlink(e);
+    e->next = s->free;
+    s->free = e;
+    s->entries--;
+    s->free_entries++;
+}
+
+/* Called with the item lock held, whenever an item gets a new exptime. */
+void expiry_wheel_add(item *it, const uint32_t hv) {
+    wheel_stripe *s = &wheels[hv & (WHEEL_STRIPES - 1)];
+    wheel_entry **pos, *e;
+
+    pthread_mutex_lock(&s->lock);
+    if ((pos = wheel_find(s, it, hv)) != NULL) {
+        if (it->exptime == 0) {
+            wheel_drop(s, pos);
+        } else {
+            e = *pos;
+            wheel_unlink(e);
+            e->exptime = it->exptime;
+            wheel_link(s, e);
+        }
+        pthread_mutex_unlock(&s->lock);
+        return;
+    }
+    if (it->exptime == 0) {
+        pthread_mutex_unlock(&s->lock);
+        return;
+    }
+    if (s->entries >= s->index_size)
+        wheel_index_grow(s);
+    if ((e = s->free) != NULL) {
+        s->free = e->next;
+        s->free_entries--;
+    } else {
+        e = malloc(sizeof(wheel_entry));
+    }
+    if (e == NULL || s->index == NULL) {
+        /* The item will still go by the LRU tail or the crawler. */
+        free(e);
+        s->dropped++;
+        pthread_mutex_unlock(&s->lock);
+        return;
+    }
+    e->it = it;
+    e->hv = hv;
+    e->exptime = it->exptime;
+    pos = &s->index[(hv >> WHEEL_STRIPE_BITS) & (s->index_size - 1)];
+    e->h_next = *pos;
+    *pos = e;
+    wheel_link(s, e);
+    s->entries++;
+    pthread_mutex_unlock(&s->lock);
+}
+
+/* Called with the item lock held, as an item with an exptime is unlinked. */
+void expiry_wheel_del(item *it, const uint32_t hv) {
+    wheel_stripe *s = &wheels[hv & (WHEEL_STRIPES - 1)];
+    wheel_entry **pos;
+
+    pthread_mutex_lock(&s->lock);
+    if ((pos = wheel_find(s, it, hv)) != NULL)
+        wheel_drop(s, pos);
+    pthread_mutex_unlock(&s->lock);
+}
+
+/* Runs one stripe's seconds up to current_time. Entries come off the due list
+ * one at a time, so workers can still move or drop the rest while an item is
+ * being freed. Busy ones land in the next second's slot. */
+static int wheel_run_stripe(wheel_stripe *s) {
+    wheel_entry *e, *next;
+    void *hold_lock;
+    item *it;
+    uint32_t hv, idx;
+    int l, shift, reclaimed = 0;
+
+    pthread_mutex_lock(&s->lock);
+    while ((int32_t)(current_time - s->now) >= 0) {
+        if ((s->now & (WHEEL_SLOTS0 - 1)) == 0) {
+            for (l = 0; l < WHEEL_LEVELS - 1; l++) {
+                shift = WHEEL_BITS0 + l * WHEEL_BITS;
+                idx = (s->now >> shift) & (WHEEL_SLOTS - 1);
+                e = s->slotsn[l][idx];
+                s->slotsn[l][idx] = NULL;
+                for (; e != NULL; e = next) {
+                    next = e->next;
+                    wheel_link(s, e);
+                }
+                if (idx != 0)
+                    break;
+            }
+        }
+        idx = s->now & (WHEEL_SLOTS0 - 1);
+        s->due = s->slots0[idx];
+        s->slots0[idx] = NULL;
+        for (e = s->due; e != NULL; e = e->next)
+            e->slot = &s->due;
+        s->now++;
+
+        while ((e = s->due) != NULL) {
+            it = e->it;
+            hv = e->hv;
+            if ((hold_lock = item_trylock(hv)) == NULL) {
+                wheel_unlink(e);
+                wheel_link(s, e);
+                continue;
+            }
+            if (refcount_incr(&it->refcount) != 2) {
+                /* Someone's still sending it out. */
+                refcount_decr(&it->refcount);
+                item_trylock_unlock(hold_lock);
+                wheel_unlink(e);
+                wheel_link(s, e);
+                continue;
+            }
+            wheel_drop(s, wheel_find(s, it, hv));
+            pthread_mutex_unlock(&s->lock);
+            do_item_unlink(it, hv);
+            do_item_remove(it);
+            item_trylock_unlock(hold_lock);
+            reclaimed++;
+            pthread_mutex_lock(&s->lock);
+        }
+    }
+    pthread_mutex_unlock(&s->lock);
+    return reclaimed;
+}
+
+/* Returns the number of items freed. */
+static int expiry_wheel_run(void) {
+    int i, reclaimed = 0;
+
+    for (i = 0; i < WHEEL_STRIPES; i++)
+        reclaimed += wheel_run_stripe(&wheels[i]);
+
+    pthread_mutex_lock(&wheel_stats_lock);
+    if (wheel_stats.cur_time != current_time) {
+        wheel_stats.last_reclaims = wheel_stats.cur_time + 1 == current_time ?
+            wheel_stats.cur_reclaims : 0;
+        wheel_stats.cur_reclaims = 0;
+        wheel_stats.cur_time = current_time;
+    }
+    wheel_stats.cur_reclaims += reclaimed;
+    wheel_stats.reclaimed += reclaimed;
+    pthread_mutex_unlock(&wheel_stats_lock);
+    return reclaimed;
+}
+
+static void expiry_wheel_stats(ADD_STAT add_stats, void *c) {
+    uint64_t entries = 0, bytes = sizeof(wheels), dropped = 0;
+    int i;
+
+    for (i = 0; i < WHEEL_STRIPES; i++) {
+        wheel_stripe *s = &wheels[i];
+        pthread_mutex_lock(&s->lock);
+        entries += s->entries;
+        bytes += (s->entries + s->free_entries) * sizeof(wheel_entry)
+            + s->index_size * sizeof(wheel_entry *);
+        dropped += s->dropped;
+        pthread_mutex_unlock(&s->lock);
+    }
+    APPEND_STAT("expiry_wheel_entries", "%llu", (unsigned long long)entries);
+    APPEND_STAT("expiry_wheel_bytes", "%llu", (unsigned long long)bytes);
+    pthread_mutex_lock(&wheel_stats_lock);
+    APPEND_STAT("expiry_wheel_reclaimed", "%llu",
+                (unsigned long long)wheel_stats.reclaimed);
+    APPEND_STAT("expiry_wheel_reclaims_per_sec", "%llu",
+                (unsigned long long)(wheel_stats.cur_time + 1 == current_time ?
+                                     wheel_stats.cur_reclaims :
+                                     wheel_stats.cur_time == current_time ?
+                                     wheel_stats.last_reclaims : 0));
+    pthread_mutex_unlock(&wheel_stats_lock);
+    APPEND_STAT("expiry_wheel_dropped", "%llu", (unsigned long long)dropped);
+}
+
+/* Applies one bump taken off a ring. Item lock held. */
+static void lru_bump_apply(item *it) {
+    int id = it->slabs_clsid;
+
+    it->it_flags &= ~ITEM_BUMPED;
+    if ((it->it_flags & ITEM_LINKED) == 0)
+        return;
+    if (!settings.lru_maintainer_thread) {
+        pthread_mutex_lock(&lru_locks[id]);
+        do_item_unlink_q(it);
+        do_item_link_q(it);
+        itemstats[id].bumps_drained++;
+        pthread_mutex_unlock(&lru_locks[id]);
+        return;
+    }
+    /* Already pulled off COLD's tail and moved up. */
+    if ((id & (3<<6)) != COLD_LRU)
+        return;
+    pthread_mutex_lock(&lru_locks[id]);
+    do_item_unlink_q(it);
+    itemstats[id].moves_to_warm++;
+    itemstats[id].bumps_drained++;
+    pthread_mutex_unlock(&lru_locks[id]);
+    it->it_flags &= ~ITEM_ACTIVE;
+    it->slabs_clsid = ITEM_clsid(it) | WARM_LRU;
+    item_link_q(it);
+}
+
+/* Drains every worker's bump ring. Returns the number of bumps taken. */
+static int lru_maintainer_bumps(void) {
+    lru_bump_buf *b;
+    unsigned int head, tail;
+    uint32_t hv;
+    item *it;
+    int drained = 0;
+
+    pthread_mutex_lock(&bump_bufs_lock);
+    for (b = bump_bufs; b != NULL; b = b->next) {
+        head = b->head;
+        bump_barrier();
+        for (tail = b->tail; tail != head; tail++) {
+            it = b->ring[tail % LRU_BUMP_BUF_SIZE];
+            hv = ITEM_hash(it);
+            item_lock(hv);
+            lru_bump_apply(it);
+            do_item_remove(it);
+            item_unlock(hv);
+        }
+        drained += tail - b->tail;
+        /* Done with the slots before the worker may reuse them. */
+        bump_barrier();
+        b->tail = tail;
+    }
+    pthread_mutex_unlock(&bump_bufs_lock);
+    return drained;
+}
+
+static pthread_t lru_maintainer_tid;
 
 #define MAX_LRU_MAINTAINER_SLEEP 1000000
 #define MIN_LRU_MAINTAINER_SLEEP 1000
+/* Floor for sleeps asked for by lru_maintainer_juggle() under pressure */
+#define MIN_LRU_MAINTAINER_BURST_SLEEP 100
 
 static void *lru_maintainer_thread(void *arg) {
     int i;
@@ -1122,21 +2355,34 @@ static void *lru_maintainer_thread(void *arg) {
         fprintf(stderr, "Starting LRU maintainer background thread\n");
     while (do_run_lru_maintainer_thread) {
         int did_moves = 0;
+        useconds_t wake = MAX_LRU_MAINTAINER_SLEEP;
         pthread_mutex_unlock(&lru_maintainer_lock);
         usleep(to_sleep);
         pthread_mutex_lock(&lru_maintainer_lock);
 
-        STATS_LOCK();
-        stats.lru_maintainer_juggles++;
-        STATS_UNLOCK();
-        /* We were asked to immediately wake up and poke a particular slab
-         * class due to a low watermark being hit */
-        if (lru_maintainer_check_clsid != 0) {
-            did_moves = lru_maintainer_juggle(lru_maintainer_check_clsid);
-            lru_maintainer_check_clsid = 0;
-        } else {
-            for (i = POWER_SMALLEST; i < MAX_NUMBER_OF_SLAB_CLASSES; i++) {
-                did_moves += lru_maintainer_juggle(i);
+        if (settings.lru_bump_buffers)
+            did_moves += lru_maintainer_bumps();
+        if (settings.expiry_wheel)
+            did_moves += expiry_wheel_run();
+        if (settings.lru_admission)
+            lru_admission_age();
+        /* Without the segmented LRU we're only here for the bump rings, the
+         * expiry wheel and the admission sketch. */
+        if (settings.lru_maintainer_thread) {
+            STATS_LOCK();
+            stats.lru_maintainer_juggles++;
+            STATS_UNLOCK();
+            lru_pressure_sample();
+            /* We were asked to immediately wake up and poke a particular slab
+             * class due to a low watermark being hit */
+            if (lru_maintainer_check_clsid != 0) {
+                did_moves += lru_maintainer_juggle(lru_maintainer_check_clsid,
+                                                   to_sleep, &wake);
+                lru_maintainer_check_clsid = 0;
+            } else {
+                for (i = POWER_SMALLEST; i < MAX_NUMBER_OF_SLAB_CLASSES; i++) {
+                    did_moves += lru_maintainer_juggle(i, to_sleep, &wake);
+                }
             }
         }
         if (did_moves == 0) {
@@ -1147,8 +2393,18 @@ static void *lru_maintainer_thread(void *arg) {
             if (to_sleep < MIN_LRU_MAINTAINER_SLEEP)
                 to_sleep = MIN_LRU_MAINTAINER_SLEEP;
         }
-        /* Once per second at most */
-        if (settings.lru_crawler && last_crawler_check != current_time) {
+        /* A class is allocating fast enough to run dry before then. */
+        if (wake < to_sleep) {
+            to_sleep = wake < MIN_LRU_MAINTAINER_BURST_SLEEP ?
+                MIN_LRU_MAINTAINER_BURST_SLEEP : wake;
+        }
+        STATS_LOCK();
+        stats.lru_maintainer_sleep = to_sleep;
+        STATS_UNLOCK();
+        /* Once per second at most. The expiry wheel already frees what
+         * the crawler would have come looking for. */
+        if (settings.lru_maintainer_thread && settings.lru_crawler &&
+            !settings.expiry_wheel && last_crawler_check != current_time) {
             lru_maintainer_crawler_check();
             last_crawler_check = current_time;
         }
@@ -1173,12 +2429,14 @@ int stop_lru_maintainer_thread(void) {
     return 0;
 }
 
-int start_lru_maintainer_thread(void) {
+/* With segmented false the thread leaves the LRU alone and only drains the
+ * -o lru_bump_buffers rings and turns the -o expiry_wheel. */
+int start_lru_maintainer_thread(const bool segmented) {
     int ret;
 
     pthread_mutex_lock(&lru_maintainer_lock);
     do_run_lru_maintainer_thread = 1;
-    settings.lru_maintainer_thread = true;
+    settings.lru_maintainer_thread = segmented;
     if ((ret = pthread_create(&lru_maintainer_tid, NULL,
         lru_maintainer_thread, NULL)) != 0) {
         fprintf(stderr, "Can't create LRU maintainer thread: %s\n",
@@ -1203,6 +2461,7 @@ void lru_maintainer_resume(void) {
 int init_lru_maintainer(void) {
     if (lru_maintainer_initialized == 0) {
         pthread_mutex_init(&lru_maintainer_lock, NULL);
+        expiry_wheel_init();
         lru_maintainer_initialized = 1;
     }
     return 0;
@@ -1316,9 +2575,8 @@ static item *crawler_crawl_q(item *it) {
 /* I pulled this out to make the main thread clearer, but it reaches into the
  * main thread's values too much. Should rethink again.
  */ //itemʧЧˣôɾ
-static void item_crawler_evaluate(item *search, uint32_t hv, int i) {
-    int slab_id = CLEAR_LRU(i);
-    crawlerstats_t *s = &crawlerstats[slab_id];
+static int item_crawler_evaluate(item *search, uint32_t hv, int i,
+                                 crawlerstats_t *s) {
     itemstats[i].crawler_items_checked++;
     if ((search->exptime != 0 && search->exptime < current_time)//itemexptimeʱˣѾʧЧ  
         || item_is_flushed(search)) {//Ϊͻ˷flush_allitemʧЧ
@@ -1342,6 +2600,7 @@ static void item_crawler_evaluate(item *search, uint32_t hv, int i) {
         do_item_unlink_nolock(search, hv);
         do_item_remove(search);
         assert(search->slabs_clsid == 0);
+        return 1;
     } else {
         s->seen++;
         refcount_decr(&search->refcount);
@@ -1355,6 +2614,7 @@ static void item_crawler_evaluate(item *search, uint32_t hv, int i) {
             s->histo[bucket]++;
         }
     }
+    return 0;
 }
 
 /*
@@ -1362,88 +2622,383 @@ static void item_crawler_evaluate(item *search, uint32_t hv, int i) {
 num-1Ҫitem_crawler_evaluateһitemǷڣǵĻɾnum-1
 αitemûеLRUеͷôֱӽαitemLRUɾ
 */
-static void *item_crawler_thread(void *arg) {
-    int i;
+/* -o lru_crawler_threads: the crawler is a pool of threads. Each one takes
+ * a whole LRU at a time off those with a crawler item linked in, so the
+ * classes and the HOT/WARM/COLD segments of one class get crawled side by
+ * side. The LRU that gave up the most expired items on its last run goes
+ * first. */
+typedef struct {
+    pthread_t tid;
+    pthread_mutex_t lock;   /* held while crawling, see lru_crawler_pause() */
+    /* The rest is under lru_crawler_stats_lock. The thread counts in locals
+     * and only publishes lru_checked when it pauses between batches. */
+    uint32_t sid;           /* LRU being crawled, 0 when idle */
+    uint64_t lru_checked;   /* items looked at in that LRU so far */
+    uint64_t items_checked; /* in LRUs already finished */
+    uint64_t reclaimed;
+    uint64_t lrus_crawled;
+    uint64_t busy_us;       /* spent on LRUs already finished */
+    struct timeval lru_start;
+} crawler_thread;
+
+static crawler_thread *crawler_threads;
+static int crawler_nthreads;
+static int crawler_threads_up;             /* under lru_crawler_lock */
+static uint8_t crawler_busy[LARGEST_ID];   /* LRU has a thread on it */
+static uint64_t crawler_yield[LARGEST_ID]; /* reclaimed on its last run */
+
+static uint64_t crawler_elapsed_us(const struct timeval *start,
+                                   const struct timeval *end) {
+    return (uint64_t)(end->tv_sec - start->tv_sec) * 1000000
+        + end->tv_usec - start->tv_usec;
+}
+
+/* Picks the next queued LRU nobody is on yet. lru_crawler_lock held. */
+static uint32_t crawler_next_lru(void) {
+    uint32_t sid, best = 0;
+    for (sid = POWER_SMALLEST; sid < LARGEST_ID; sid++) {
+        if (crawlers[sid].it_flags != 1 || crawler_busy[sid])
+            continue;
+        if (best == 0 || crawler_yield[sid] > crawler_yield[best])
+            best = sid;
+    }
+    return best;
+}
+
+/* Per thread progress for "stats crawlers". */
+static void crawler_begin(crawler_thread *me, const uint32_t sid) {
+    pthread_mutex_lock(&lru_crawler_stats_lock);
+    me->sid = sid;
+    gettimeofday(&me->lru_start, NULL);
+    pthread_mutex_unlock(&lru_crawler_stats_lock);
+}
+
+static void crawler_progress(crawler_thread *me, const uint64_t checked) {
+    pthread_mutex_lock(&lru_crawler_stats_lock);
+    me->lru_checked = checked;
+    pthread_mutex_unlock(&lru_crawler_stats_lock);
+}
+
+static void crawler_end(crawler_thread *me, const uint64_t checked,
+                        const uint64_t reclaimed) {
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+    pthread_mutex_lock(&lru_crawler_stats_lock);
+    me->items_checked += checked;
+    me->lru_checked = 0;
+    me->reclaimed += reclaimed;
+    me->lrus_crawled++;
+    me->busy_us += crawler_elapsed_us(&me->lru_start, &now);
+    me->sid = 0;
+    pthread_mutex_unlock(&lru_crawler_stats_lock);
+}
+
+/* Walks the crawler item of one LRU from its tail to its head. Returns the
+ * number of expired items freed. The items are tallied into a local
+ * crawlerstats_t, added to the class's totals once the pass is done, so
+ * threads on different LRUs don't take turns on lru_crawler_stats_lock. */
+static uint64_t lru_crawler_lru(crawler_thread *me, const uint32_t sid) {
     int crawls_persleep = settings.crawls_persleep;
+    crawlerstats_t pass, *s;
+    uint64_t checked = 0, reclaimed = 0;
+    void *hold_lock;
+    item *search;
+    uint32_t hv;
+    int x;
 
-    pthread_mutex_lock(&lru_crawler_lock);
-    pthread_cond_signal(&lru_crawler_cond);
-    settings.lru_crawler = true;
-    if (settings.verbose > 2)
-        fprintf(stderr, "Starting LRU crawler background thread\n");
-    while (do_run_lru_crawler_thread) {
-        //ȴworkerָ߳ҪLRU,Ҳǵȴͻִlru_crawler tocrawl <classid,classid,classid|all> 
-        //lru_crawler crawl<classid,classid,classid|all>ָġָҪĸLRUн
-    pthread_cond_wait(&lru_crawler_cond, &lru_crawler_lock);
+    memset(&pass, 0, sizeof(pass));
+    pthread_mutex_lock(&me->lock);
+    for (;;) {
+        pthread_mutex_lock(&lru_locks[sid]);
+        search = crawler_crawl_q((item *)&crawlers[sid]);
+        if (search == NULL ||
+            (crawlers[sid].remaining && --crawlers[sid].remaining < 1)) {
+            if (settings.verbose > 2)
+                fprintf(stderr, "Nothing left to crawl for %d\n", sid);
+            crawlers[sid].it_flags = 0;
+            crawler_unlink_q((item *)&crawlers[sid]);
+            pthread_mutex_unlock(&lru_locks[sid]);
+            break;
+        }
+        /* A metadump's crawler item; step over it. */
+        if (search->nbytes == 0 && search->nkey == 0 && search->it_flags == 1) {
+            pthread_mutex_unlock(&lru_locks[sid]);
+            continue;
+        }
+        hv = ITEM_hash(search);
+        /* Attempt to hash item lock the "search" item. If locked, no
+         * other callers can incr the refcount
+         */
+        if ((hold_lock = item_trylock(hv)) == NULL) {
+            pthread_mutex_unlock(&lru_locks[sid]);
+            continue;
+        }
+        /* Now see if the item is refcount locked */
+        if (refcount_incr(&search->refcount) != 2) {
+            refcount_decr(&search->refcount);
+            item_trylock_unlock(hold_lock);
+            pthread_mutex_unlock(&lru_locks[sid]);
+            continue;
+        }
 
-        while (crawler_count) {//crawler_countҪٸLRU  
-        item *search = NULL;
-        void *hold_lock = NULL;
+        /* Frees the item or decrements the refcount. */
+        reclaimed += item_crawler_evaluate(search, hv, sid, &pass);
+        checked++;
 
-        for (i = POWER_SMALLEST; i < LARGEST_ID; i++) {
-            if (crawlers[i].it_flags != 1) {
+        item_trylock_unlock(hold_lock);
+        pthread_mutex_unlock(&lru_locks[sid]);
+
+        if (crawls_persleep-- <= 0) {
+            /* Lets lru_crawler_pause() in between items. */
+            pthread_mutex_unlock(&me->lock);
+            crawler_progress(me, checked);
+            if (settings.lru_crawler_sleep)
+                usleep(settings.lru_crawler_sleep);
+            pthread_mutex_lock(&me->lock);
+            crawls_persleep = settings.crawls_persleep;
+        }
+    }
+    pthread_mutex_unlock(&me->lock);
+
+    pthread_mutex_lock(&lru_crawler_stats_lock);
+    s = &crawlerstats[CLEAR_LRU(sid)];
+    for (x = 0; x < 61; x++)
+        s->histo[x] += pass.histo[x];
+    s->ttl_hourplus += pass.ttl_hourplus;
+    s->noexp += pass.noexp;
+    s->reclaimed += pass.reclaimed;
+    s->seen += pass.seen;
+    s->end_time = current_time;
+    s->run_complete = true;
+    pthread_mutex_unlock(&lru_crawler_stats_lock);
+    crawler_end(me, checked, reclaimed);
+    return reclaimed;
+}
+
+/*** LRU CRAWLER METADUMP ***/
+
+/* "lru_crawler metadump" lends its connection to a crawler thread, which
+ * walks the requested LRUs with crawler items of its own and writes a line
+ * per live item straight to the client's socket. Lines go out in batches
+ * of DUMP_BUF_SIZE; if the client reads slower than that the crawler waits
+ * on the socket with no locks held, so a slow client only holds up its own
+ * dump. One dump runs at a time. */
+#define DUMP_BUF_SIZE (64 * 1024)
+#define DUMP_LINE_MAX 1024
+#define DUMP_STALL_SECS 60
+
+static struct {
+    conn *c;               /* client, NULL when there's no dump */
+    bool running;          /* picked up by a crawler thread */
+    bool failed;           /* client went away or stopped reading */
+    uint8_t classes[MAX_NUMBER_OF_SLAB_CLASSES];
+    int used;
+    char buf[DUMP_BUF_SIZE];
+} dump; /* c and running are under lru_crawler_lock, the rest belongs to
+         * the crawler thread running the dump. */
+static crawler dump_crawlers[LARGEST_ID];
+
+/* key=<url encoded> exp=<unix time or -1> la=<unix time> cls=<id> size=<n> */
+static int dump_line(item *it, char *line) {
+    static const char hex[] = "0123456789ABCDEF";
+    char *key = ITEM_key(it);
+    char *p = line;
+    int i;
+
+    memcpy(p, "key=", 4);
+    p += 4;
+    for (i = 0; i < it->nkey; i++) {
+        unsigned char ch = key[i];
+        if (ch > ' ' && ch < 127 && ch != '%') {
+            *p++ = ch;
+        } else {
+            *p++ = '%';
+            *p++ = hex[ch >> 4];
+            *p++ = hex[ch & 15];
+        }
+    }
+    p += snprintf(p, DUMP_LINE_MAX - (p - line),
+                  " exp=%ld la=%llu cls=%u size=%lu\n",
+                  it->exptime == 0 ? -1 : (long)(it->exptime + process_started),
+                  (unsigned long long)(it->time + process_started),
+                  ITEM_clsid(it), (unsigned long)item_footprint(it));
+    return p - line;
+}
+
+/* Writes out what's buffered, waiting for the client to make room. Gives up
+ * on errors or once the client hasn't read anything for DUMP_STALL_SECS. */
+static bool dump_flush(void) {
+    struct pollfd pfd;
+    int off = 0, stalls = 0;
+    ssize_t n;
+    int r;
+
+    pfd.fd = dump.c->sfd;
+    pfd.events = POLLOUT;
+    while (off < dump.used && !dump.failed) {
+        n = write(dump.c->sfd, dump.buf + off, dump.used - off);
+        if (n > 0) {
+            off += n;
+            stalls = 0;
+            continue;
+        }
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            r = poll(&pfd, 1, 1000);
+            if (r < 0 && errno == EINTR)
                 continue;
-            }
-            pthread_mutex_lock(&lru_locks[i]);
-                //crawlers[i]ǰڵ,crawlers[i]ǰڵλ  
-            search = crawler_crawl_q((item *)&crawlers[i]);
-            if (search == NULL ||
-                (crawlers[i].remaining && --crawlers[i].remaining < 1)) {
-                    //crawlers[i]ͷڵ㣬ûǰڵ  
-                //remainingֵΪsettings.lru_crawler_tocrawlÿlru  
-                //̣߳ÿһlruеĶٸitem
-                if (settings.verbose > 2)
-                    fprintf(stderr, "Nothing left to crawl for %d\n", i);
-                    crawlers[i].it_flags = 0;//㹻Σ˳lru  
-                    crawler_count--;//һLRU,һ  
-                    crawler_unlink_q((item *)&crawlers[i]);//αitemLRUɾ  
-                pthread_mutex_unlock(&lru_locks[i]);
-                pthread_mutex_lock(&lru_crawler_stats_lock);
-                crawlerstats[CLEAR_LRU(i)].end_time = current_time;
-                crawlerstats[CLEAR_LRU(i)].run_complete = true;
-                pthread_mutex_unlock(&lru_crawler_stats_lock);
+            if (r > 0 && !(pfd.revents & (POLLERR | POLLHUP | POLLNVAL)))
                 continue;
-            }
-            uint32_t hv = hash(ITEM_key(search), search->nkey);
-            /* Attempt to hash item lock the "search" item. If locked, no
-             * other callers can incr the refcount
-             */
-                if ((hold_lock = item_trylock(hv)) == NULL) {//סitemĹϣμ  
-                pthread_mutex_unlock(&lru_locks[i]);
+            if (r == 0 && ++stalls < DUMP_STALL_SECS)
                 continue;
+        }
+        dump.failed = true;
+    }
+    dump.used = 0;
+    return !dump.failed;
+}
+
+/* Walks one LRU tail to head like lru_crawler_lru(), but only reads the
+ * items: the line is formatted under the LRU lock, which is enough to keep
+ * a linked item from being freed, and written out after it's dropped. */
+static bool lru_crawler_dump_lru(crawler_thread *me, const uint32_t sid) {
+    int crawls_persleep = settings.crawls_persleep;
+    crawler *cr = &dump_crawlers[sid];
+    char line[DUMP_LINE_MAX];
+    uint64_t checked = 0;
+    item *search;
+    int len;
+
+    pthread_mutex_lock(&lru_locks[sid]);
+    if (tails[sid] == NULL) {
+        pthread_mutex_unlock(&lru_locks[sid]);
+        return true;
+    }
+    memset(cr, 0, sizeof(crawler));
+    cr->it_flags = 1;
+    cr->slabs_clsid = sid;
+    crawler_link_q((item *)cr);
+    pthread_mutex_unlock(&lru_locks[sid]);
+
+    crawler_begin(me, sid);
+    pthread_mutex_lock(&me->lock);
+    for (;;) {
+        pthread_mutex_lock(&lru_locks[sid]);
+        search = crawler_crawl_q((item *)cr);
+        if (search == NULL)
+            break;
+        len = 0;
+        if (!(search->nbytes == 0 && search->nkey == 0 && search->it_flags == 1)
+            && !(search->exptime != 0 && search->exptime < current_time)
+            && !item_is_flushed(search)) {
+            len = dump_line(search, line);
+        }
+        pthread_mutex_unlock(&lru_locks[sid]);
+
+        if (len > 0) {
+            checked++;
+            if (dump.used + len > DUMP_BUF_SIZE) {
+                /* Don't hold up lru_crawler_pause() on a slow client. */
+                pthread_mutex_unlock(&me->lock);
+                dump_flush();
+                pthread_mutex_lock(&me->lock);
             }
-            /* Now see if the item is refcount locked */
-                if (refcount_incr(&search->refcount) != 2) { //ʱworker߳item  
-                    refcount_decr(&search->refcount); //lru̷߳øitem  
-                if (hold_lock)
-                    item_trylock_unlock(hold_lock);
-                pthread_mutex_unlock(&lru_locks[i]);
-                continue;
+            if (dump.failed) {
+                pthread_mutex_lock(&lru_locks[sid]);
+                break;
             }
+            memcpy(dump.buf + dump.used, line, len);
+            dump.used += len;
+        }
 
-            /* Frees the item or decrements the refcount. */
-            /* Interface for this could improve: do the free/decr here
-                 * instead? *///itemʧЧˣôɾitem  
-            pthread_mutex_lock(&lru_crawler_stats_lock);
-            item_crawler_evaluate(search, hv, i);
-            pthread_mutex_unlock(&lru_crawler_stats_lock);
+        if (crawls_persleep-- <= 0) {
+            pthread_mutex_unlock(&me->lock);
+            crawler_progress(me, checked);
+            if (settings.lru_crawler_sleep)
+                usleep(settings.lru_crawler_sleep);
+            pthread_mutex_lock(&me->lock);
+            crawls_persleep = settings.crawls_persleep;
+        }
+    }
+    /* Reached the head, or gave up on the client part way up. */
+    crawler_unlink_q((item *)cr);
+    cr->it_flags = 0;
+    pthread_mutex_unlock(&lru_locks[sid]);
+    pthread_mutex_unlock(&me->lock);
+    crawler_end(me, checked, 0);
+    return !dump.failed;
+}
 
-            if (hold_lock)
-                item_trylock_unlock(hold_lock);
-            pthread_mutex_unlock(&lru_locks[i]);
+static void lru_crawler_dump(crawler_thread *me) {
+    int id, x;
 
-            if (crawls_persleep <= 0 && settings.lru_crawler_sleep) {
-                usleep(settings.lru_crawler_sleep);
-                crawls_persleep = settings.crawls_persleep;
-            }
+    dump.used = 0;
+    dump.failed = false;
+    for (id = POWER_SMALLEST; id < MAX_NUMBER_OF_SLAB_CLASSES; id++) {
+        if (!dump.classes[id])
+            continue;
+        for (x = 0; x < 4; x++) {
+            if (!lru_crawler_dump_lru(me, id | lru_type_map[x]))
+                return;
         }
     }
+    if (dump.used + 5 > DUMP_BUF_SIZE)
+        dump_flush();
+    memcpy(dump.buf + dump.used, "END\r\n", 5);
+    dump.used += 5;
+    dump_flush();
+}
+
+static void *item_crawler_thread(void *arg) {
+    crawler_thread *me = arg;
+    uint64_t reclaimed;
+    uint32_t sid;
+
+    pthread_mutex_lock(&lru_crawler_lock);
+    crawler_threads_up++;
+    pthread_cond_broadcast(&lru_crawler_cond);
     if (settings.verbose > 2)
-        fprintf(stderr, "LRU crawler thread sleeping\n");
-    STATS_LOCK();
-    stats.lru_crawler_running = false;
-    STATS_UNLOCK();
+        fprintf(stderr, "Starting LRU crawler background thread\n");
+    for (;;) {
+        if (dump.c != NULL && !dump.running) {
+            dump.running = true;
+            pthread_mutex_unlock(&lru_crawler_lock);
+            lru_crawler_dump(me);
+            pthread_mutex_lock(&lru_crawler_lock);
+            /* Hand the client back to its worker; it closes it if the dump
+             * was cut short. */
+            redispatch_conn(dump.c, dump.failed ? conn_closing : conn_new_cmd);
+            dump.c = NULL;
+            dump.running = false;
+            continue;
+        }
+        /* Whatever was queued still gets crawled after we're told to stop. */
+        if ((sid = crawler_next_lru()) == 0) {
+            if (!do_run_lru_crawler_thread)
+                break;
+            pthread_cond_wait(&lru_crawler_cond, &lru_crawler_lock);
+            continue;
+        }
+        crawler_busy[sid] = 1;
+        crawler_begin(me, sid);
+        pthread_mutex_unlock(&lru_crawler_lock);
+
+        reclaimed = lru_crawler_lru(me, sid);
+
+        pthread_mutex_lock(&lru_crawler_lock);
+        crawler_yield[sid] = reclaimed;
+        crawler_busy[sid] = 0;
+        if (--crawler_count == 0) {
+            if (settings.verbose > 2)
+                fprintf(stderr, "LRU crawler thread sleeping\n");
+            STATS_LOCK();
+            stats.lru_crawler_running = false;
+            STATS_UNLOCK();
+        }
     }
+    crawler_threads_up--;
     pthread_mutex_unlock(&lru_crawler_lock);
     if (settings.verbose > 2)
         fprintf(stderr, "LRU crawler thread stopping\n");
@@ -1451,19 +3006,72 @@ static void *item_crawler_thread(void *arg) {
     return NULL;
 }
 
-static pthread_t item_crawler_tid; //߳ID
+/* "stats crawlers" */
+void lru_crawler_stats(ADD_STAT add_stats, void *c) {
+    const char *fmt = "crawler:%d:%s";
+    char key_str[STAT_KEY_LEN];
+    char val_str[STAT_VAL_LEN];
+    int klen = 0, vlen = 0;
+    struct timeval now;
+    uint64_t checked, busy;
+    uint32_t sid;
+    int i, pending;
+
+    pthread_mutex_lock(&lru_crawler_lock);
+    pending = crawler_count;
+    pthread_mutex_unlock(&lru_crawler_lock);
+    APPEND_STAT("crawler_threads", "%d", settings.lru_crawler_threads);
+    APPEND_STAT("crawler_lrus_pending", "%d", pending);
+
+    gettimeofday(&now, NULL);
+    pthread_mutex_lock(&lru_crawler_stats_lock);
+    for (i = 0; i < crawler_nthreads; i++) {
+        crawler_thread *t = &crawler_threads[i];
+        checked = t->items_checked + t->lru_checked;
+        busy = t->busy_us;
+        if (t->sid != 0)
+            busy += crawler_elapsed_us(&t->lru_start, &now);
+        APPEND_NUM_FMT_STAT(fmt, i, "lru", "%u", t->sid);
+        APPEND_NUM_FMT_STAT(fmt, i, "lru_checked",
+                            "%llu", (unsigned long long)t->lru_checked);
+        APPEND_NUM_FMT_STAT(fmt, i, "items_checked",
+                            "%llu", (unsigned long long)checked);
+        APPEND_NUM_FMT_STAT(fmt, i, "reclaimed",
+                            "%llu", (unsigned long long)t->reclaimed);
+        APPEND_NUM_FMT_STAT(fmt, i, "lrus_crawled",
+                            "%llu", (unsigned long long)t->lrus_crawled);
+        APPEND_NUM_FMT_STAT(fmt, i, "busy_us",
+                            "%llu", (unsigned long long)busy);
+        APPEND_NUM_FMT_STAT(fmt, i, "items_per_sec", "%llu",
+                            (unsigned long long)(busy ? checked * 1000000 / busy : 0));
+    }
+    pthread_mutex_unlock(&lru_crawler_stats_lock);
+
+    pthread_mutex_lock(&lru_crawler_lock);
+    for (sid = POWER_SMALLEST; sid < LARGEST_ID; sid++) {
+        if (crawler_yield[sid] != 0) {
+            APPEND_NUM_FMT_STAT("lru:%d:%s", sid, "last_yield",
+                                "%llu", (unsigned long long)crawler_yield[sid]);
+        }
+    }
+    pthread_mutex_unlock(&lru_crawler_lock);
+}
+
 
 //worker߳ڽյ"lru_crawler disable"ִ  
 int stop_item_crawler_thread(void) {
     int ret;
+    int i;
     pthread_mutex_lock(&lru_crawler_lock);
     do_run_lru_crawler_thread = 0;
     //LRU߳̿ڵȴҪѲֹͣLRU߳  
-    pthread_cond_signal(&lru_crawler_cond);
+    pthread_cond_broadcast(&lru_crawler_cond);
     pthread_mutex_unlock(&lru_crawler_lock);
-    if ((ret = pthread_join(item_crawler_tid, NULL)) != 0) {
-        fprintf(stderr, "Failed to stop LRU crawler thread: %s\n", strerror(ret));
-        return -1;
+    for (i = 0; i < crawler_nthreads; i++) {
+        if ((ret = pthread_join(crawler_threads[i].tid, NULL)) != 0) {
+            fprintf(stderr, "Failed to stop LRU crawler thread: %s\n", strerror(ret));
+            return -1;
+        }
     }
     settings.lru_crawler = false;
     return 0;
@@ -1511,28 +3119,52 @@ lru_crawler crawl <classid,classid,classid|all> ָ
 */ //οhttp://blog.csdn.net/luotuo44/article/details/42963793
 int start_item_crawler_thread(void) {//м-o lru_crawler߿ͻִlru_crawler enable߳
     int ret;
+    int i;
     //worker߳̽յ"lru_crawler enable"ñ  
     //memcachedʱ-o lru_crawlerҲǻñ  
 
     //stop_item_crawler_threadԿpthread_join  
     //pthread_joinغ󣬲Żsettings.lru_crawlerΪfalse  
     //Բͬʱcrawler߳  
+    /* Nothing for it to walk without LRU lists. */
+    if (settings.lru_engine != LRU_ENGINE_LIST)
+        return -1;
     if (settings.lru_crawler) //Ѿ´̣߳ٴ߳
         return -1;
     pthread_mutex_lock(&lru_crawler_lock);
+    /* The pool is sized once; enable/disable reuses it. */
+    if (crawler_threads == NULL) {
+        crawler_threads = calloc(settings.lru_crawler_threads, sizeof(crawler_thread));
+        if (crawler_threads == NULL) {
+            pthread_mutex_unlock(&lru_crawler_lock);
+            return -1;
+        }
+        for (i = 0; i < settings.lru_crawler_threads; i++)
+            pthread_mutex_init(&crawler_threads[i].lock, NULL);
+        crawler_nthreads = settings.lru_crawler_threads;
+    }
     do_run_lru_crawler_thread = 1;
     //һLRỤ̺߳߳Ϊitem_crawler_threadLRU߳ڽ  
     //item_crawler_thread󣬻pthread_cond_waitȴworkerָ߳  
     //ҪLRU  
-    if ((ret = pthread_create(&item_crawler_tid, NULL,
-        item_crawler_thread, NULL)) != 0) {
-        fprintf(stderr, "Can't create LRU crawler thread: %s\n",
-            strerror(ret));
-        pthread_mutex_unlock(&lru_crawler_lock);
-        return -1;
+    for (i = 0; i < crawler_nthreads; i++) {
+        if ((ret = pthread_create(&crawler_threads[i].tid, NULL,
+            item_crawler_thread, &crawler_threads[i])) != 0) {
+            fprintf(stderr, "Can't create LRU crawler thread: %s\n",
+                strerror(ret));
+            /* Wind down the ones that did start. */
+            do_run_lru_crawler_thread = 0;
+            pthread_cond_broadcast(&lru_crawler_cond);
+            pthread_mutex_unlock(&lru_crawler_lock);
+            while (--i >= 0)
+                pthread_join(crawler_threads[i].tid, NULL);
+            return -1;
+        }
     }
-    /* Avoid returning until the crawler has actually started */
-    pthread_cond_wait(&lru_crawler_cond, &lru_crawler_lock);
+    /* Avoid returning until the crawlers have actually started */
+    while (crawler_threads_up < crawler_nthreads)
+        pthread_cond_wait(&lru_crawler_cond, &lru_crawler_lock);
+    settings.lru_crawler = true;
     pthread_mutex_unlock(&lru_crawler_lock);
 
     return 0;
@@ -1553,7 +3185,9 @@ static int do_lru_crawler_start(uint32_t id, uint32_t remaining) {
     for (i = 0; i < 3; i++) {
         sid = tocrawl[i];
         pthread_mutex_lock(&lru_locks[sid]);
-        if (tails[sid] != NULL) {
+        /* Crawler threads don't hold lru_crawler_lock while they walk, so
+         * one may still be on its way up this LRU. */
+        if (tails[sid] != NULL && crawlers[sid].it_flags != 1) {
             if (settings.verbose > 2)
                 fprintf(stderr, "Kicking LRU crawler off for LRU %d\n", sid);
             crawlers[sid].nbytes = 0;
@@ -1590,12 +3224,36 @@ static int lru_crawler_start(uint32_t id, uint32_t remaining) {
     }
     starts = do_lru_crawler_start(id, remaining);
     if (starts) {
-        pthread_cond_signal(&lru_crawler_cond);
+        pthread_cond_broadcast(&lru_crawler_cond);
     }
     pthread_mutex_unlock(&lru_crawler_lock);
     return starts;
 }
 
+/* Parses "all" or a comma separated list of class ids into a flag per class. */
+static bool lru_crawler_classes(char *slabs, uint8_t *tocrawl) {
+    char *b = NULL;
+    uint32_t sid = 0;
+
+    memset(tocrawl, 0, sizeof(uint8_t) * MAX_NUMBER_OF_SLAB_CLASSES);
+    if (strcmp(slabs, "all") == 0) {
+        for (sid = 0; sid < MAX_NUMBER_OF_SLAB_CLASSES; sid++) {
+            tocrawl[sid] = 1;
+        }
+        return true;
+    }
+    for (char *p = strtok_r(slabs, ",", &b);
+         p != NULL;
+         p = strtok_r(NULL, ",", &b)) {
+        if (!safe_strtoul(p, &sid) || sid < POWER_SMALLEST
+                || sid >= MAX_NUMBER_OF_SLAB_CLASSES-1) {
+            return false;
+        }
+        tocrawl[sid] = 1;
+    }
+    return true;
+}
+
 /* FIXME: Split this into two functions: one to kick a crawler for a sid, and one to
  * parse the string. LRU maintainer code is generating a string to set up a
  * sid.
@@ -1610,7 +3268,6 @@ crawl<classid,classid,classid|all>
  //ͻʹlru_crawler crawl <classid,classid,classid|all>ʱ  
 //worker߳̾ͻñ,ĵڶΪĲ  
 enum crawler_result_type lru_crawler_crawl(char *slabs) {
-    char *b = NULL;
     uint32_t sid = 0;
     int starts = 0;
     uint8_t tocrawl[MAX_NUMBER_OF_SLAB_CLASSES];
@@ -1624,23 +3281,9 @@ enum crawler_result_type lru_crawler_crawl(char *slabs) {
     /* FIXME: I added this while debugging. Don't think it's needed? */
 	//ҪĳһLRUнôtocrawl  
     //ӦԪظֵ1Ϊ־  
-    memset(tocrawl, 0, sizeof(uint8_t) * MAX_NUMBER_OF_SLAB_CLASSES);
-    if (strcmp(slabs, "all") == 0) { //ȫlru  
-        for (sid = 0; sid < MAX_NUMBER_OF_SLAB_CLASSES; sid++) {
-            tocrawl[sid] = 1;
-        }
-    } else {
-        for (char *p = strtok_r(slabs, ",", &b);//һsid  
-             p != NULL;
-             p = strtok_r(NULL, ",", &b)) {
-
-            if (!safe_strtoul(p, &sid) || sid < POWER_SMALLEST
-                    || sid >= MAX_NUMBER_OF_SLAB_CLASSES-1) {
-                pthread_mutex_unlock(&lru_crawler_lock);
-                return CRAWLER_BADCLASS;
-            }
-            tocrawl[sid] = 1;
-        }
+    if (!lru_crawler_classes(slabs, tocrawl)) {
+        pthread_mutex_unlock(&lru_crawler_lock);
+        return CRAWLER_BADCLASS;
     }
 
     //crawlersһαitem顣ûҪĳһLRUУô  
@@ -1651,21 +3294,53 @@ enum crawler_result_type lru_crawler_crawl(char *slabs) {
     }
     if (starts) {
     //lru_crawler crawl<classid,classid,classid|all>ָġָҪĸLRUн
-    pthread_cond_signal(&lru_crawler_cond); //ˣLRỤִ߳  
+    pthread_cond_broadcast(&lru_crawler_cond); //ˣLRỤִ߳  
         pthread_mutex_unlock(&lru_crawler_lock);
         return CRAWLER_OK;
     } else {
+        /* Nothing new: it's already being crawled, or it's empty. */
+        starts = crawler_count;
         pthread_mutex_unlock(&lru_crawler_lock);
-        return CRAWLER_NOTSTARTED;
+        return starts ? CRAWLER_RUNNING : CRAWLER_NOTSTARTED;
     }
 }
 
-/* If we hold this lock, crawler can't wake up or move */
+/* "lru_crawler metadump <classid,classid,classid|all>". On CRAWLER_OK the
+ * caller stops serving the connection; the crawler thread writes the dump
+ * and then hands it back with redispatch_conn(). */
+enum crawler_result_type lru_crawler_metadump(char *slabs, conn *c) {
+    uint8_t classes[MAX_NUMBER_OF_SLAB_CLASSES];
+
+    if (pthread_mutex_trylock(&lru_crawler_lock) != 0) {
+        return CRAWLER_RUNNING;
+    }
+    if (dump.c != NULL) {
+        pthread_mutex_unlock(&lru_crawler_lock);
+        return CRAWLER_RUNNING;
+    }
+    if (!lru_crawler_classes(slabs, classes)) {
+        pthread_mutex_unlock(&lru_crawler_lock);
+        return CRAWLER_BADCLASS;
+    }
+    memcpy(dump.classes, classes, sizeof(classes));
+    dump.c = c;
+    pthread_cond_broadcast(&lru_crawler_cond);
+    pthread_mutex_unlock(&lru_crawler_lock);
+    return CRAWLER_OK;
+}
+
+/* If we hold these locks, crawlers can't pick up an LRU or move */
 void lru_crawler_pause(void) {
+    int i;
     pthread_mutex_lock(&lru_crawler_lock);
+    for (i = 0; i < crawler_nthreads; i++)
+        pthread_mutex_lock(&crawler_threads[i].lock);
 }
 
 void lru_crawler_resume(void) {
+    int i;
+    for (i = crawler_nthreads - 1; i >= 0; i--)
+        pthread_mutex_unlock(&crawler_threads[i].lock);
     pthread_mutex_unlock(&lru_crawler_lock);
 }
 
@@ -6,6 +6,13 @@ item *do_item_alloc(char *key, const size_t nkey, const int flags, const rel_tim
 void item_free(item *it);
 bool item_size_ok(const size_t nkey, const int flags, const int nbytes);
 
+/* Value access that also works for chunked (-o large_item_max) items */
+char *item_value_at(const item *it, size_t off, size_t *avail);
+void item_value_read(const item *it, size_t off, char *buf, size_t len);
+void item_value_write(item *it, size_t off, const char *buf, size_t len);
+void item_value_copy(item *dst, size_t doff, const item *src, size_t soff,
+                     size_t len);
+
 int  do_item_link(item *it, const uint32_t hv);     /** may fail if transgresses limits */
 void do_item_unlink(item *it, const uint32_t hv);
 void do_item_unlink_nolock(item *it, const uint32_t hv);
@@ -28,11 +35,23 @@ item *do_item_touch(const char *key, const size_t nkey, uint32_t exptime, const
 void item_stats_reset(void);
 extern pthread_mutex_t lru_locks[POWER_LARGEST];
 
+/* -o lru_admission */
+int lru_admission_init(const size_t maxbytes);
+void lru_admission_record(const uint32_t hv);
+
+/* -o expiry_wheel */
+void expiry_wheel_add(item *it, const uint32_t hv);
+void expiry_wheel_del(item *it, const uint32_t hv);
+
+/* -o lru_bump_buffers, one per worker thread */
+typedef struct lru_bump_buf lru_bump_buf;
+lru_bump_buf *lru_bump_buf_create(void);
+
 enum crawler_result_type {
     CRAWLER_OK=0, CRAWLER_RUNNING, CRAWLER_BADCLASS, CRAWLER_NOTSTARTED
 };
 
-int start_lru_maintainer_thread(void);
+int start_lru_maintainer_thread(const bool segmented);
 int stop_lru_maintainer_thread(void);
 int init_lru_maintainer(void);
 void lru_maintainer_pause(void);
@@ -42,5 +61,7 @@ int start_item_crawler_thread(void);
 int stop_item_crawler_thread(void);
 int init_lru_crawler(void);
 enum crawler_result_type lru_crawler_crawl(char *slabs);
+enum crawler_result_type lru_crawler_metadump(char *slabs, conn *c);
+void lru_crawler_stats(ADD_STAT add_stats, void *c);
 void lru_crawler_pause(void);
 void lru_crawler_resume(void);
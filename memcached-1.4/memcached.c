@@ -94,6 +94,7 @@ static void process_command(conn *c, char *command);
 static void write_and_free(conn *c, char *buf, int bytes);
 static int ensure_iov_space(conn *c);
 static int add_iov(conn *c, const void *buf, int len);
+static int add_iov_value(conn *c, item *it, int len);
 static int add_msghdr(conn *c);
 static void write_bin_error(conn *c, protocol_binary_response_status err,
                             const char *errstr, int swallow);
@@ -182,9 +183,13 @@ static void stats_init(void) {
     stats.malloc_fails = 0;
     stats.curr_bytes = stats.listen_disabled_num = 0;
     stats.hash_power_level = stats.hash_bytes = stats.hash_is_expanding = 0;
+    stats.hash_expand_buckets = 0;
+    stats.hash_expansions = 0;
+    stats.hash_shrinks = 0;
     stats.expired_unfetched = stats.evicted_unfetched = 0;
     stats.slabs_moved = 0;
     stats.lru_maintainer_juggles = 0;
+    stats.lru_maintainer_sleep = 0;
     stats.accepting_conns = true; /* assuming we start in this state. */
     stats.slab_reassign_running = false;
     stats.lru_crawler_running = false;
@@ -289,6 +294,7 @@ static void settings_init(void) {
 
 	//LRUÿLRUеĶٸitemLRU湤޸ֵ
     settings.lru_crawler_tocrawl = 0;
+    settings.lru_crawler_threads = 1;
     settings.lru_maintainer_thread = false;
     settings.hot_lru_pct = 32;
     settings.warm_lru_pct = 32;
@@ -296,6 +302,24 @@ static void settings_init(void) {
 		//ϣĳ2^nֵnĳʼֵmemcachedʱͨ-o hashpower_init
 	//õֵҪ[12,64]֮䡣ãֵΪ0.ϣݽȡĬֵ16
     settings.hashpower_init = 0;
+    settings.hash_shrink_load = 0;
+    settings.hash_tag_match = "auto";
+    settings.item_hash = false;
+    settings.seqlock_gets = false;
+    settings.lru_bump_buffers = false;
+    settings.lru_engine = LRU_ENGINE_LIST;
+    settings.lru_samples = 5;
+    settings.lru_admission = false;
+    settings.lru_ghosts = false;
+    settings.lru_reserve = 0;
+    settings.lru_cost = 0;
+    settings.slab_profile = NULL;
+    settings.slab_hugepages = SLAB_HUGEPAGES_OFF;
+    settings.numa = false;
+    settings.slab_magazines = 0;
+    settings.large_item_max = 0;
+    settings.expiry_wheel = false;
+    settings.item_lock_grow_waits = 0;
 //Ƿڲͬitemռõڴͨ-o slab_reassignѡ
     settings.slab_reassign = false;
 
@@ -529,6 +553,7 @@ conn *conn_new(const int sfd, enum conn_states init_state,
 	//ʼһЩԱ
     c->state = init_state;
     c->rlbytes = 0;
+    c->rloff = c->rlend = 0;
     c->cmd = -1;
     c->rbytes = c->wbytes = 0;
     c->wcurr = c->wbuf;
@@ -743,7 +768,8 @@ static const char *state_text(enum conn_states state) {
                                        "conn_swallow",
                                        "conn_closing",
                                        "conn_mwrite",
-                                       "conn_closed" };
+                                       "conn_closed",
+                                       "conn_watch" };
     return statenames[state];
 }
 
@@ -866,6 +892,46 @@ static int add_iov(conn *c, const void *buf, int len) {
     return 0;
 }
 
+/*
+ * Adds the first len bytes of an item's value to the response, with an iovec
+ * per piece of a chunked value so it never has to be copied together.
+ */
+static int add_iov_value(conn *c, item *it, int len) {
+    int off = 0;
+
+    if (!(it->it_flags & ITEM_CHUNKED))
+        return add_iov(c, ITEM_data(it), len);
+    while (off < len) {
+        size_t avail;
+        char *p = item_value_at(it, off, &avail);
+        if (avail > (size_t)(len - off))
+            avail = len - off;
+        if (add_iov(c, p, avail) != 0)
+            return -1;
+        off += avail;
+    }
+    return 0;
+}
+
+/* Points ritem and rlbytes at the next piece of c->item's value to read. */
+static void conn_next_ritem(conn *c) {
+    size_t avail;
+
+    c->ritem = item_value_at(c->item, c->rloff, &avail);
+    c->rlbytes = c->rlend - c->rloff;
+    if ((size_t)c->rlbytes > avail)
+        c->rlbytes = avail;
+    c->rloff += c->rlbytes;
+}
+
+/* Reads the first len bytes of c->item's value next, piece by piece if it's
+ * chunked. */
+static void conn_set_ritem(conn *c, const int len) {
+    c->rloff = 0;
+    c->rlend = len;
+    conn_next_ritem(c);
+}
+
 
 /*
  * Constructs a set of UDP headers and attaches them to the outgoing messages.
@@ -981,12 +1047,14 @@ static void complete_nread_ascii(conn *c) {
     item *it = c->item;
     int comm = c->cmd;
     enum store_item_type ret;
+    char crlf[2];
 
     pthread_mutex_lock(&c->thread->stats.mutex);
     c->thread->stats.slab_stats[ITEM_clsid(it)].set_cmds++;
     pthread_mutex_unlock(&c->thread->stats.mutex);
 
-    if (strncmp(ITEM_data(it) + it->nbytes - 2, "\r\n", 2) != 0) { //valueӦdataЯ\r\n2ַ
+    item_value_read(it, it->nbytes - 2, crlf, 2);
+    if (strncmp(crlf, "\r\n", 2) != 0) { //valueӦdataЯ\r\n2ַ
         out_string(c, "CLIENT_ERROR bad data chunk");
     } else {
       ret = store_item(it, comm, c);
@@ -1298,8 +1366,7 @@ static void complete_update_bin(conn *c) {
 
     /* We don't actually receive the trailing two characters in the bin
      * protocol, so we're going to just set them here */
-    *(ITEM_data(it) + it->nbytes - 2) = '\r';
-    *(ITEM_data(it) + it->nbytes - 1) = '\n';
+    item_value_write(it, it->nbytes - 2, "\r\n", 2);
 
     ret = store_item(it, c->cmd, c);
 
@@ -1427,7 +1494,7 @@ static void process_bin_get_or_touch(conn *c) {
 
         if (should_return_value) {
             /* Add the data minus the CRLF */
-            add_iov(c, ITEM_data(it), it->nbytes - 2);
+            add_iov_value(c, it, it->nbytes - 2);
         }
 
         conn_set_state(c, conn_mwrite);
@@ -1604,6 +1671,10 @@ static void process_bin_stat(conn *c) {
         stats_reset();
     } else if (strncmp(subcommand, "settings", 8) == 0) {
         process_stat_settings(&append_stats, c);
+    } else if (strncmp(subcommand, "locks", 5) == 0) {
+        item_lock_stats_append(&append_stats, c);
+    } else if (strncmp(subcommand, "crawlers", 8) == 0) {
+        lru_crawler_stats(&append_stats, c);
     } else if (strncmp(subcommand, "detail", 6) == 0) {
         char *subcmd_pos = subcommand + 6;
         if (strncmp(subcmd_pos, " dump", 5) == 0) {
@@ -1995,8 +2066,10 @@ static void dispatch_bin_command(conn *c) {
         case PROTOCOL_BINARY_CMD_SET: /* FALLTHROUGH */
         case PROTOCOL_BINARY_CMD_ADD: /* FALLTHROUGH */
         case PROTOCOL_BINARY_CMD_REPLACE:
-            if (extlen == 8 && keylen != 0 && bodylen >= (keylen + 8)) {
-                bin_read_key(c, bin_reading_set_header, 8);
+            /* 4 more bytes of extras carry the item's cost hint. */
+            if ((extlen == 8 || extlen == 12) && keylen != 0
+                && bodylen >= (keylen + extlen)) {
+                bin_read_key(c, bin_reading_set_header, extlen);
             } else {
                 protocol_error = 1;
             }
@@ -2091,6 +2164,7 @@ static void process_bin_update(conn *c) {
     char *key;
     int nkey;
     int vlen;
+    uint32_t cost = 0;
     item *it;
     protocol_binary_request_set* req = binary_get_request(c);
 
@@ -2102,6 +2176,12 @@ static void process_bin_update(conn *c) {
     /* fix byteorder in the request */
     req->message.body.flags = ntohl(req->message.body.flags);
     req->message.body.expiration = ntohl(req->message.body.expiration);
+    if (c->binary_header.request.extlen == 12) {
+        memcpy(&cost, req->bytes + sizeof(req->bytes), sizeof(cost));
+        cost = ntohl(cost);
+        if (cost > ITEM_COST_MAX)
+            cost = ITEM_COST_MAX;
+    }
 
     vlen = c->binary_header.request.bodylen - (nkey + c->binary_header.request.extlen);
 
@@ -2152,6 +2232,7 @@ static void process_bin_update(conn *c) {
     }
 
     ITEM_set_cas(it, c->binary_header.request.cas);
+    it->cost = cost;
 
     switch (c->cmd) {
         case PROTOCOL_BINARY_CMD_ADD:
@@ -2172,8 +2253,7 @@ static void process_bin_update(conn *c) {
     }
 
     c->item = it;
-    c->ritem = ITEM_data(it);
-    c->rlbytes = vlen;
+    conn_set_ritem(c, vlen);
     conn_set_state(c, conn_nread);
     c->substate = bin_read_set_value;
 }
@@ -2225,8 +2305,7 @@ static void process_bin_append_prepend(conn *c) {
     }
 
     c->item = it;
-    c->ritem = ITEM_data(it);
-    c->rlbytes = vlen;
+    conn_set_ritem(c, vlen);
     conn_set_state(c, conn_nread);
     c->substate = bin_read_set_value;
 }
@@ -2466,16 +2545,17 @@ enum store_item_type do_store_item(item *it, int comm, conn *c, const uint32_t h
 
                     return NOT_STORED;
                 }
+                new_it->cost = old_it->cost;
 
                 /* copy data from it and old_it to new_it */
 
                 if (comm == NREAD_APPEND) {
-                    memcpy(ITEM_data(new_it), ITEM_data(old_it), old_it->nbytes);
-                    memcpy(ITEM_data(new_it) + old_it->nbytes - 2 /* CRLF */, ITEM_data(it), it->nbytes);
+                    item_value_copy(new_it, 0, old_it, 0, old_it->nbytes);
+                    item_value_copy(new_it, old_it->nbytes - 2 /* CRLF */, it, 0, it->nbytes);
                 } else {
                     /* NREAD_PREPEND */
-                    memcpy(ITEM_data(new_it), ITEM_data(it), it->nbytes);
-                    memcpy(ITEM_data(new_it) + it->nbytes - 2 /* CRLF */, ITEM_data(old_it), old_it->nbytes);
+                    item_value_copy(new_it, 0, it, 0, it->nbytes);
+                    item_value_copy(new_it, it->nbytes - 2 /* CRLF */, old_it, 0, old_it->nbytes);
                 }
 
                 it = new_it;
@@ -2727,9 +2807,19 @@ static void server_stats(ADD_STAT add_stats, conn *c) {
     APPEND_STAT("time_in_listen_disabled_us", "%llu", stats.time_in_listen_disabled_us);
     APPEND_STAT("threads", "%d", settings.num_threads);
     APPEND_STAT("conn_yields", "%llu", (unsigned long long)thread_stats.conn_yields);
+    if (settings.seqlock_gets) {
+        APPEND_STAT("seqlock_retries", "%llu", (unsigned long long)thread_stats.seqlock_retries);
+    }
+    if (settings.numa) {
+        APPEND_STAT("numa_local_hits", "%llu", (unsigned long long)thread_stats.numa_local_hits);
+        APPEND_STAT("numa_remote_hits", "%llu", (unsigned long long)thread_stats.numa_remote_hits);
+    }
     APPEND_STAT("hash_power_level", "%u", stats.hash_power_level);
     APPEND_STAT("hash_bytes", "%llu", (unsigned long long)stats.hash_bytes);
     APPEND_STAT("hash_is_expanding", "%u", stats.hash_is_expanding);
+    APPEND_STAT("hash_expand_buckets", "%u", stats.hash_expand_buckets);
+    APPEND_STAT("hash_expansions", "%llu", (unsigned long long)stats.hash_expansions);
+    APPEND_STAT("hash_shrinks", "%llu", (unsigned long long)stats.hash_shrinks);
     if (settings.slab_reassign) {
         APPEND_STAT("slab_reassign_rescues", "%llu", stats.slab_reassign_rescues);
         APPEND_STAT("slab_reassign_evictions_nomem", "%llu", stats.slab_reassign_evictions_nomem);
@@ -2744,6 +2834,7 @@ static void server_stats(ADD_STAT add_stats, conn *c) {
     }
     if (settings.lru_maintainer_thread) {
         APPEND_STAT("lru_maintainer_juggles", "%llu", (unsigned long long)stats.lru_maintainer_juggles);
+        APPEND_STAT("lru_maintainer_sleep", "%u", stats.lru_maintainer_sleep);
     }
     APPEND_STAT("malloc_fails", "%llu",
                 (unsigned long long)stats.malloc_fails);
@@ -2819,9 +2910,35 @@ static void process_stat_settings(ADD_STAT add_stats, void *c) {
     APPEND_STAT("lru_crawler", "%s", settings.lru_crawler ? "yes" : "no");
     APPEND_STAT("lru_crawler_sleep", "%d", settings.lru_crawler_sleep);
     APPEND_STAT("lru_crawler_tocrawl", "%lu", (unsigned long)settings.lru_crawler_tocrawl);
+    APPEND_STAT("lru_crawler_threads", "%d", settings.lru_crawler_threads);
     APPEND_STAT("tail_repair_time", "%d", settings.tail_repair_time);
     APPEND_STAT("flush_enabled", "%s", settings.flush_enabled ? "yes" : "no");
     APPEND_STAT("hash_algorithm", "%s", settings.hash_algorithm);
+    APPEND_STAT("hash_engine", "%s", settings.hash_engine);
+    APPEND_STAT("hash_tag_match", "%s", settings.hash_tag_match);
+    APPEND_STAT("hash_shrink_load", "%.2f", settings.hash_shrink_load);
+    APPEND_STAT("item_hash", "%s", settings.item_hash ? "yes" : "no");
+    APPEND_STAT("seqlock_gets", "%s", settings.seqlock_gets ? "yes" : "no");
+    APPEND_STAT("lru_bump_buffers", "%s", settings.lru_bump_buffers ? "yes" : "no");
+    APPEND_STAT("lru_engine", "%s",
+                settings.lru_engine == LRU_ENGINE_CLOCK ? "clock" :
+                settings.lru_engine == LRU_ENGINE_SAMPLED ? "sampled" : "list");
+    APPEND_STAT("lru_samples", "%d", settings.lru_samples);
+    APPEND_STAT("lru_admission", "%s", settings.lru_admission ? "yes" : "no");
+    APPEND_STAT("lru_ghosts", "%s", settings.lru_ghosts ? "yes" : "no");
+    APPEND_STAT("lru_reserve", "%d", settings.lru_reserve);
+    APPEND_STAT("lru_cost", "%d", settings.lru_cost);
+    APPEND_STAT("slab_profile", "%s",
+                settings.slab_profile ? settings.slab_profile : "NULL");
+    APPEND_STAT("slab_hugepages", "%s",
+                settings.slab_hugepages == SLAB_HUGEPAGES_THP ? "thp" :
+                settings.slab_hugepages == SLAB_HUGEPAGES_2M ? "2m" :
+                settings.slab_hugepages == SLAB_HUGEPAGES_1G ? "1g" : "no");
+    APPEND_STAT("numa", "%s", settings.numa ? "yes" : "no");
+    APPEND_STAT("slab_magazines", "%d", settings.slab_magazines);
+    APPEND_STAT("large_item_max", "%d", settings.large_item_max);
+    APPEND_STAT("expiry_wheel", "%s", settings.expiry_wheel ? "yes" : "no");
+    APPEND_STAT("item_lock_grow_waits", "%d", settings.item_lock_grow_waits);
     APPEND_STAT("lru_maintainer_thread", "%s", settings.lru_maintainer_thread ? "yes" : "no");
     APPEND_STAT("hot_lru_pct", "%d", settings.hot_lru_pct);
     APPEND_STAT("warm_lru_pct", "%d", settings.warm_lru_pct);
@@ -2991,6 +3108,10 @@ static void process_stat(conn *c, token_t *tokens, const size_t ntokens) {
         return ;
     } else if (strcmp(subcommand, "settings") == 0) {
         process_stat_settings(&append_stats, c);
+    } else if (strcmp(subcommand, "locks") == 0) {
+        item_lock_stats_append(&append_stats, c);
+    } else if (strcmp(subcommand, "crawlers") == 0) {
+        lru_crawler_stats(&append_stats, c);
     } else if (strcmp(subcommand, "cachedump") == 0) {
         char *buf;
         unsigned int bytes, id, limit = 0;
@@ -3048,6 +3169,15 @@ static void process_stat(conn *c, token_t *tokens, const size_t ntokens) {
     }
 }
 
+/* Drops the references item_get_batch() took on batch[ibatch..nbatch),
+ * which are NULL for misses. */
+static void get_batch_release(item **batch, int ibatch, const int nbatch) {
+    for (; ibatch < nbatch; ibatch++) {
+        if (batch[ibatch] != NULL)
+            item_remove(batch[ibatch]);
+    }
+}
+
 /* ntokens is overwritten here... shrug.. */
 static inline void process_get_command(conn *c, token_t *tokens, size_t ntokens, bool return_cas) {
     char *key;
@@ -3056,9 +3186,23 @@ static inline void process_get_command(conn *c, token_t *tokens, size_t ntokens,
     item *it;
     token_t *key_token = &tokens[KEY_TOKEN];
     char *suffix;
+    const char *keys[MAX_TOKENS];
+    size_t nkeys[MAX_TOKENS];
+    item *batch[MAX_TOKENS];
+    int nbatch, ibatch;
     assert(c != NULL);
 
     do {
+        /* Look up every key of this window together, see item_get_batch().
+         * An overlong key ends the batch and is dealt with below. */
+        for (nbatch = 0; key_token[nbatch].length != 0 &&
+             key_token[nbatch].length <= KEY_MAX_LENGTH; nbatch++) {
+            keys[nbatch] = key_token[nbatch].value;
+            nkeys[nbatch] = key_token[nbatch].length;
+        }
+        item_get_batch(keys, nkeys, batch, nbatch);
+        ibatch = 0;
+
 		//Ϊһgetͬʱȡ¼
 		//get key1 key2 key3
         while(key_token->length != 0) {
@@ -3074,7 +3218,7 @@ static inline void process_get_command(conn *c, token_t *tokens, size_t ntokens,
                 return;
             }
 
-            it = item_get(key, nkey);
+            it = batch[ibatch++];
             if (settings.detail_enabled) {
                 stats_prefix_record_get(key, nkey, NULL != it);
             }
@@ -3131,6 +3275,7 @@ static inline void process_get_command(conn *c, token_t *tokens, size_t ntokens,
                       while (i-- > 0) {
                           item_remove(*(c->ilist + i));
                       }
+                      get_batch_release(batch, ibatch, nbatch);
                       return;
                   }
                   *(c->suffixlist + i) = suffix;
@@ -3142,7 +3287,7 @@ static inline void process_get_command(conn *c, token_t *tokens, size_t ntokens,
                       add_iov(c, ITEM_key(it), it->nkey) != 0 ||
                       add_iov(c, ITEM_suffix(it), it->nsuffix - 2) != 0 ||
                       add_iov(c, suffix, suffix_len) != 0 ||
-                      add_iov(c, ITEM_data(it), it->nbytes) != 0)
+                      add_iov_value(c, it, it->nbytes) != 0)
                       {
                       	  //üһ
                           item_remove(it);
@@ -3155,7 +3300,10 @@ static inline void process_get_command(conn *c, token_t *tokens, size_t ntokens,
                                         it->nbytes, ITEM_get_cas(it));
                   if (add_iov(c, "VALUE ", 6) != 0 ||
                       add_iov(c, ITEM_key(it), it->nkey) != 0 ||
-                      add_iov(c, ITEM_suffix(it), it->nsuffix + it->nbytes) != 0)
+                      ((it->it_flags & ITEM_CHUNKED)
+                       ? add_iov(c, ITEM_suffix(it), it->nsuffix) != 0 ||
+                         add_iov_value(c, it, it->nbytes) != 0
+                       : add_iov(c, ITEM_suffix(it), it->nsuffix + it->nbytes) != 0))
                       {
                           item_remove(it);
                           break;
@@ -3196,6 +3344,9 @@ static inline void process_get_command(conn *c, token_t *tokens, size_t ntokens,
             key_token++;
         }
 
+        /* Release whatever the batch had left when the loop broke off. */
+        get_batch_release(batch, ibatch, nbatch);
+
         /*
          * If the command string hasn't been fully processed, get the next set
          * of tokens.
@@ -3245,6 +3396,8 @@ static void process_update_command(conn *c, token_t *tokens, const size_t ntoken
     time_t exptime;//itemĳʱ
     int vlen;
     uint64_t req_cas_id=0;
+    uint32_t cost = 0;
+    size_t cost_token;
     item *it;
 
     assert(c != NULL);
@@ -3293,6 +3446,21 @@ static void process_update_command(conn *c, token_t *tokens, const size_t ntoken
             return;
         }
     }
+
+    /* An optional "cost=<n>" may follow, before any noreply. */
+    cost_token = handle_cas ? 6 : 5;
+    if (ntokens > cost_token + 1
+        && strncmp(tokens[cost_token].value, "cost=", 5) == 0) {
+        if (!safe_strtoul(tokens[cost_token].value + 5, &cost)) {
+            out_string(c, "CLIENT_ERROR bad command line format");
+            return;
+        }
+        if (cost > ITEM_COST_MAX)
+            cost = ITEM_COST_MAX;
+    } else if (ntokens > cost_token + 2) {
+        out_string(c, "CLIENT_ERROR bad command line format");
+        return;
+    }
 	//ڴ洢itemݵʱ򣬶Զݵ"\r\n"
     vlen += 2; //+2Ϊdata滹Ҫ"\r\n"ַ
     if (vlen < 0 || vlen - 2 < 0) {
@@ -3332,12 +3500,12 @@ static void process_update_command(conn *c, token_t *tokens, const size_t ntoken
         return;
     }
     ITEM_set_cas(it, req_cas_id); //cas
+    it->cost = cost;
 
 	//item뵽ϣLRUУ빤
 	//complete_nread_ascii  ӿͻ˶ȡݲֺcomplete_nreadаitemӵhashLRU
     c->item = it;
-    c->ritem = ITEM_data(it);//ֱͨ
-    c->rlbytes = it->nbytes; //vlen(Ҫûĳȴ2ΪҪ\r\n)
+    conn_set_ritem(c, it->nbytes); //vlen(Ҫûĳȴ2ΪҪ\r\n)
     c->cmd = comm;
     conn_set_state(c, conn_nread); //ȥreadݲ+\r\n
 }
@@ -3464,6 +3632,12 @@ enum delta_result_type do_add_delta(conn *c, const char *key, const size_t nkey,
         return NON_NUMERIC;
     }
 
+    /* A chunked value is far too long to be a number. */
+    if (it->it_flags & ITEM_CHUNKED) {
+        do_item_remove(it);
+        return NON_NUMERIC;
+    }
+
     if (cas != NULL && *cas != 0 && ITEM_get_cas(it) != *cas) {
         do_item_remove(it);
         return DELTA_ITEM_CAS_MISMATCH;
@@ -3516,6 +3690,7 @@ enum delta_result_type do_add_delta(conn *c, const char *key, const size_t nkey,
             do_item_remove(it);
             return EOM;
         }
+        new_it->cost = it->cost;
         memcpy(ITEM_data(new_it), buf, res);
         memcpy(ITEM_data(new_it) + res, "\r\n", 2);
         item_replace(it, new_it, hv);
@@ -3674,7 +3849,7 @@ static void process_command(conn *c, char *command) {
 
         process_get_command(c, tokens, ntokens, false);
 
-    } else if ((ntokens == 6 || ntokens == 7) &&
+    } else if ((ntokens >= 6 && ntokens <= 8) &&
                ((strcmp(tokens[COMMAND_TOKEN].value, "add") == 0 && (comm = NREAD_ADD)) ||
                 (strcmp(tokens[COMMAND_TOKEN].value, "set") == 0 && (comm = NREAD_SET)) ||
                 (strcmp(tokens[COMMAND_TOKEN].value, "replace") == 0 && (comm = NREAD_REPLACE)) ||
@@ -3683,7 +3858,7 @@ static void process_command(conn *c, char *command) {
 
         process_update_command(c, tokens, ntokens, comm, false);
 
-    } else if ((ntokens == 7 || ntokens == 8) && (strcmp(tokens[COMMAND_TOKEN].value, "cas") == 0 && (comm = NREAD_CAS))) {
+    } else if ((ntokens >= 7 && ntokens <= 9) && (strcmp(tokens[COMMAND_TOKEN].value, "cas") == 0 && (comm = NREAD_CAS))) {
 
         process_update_command(c, tokens, ntokens, comm, true);
 
@@ -3832,6 +4007,17 @@ static void process_command(conn *c, char *command) {
         } else if (ntokens == 4 &&
             (strcmp(tokens[COMMAND_TOKEN + 1].value, "automove") == 0)) {
             process_slabs_automove_command(c, tokens, ntokens);
+        } else if (ntokens == 4 &&
+            strcmp(tokens[COMMAND_TOKEN + 1].value, "profile") == 0 &&
+            strcmp(tokens[2].value, "save") == 0) {
+            if (settings.slab_profile == NULL) {
+                out_string(c, "CLIENT_ERROR slab profiling disabled");
+                return;
+            }
+            if (slabs_profile_save(settings.slab_profile) == 0)
+                out_string(c, "OK");
+            else
+                out_string(c, "SERVER_ERROR failed to save slab profile");
         } else {
             out_string(c, "ERROR");
         }
@@ -3860,6 +4046,34 @@ static void process_command(conn *c, char *command) {
                 break;
             }
             return;
+        } else if (ntokens == 4 && strcmp(tokens[COMMAND_TOKEN + 1].value, "metadump") == 0) {
+            if (settings.lru_crawler == false) {
+                out_string(c, "CLIENT_ERROR lru crawler disabled");
+                return;
+            }
+            if (IS_UDP(c->transport)) {
+                out_string(c, "CLIENT_ERROR metadump not available over UDP");
+                return;
+            }
+
+            switch(lru_crawler_metadump(tokens[2].value, c)) {
+            case CRAWLER_OK:
+                /* A crawler thread writes the dump and hands us back the
+                 * connection when it's done. */
+                conn_set_state(c, conn_watch);
+                event_del(&c->event);
+                break;
+            case CRAWLER_RUNNING:
+                out_string(c, "BUSY currently processing crawler request");
+                break;
+            case CRAWLER_BADCLASS:
+                out_string(c, "BADCLASS invalid class id");
+                break;
+            case CRAWLER_NOTSTARTED:
+                out_string(c, "NOTSTARTED no items to crawl");
+                break;
+            }
+            return;
         } else if (ntokens == 4 && strcmp(tokens[COMMAND_TOKEN + 1].value, "tocrawl") == 0) {
             //ǰ˵lru_crawler tocrawl numָÿLRUֻnum-1item㣬Ǽɾnum-1
             uint32_t tocrawl;
@@ -4470,6 +4684,11 @@ static void drive_machine(conn *c) {
 
         case conn_nread:
             if (c->rlbytes == 0) { //ݲֿitemϣʼhashlruӴ
+                if (c->rloff < c->rlend) {
+                    /* on to the next piece of a chunked value */
+                    conn_next_ritem(c);
+                    break;
+                }
                 complete_nread(c);
                 break;
             }
@@ -4659,6 +4878,11 @@ static void drive_machine(conn *c) {
             abort();
             break;
 
+        case conn_watch:
+            /* Another thread owns the socket until redispatch_conn(). */
+            stop = true;
+            break;
+
         case conn_max_state:
             assert(false);
             break;
@@ -4690,6 +4914,22 @@ void event_handler(const int fd, const short which, void *arg) {
     return;
 }
 
+/* Takes back a connection another thread was writing to (see
+ * redispatch_conn()). Runs in the connection's worker thread. Anything the
+ * client pipelined after the command that lent it out is still in rbuf. */
+void conn_worker_readd(conn *c, enum conn_states state) {
+    c->ev_flags = EV_READ | EV_PERSIST;
+    event_set(&c->event, c->sfd, c->ev_flags, event_handler, (void *)c);
+    event_base_set(c->thread->base, &c->event);
+    c->state = state;
+
+    if (event_add(&c->event, 0) == -1) {
+        perror("event_add");
+        conn_set_state(c, conn_closing);
+    }
+    drive_machine(c);
+}
+
 static int new_socket(struct addrinfo *ai) {
     int sfd;
     int flags;
@@ -5096,6 +5336,9 @@ static void clock_handler(const int fd, const short which, void *arg) {
     event_base_set(main_base, &clockevent);
     evtimer_add(&clockevent, &t);
 
+    /* -o item_lock_grow_waits */
+    item_locks_check();
+
 #if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
     if (monotonic) {
         struct timespec ts;
@@ -5180,12 +5423,75 @@ static void usage(void) {
            "                forcefully taking over the LRU tail item whose refcount has leaked.\n"
            "                Disabled by default; dangerous option.\n"
            "              - hash_algorithm: The hash table algorithm\n"
-           "                default is jenkins hash. options: jenkins, murmur3\n"
+           "                default is jenkins hash. options: jenkins, murmur3,\n"
+           "                wyhash, crc32c (uses SSE4.2 when the CPU has it)\n"
+           "              - hash_engine: The hash table layout\n"
+           "                default is chained. options: chained, bucketed\n"
+           "                (bucketed packs tags and item pointers into\n"
+           "                cache line sized buckets)\n"
+           "              - hash_tag_match: How the bucketed engine compares\n"
+           "                tags. default is auto, which times sse2 and scalar\n"
+           "                at startup and uses the faster one\n"
+           "              - hash_shrink_load: Halve the hash table when it holds\n"
+           "                fewer items per bucket than this (> 0, < 0.75).\n"
+           "                Never shrinks below the starting hashpower.\n"
+           "                Flushed items count until crawled or fetched.\n"
+           "                default is 0 (never shrink)\n"
+           "              - item_hash: Keep each item's key hash in its header, so\n"
+           "                evictions, the crawler and slab moves don't rehash\n"
+           "              - seqlock_gets: Look keys up without the item lock,\n"
+           "                retrying when a writer got in the way\n"
+           "              - lru_bump_buffers: Queue LRU bumps from gets in per-thread\n"
+           "                rings for the LRU maintainer thread to apply\n");
+    printf("              - lru_engine: How eviction victims are found (list, clock,\n"
+           "                sampled). clock and sampled keep no LRU lists and can't\n"
+           "                be used with lru_maintainer, lru_crawler or\n"
+           "                lru_bump_buffers. default is list\n"
+           "              - lru_samples: Chunks an lru_engine=sampled eviction picks\n"
+           "                the least recently used of. default is 5\n"
+           "              - lru_admission: Only let a new item evict the COLD LRU\n"
+           "                tail when its key has been asked for at least as often\n"
+           "                as that tail's. Needs lru_engine=list\n"
+           "              - lru_ghosts: Remember the hashes of evicted keys per\n"
+           "                slab class and size each class's WARM LRU from how\n"
+           "                many come back. Needs lru_maintainer\n"
+           "              - lru_reserve: Pct of each full slab class the LRU\n"
+           "                maintainer keeps free by evicting ahead of demand.\n"
+           "                Needs lru_maintainer, can't be used with\n"
+           "                lru_admission. default is 0 (off)\n"
+           "              - lru_cost: Seconds after its last access each unit of\n"
+           "                an item's cost hint keeps it from being evicted.\n"
+           "                Needs lru_engine=list. default is 0 (off)\n");
+    printf("              - slab_profile: File to read slab class sizes from\n"
+           "                at start, instead of -f. Sizes are sampled while\n"
+           "                running and \"slabs profile save\" writes classes\n"
+           "                fitted to them there\n"
+           "              - slab_hugepages: Back all of -m with one mapping of\n"
+           "                huge pages: thp (madvise), 2m or 1g (hugetlbfs).\n"
+           "                Falls back to thp, then to normal pages\n"
+           "              - numa: Give each NUMA node its share of -m and pin\n"
+           "                workers to nodes in blocks; an item's memory comes\n"
+           "                from the node its key hashes to\n"
+           "              - slab_magazines: Free chunks each worker keeps per\n"
+           "                slab class (up to 64KB) to skip the slab lock.\n"
+           "                Can't be used with slab_profile or lru_engine other\n"
+           "                than list. default is 0 (off)\n"
+           "              - large_item_max: Store values up to this size (k/m\n"
+           "                suffixes allowed) as chains of chunks from the\n"
+           "                largest slab class, instead of raising -I.\n"
+           "                default is 0 (off)\n");
+    printf("              - expiry_wheel: Index items with an exptime in a timing\n"
+           "                wheel and free each second's expired items as it passes\n"
+           "              - item_lock_grow_waits: Double the item lock table when\n"
+           "                more item lock calls than this wait in a second\n"
+           "                default is 0 (never)\n"
            "              - lru_crawler: Enable LRU Crawler background thread\n"
            "              - lru_crawler_sleep: Microseconds to sleep between items\n"
            "                default is 100.\n"
            "              - lru_crawler_tocrawl: Max items to crawl per slab per run\n"
            "                default is 0 (unlimited)\n"
+           "              - lru_crawler_threads: Crawler threads, each walking a\n"
+           "                different LRU at the same time. default is 1\n"
            "              - lru_maintainer: Enable new LRU system + background thread\n"
            "              - hot_lru_pct: Pct of slab memory to reserve for hot lru.\n"
            "                (requires lru_maintainer)\n"
@@ -5424,6 +5730,7 @@ int main (int argc, char **argv) {
     bool start_lru_maintainer = false;
     bool start_lru_crawler = false;
     enum hashfunc_type hash_type = JENKINS_HASH;
+    enum assoc_engine_type assoc_type = ASSOC_CHAINED;
     uint32_t tocrawl;
 
     char *subopts, *subopts_orig;
@@ -5435,9 +5742,29 @@ int main (int argc, char **argv) {
         SLAB_AUTOMOVE,
         TAIL_REPAIR_TIME,
         HASH_ALGORITHM,
+        HASH_ENGINE,
+        HASH_TAG_MATCH,
+        HASH_SHRINK_LOAD,
+        ITEM_HASH,
+        SEQLOCK_GETS,
+        LRU_BUMP_BUFFERS,
+        LRU_ENGINE,
+        LRU_SAMPLES,
+        LRU_ADMISSION,
+        LRU_GHOSTS,
+        LRU_RESERVE,
+        LRU_COST,
+        SLAB_PROFILE,
+        SLAB_HUGEPAGES,
+        NUMA,
+        SLAB_MAGAZINES,
+        LARGE_ITEM_MAX,
+        EXPIRY_WHEEL,
+        ITEM_LOCK_GROW_WAITS,
         LRU_CRAWLER,
         LRU_CRAWLER_SLEEP,
         LRU_CRAWLER_TOCRAWL,
+        LRU_CRAWLER_THREADS,
         LRU_MAINTAINER,
         HOT_LRU_PCT,
         WARM_LRU_PCT,
@@ -5450,9 +5777,29 @@ int main (int argc, char **argv) {
         [SLAB_AUTOMOVE] = "slab_automove",
         [TAIL_REPAIR_TIME] = "tail_repair_time",
         [HASH_ALGORITHM] = "hash_algorithm",
+        [HASH_ENGINE] = "hash_engine",
+        [HASH_TAG_MATCH] = "hash_tag_match",
+        [HASH_SHRINK_LOAD] = "hash_shrink_load",
+        [ITEM_HASH] = "item_hash",
+        [SEQLOCK_GETS] = "seqlock_gets",
+        [LRU_BUMP_BUFFERS] = "lru_bump_buffers",
+        [LRU_ENGINE] = "lru_engine",
+        [LRU_SAMPLES] = "lru_samples",
+        [LRU_ADMISSION] = "lru_admission",
+        [LRU_GHOSTS] = "lru_ghosts",
+        [LRU_RESERVE] = "lru_reserve",
+        [LRU_COST] = "lru_cost",
+        [SLAB_PROFILE] = "slab_profile",
+        [SLAB_HUGEPAGES] = "slab_hugepages",
+        [NUMA] = "numa",
+        [SLAB_MAGAZINES] = "slab_magazines",
+        [LARGE_ITEM_MAX] = "large_item_max",
+        [EXPIRY_WHEEL] = "expiry_wheel",
+        [ITEM_LOCK_GROW_WAITS] = "item_lock_grow_waits",
         [LRU_CRAWLER] = "lru_crawler",
         [LRU_CRAWLER_SLEEP] = "lru_crawler_sleep",
         [LRU_CRAWLER_TOCRAWL] = "lru_crawler_tocrawl",
+        [LRU_CRAWLER_THREADS] = "lru_crawler_threads",
         [LRU_MAINTAINER] = "lru_maintainer",
         [HOT_LRU_PCT] = "hot_lru_pct",
         [WARM_LRU_PCT] = "warm_lru_pct",
@@ -5820,8 +6167,55 @@ int main (int argc, char **argv) {
                     hash_type = JENKINS_HASH;
                 } else if (strcmp(subopts_value, "murmur3") == 0) {
                     hash_type = MURMUR3_HASH;
+                } else if (strcmp(subopts_value, "wyhash") == 0) {
+                    hash_type = WYHASH_HASH;
+                } else if (strcmp(subopts_value, "crc32c") == 0) {
+                    hash_type = CRC32C_HASH;
+                } else {
+                    fprintf(stderr, "Unknown hash_algorithm option (jenkins, murmur3, wyhash, crc32c)\n");
+                    return 1;
+                }
+                break;
+            case HASH_ENGINE:
+                if (subopts_value == NULL) {
+                    fprintf(stderr, "Missing hash_engine argument\n");
+                    return 1;
+                };
+                if (strcmp(subopts_value, "chained") == 0) {
+                    assoc_type = ASSOC_CHAINED;
+                } else if (strcmp(subopts_value, "bucketed") == 0) {
+                    assoc_type = ASSOC_BUCKETED;
                 } else {
-                    fprintf(stderr, "Unknown hash_algorithm option (jenkins, murmur3)\n");
+                    fprintf(stderr, "Unknown hash_engine option (chained, bucketed)\n");
+                    return 1;
+                }
+                break;
+            case HASH_TAG_MATCH:
+                if (subopts_value == NULL) {
+                    fprintf(stderr, "Missing hash_tag_match argument\n");
+                    return 1;
+                }
+                if (strcmp(subopts_value, "auto") == 0) {
+                    settings.hash_tag_match = "auto";
+                } else if (strcmp(subopts_value, "sse2") == 0) {
+                    settings.hash_tag_match = "sse2";
+                } else if (strcmp(subopts_value, "scalar") == 0) {
+                    settings.hash_tag_match = "scalar";
+                } else {
+                    fprintf(stderr, "Unknown hash_tag_match option (auto, sse2, scalar)\n");
+                    return 1;
+                }
+                break;
+            case HASH_SHRINK_LOAD:
+                if (subopts_value == NULL) {
+                    fprintf(stderr, "Missing hash_shrink_load argument\n");
+                    return 1;
+                }
+                settings.hash_shrink_load = atof(subopts_value);
+                /* Halving doubles the load, which must stay clear of the
+                 * 1.5 items per bucket the chained table grows at. */
+                if (settings.hash_shrink_load <= 0 || settings.hash_shrink_load >= 0.75) {
+                    fprintf(stderr, "hash_shrink_load must be > 0 and < 0.75\n");
                     return 1;
                 }
                 break;
@@ -5853,6 +6247,17 @@ int main (int argc, char **argv) {
                 }
                 settings.lru_crawler_tocrawl = tocrawl;
                 break;
+            case LRU_CRAWLER_THREADS:
+                if (subopts_value == NULL) {
+                    fprintf(stderr, "Missing lru_crawler_threads value\n");
+                    return 1;
+                }
+                settings.lru_crawler_threads = atoi(subopts_value);
+                if (settings.lru_crawler_threads < 1 || settings.lru_crawler_threads > 64) {
+                    fprintf(stderr, "lru_crawler_threads must be between 1 and 64\n");
+                    return 1;
+                }
+                break;
             case LRU_MAINTAINER:
                 start_lru_maintainer = true;
                 break;
@@ -5881,6 +6286,160 @@ int main (int argc, char **argv) {
             case NOEXP_NOEVICT:
                 settings.expirezero_does_not_evict = true;
                 break;
+            case ITEM_HASH:
+                settings.item_hash = true;
+                break;
+            case SEQLOCK_GETS:
+#ifdef HAVE_GCC_ATOMICS
+                settings.seqlock_gets = true;
+#else
+                fprintf(stderr, "seqlock_gets needs a compiler with atomic builtins\n");
+                return 1;
+#endif
+                break;
+            case LRU_BUMP_BUFFERS:
+#ifdef HAVE_GCC_ATOMICS
+                settings.lru_bump_buffers = true;
+#else
+                fprintf(stderr, "lru_bump_buffers needs a compiler with atomic builtins\n");
+                return 1;
+#endif
+                break;
+            case LRU_ENGINE:
+                if (subopts_value == NULL) {
+                    fprintf(stderr, "Missing lru_engine argument\n");
+                    return 1;
+                };
+                if (strcmp(subopts_value, "list") == 0) {
+                    settings.lru_engine = LRU_ENGINE_LIST;
+                } else if (strcmp(subopts_value, "clock") == 0) {
+                    settings.lru_engine = LRU_ENGINE_CLOCK;
+                } else if (strcmp(subopts_value, "sampled") == 0) {
+                    settings.lru_engine = LRU_ENGINE_SAMPLED;
+                } else {
+                    fprintf(stderr, "Unknown lru_engine option (list, clock, sampled)\n");
+                    return 1;
+                }
+                break;
+            case LRU_SAMPLES:
+                if (subopts_value == NULL) {
+                    fprintf(stderr, "Missing lru_samples argument\n");
+                    return 1;
+                }
+                settings.lru_samples = atoi(subopts_value);
+                if (settings.lru_samples < 1 || settings.lru_samples > 64) {
+                    fprintf(stderr, "lru_samples must be between 1 and 64\n");
+                    return 1;
+                }
+                break;
+            case LRU_ADMISSION:
+                settings.lru_admission = true;
+                break;
+            case LRU_GHOSTS:
+                settings.lru_ghosts = true;
+                break;
+            case LRU_RESERVE:
+                if (subopts_value == NULL) {
+                    fprintf(stderr, "Missing lru_reserve argument\n");
+                    return 1;
+                }
+                settings.lru_reserve = atoi(subopts_value);
+                if (settings.lru_reserve < 1 || settings.lru_reserve > 50) {
+                    fprintf(stderr, "lru_reserve must be between 1 and 50\n");
+                    return 1;
+                }
+                break;
+            case LRU_COST:
+                if (subopts_value == NULL) {
+                    fprintf(stderr, "Missing lru_cost argument\n");
+                    return 1;
+                }
+                settings.lru_cost = atoi(subopts_value);
+                if (settings.lru_cost < 1) {
+                    fprintf(stderr, "lru_cost must be at least 1\n");
+                    return 1;
+                }
+                break;
+            case SLAB_PROFILE:
+                if (subopts_value == NULL || *subopts_value == '\0') {
+                    fprintf(stderr, "Missing slab_profile argument\n");
+                    return 1;
+                }
+                settings.slab_profile = strdup(subopts_value);
+                break;
+            case SLAB_HUGEPAGES:
+                if (subopts_value == NULL) {
+                    fprintf(stderr, "Missing slab_hugepages argument\n");
+                    return 1;
+                }
+                if (strcmp(subopts_value, "thp") == 0) {
+                    settings.slab_hugepages = SLAB_HUGEPAGES_THP;
+                } else if (strcmp(subopts_value, "2m") == 0) {
+                    settings.slab_hugepages = SLAB_HUGEPAGES_2M;
+                } else if (strcmp(subopts_value, "1g") == 0) {
+                    settings.slab_hugepages = SLAB_HUGEPAGES_1G;
+                } else {
+                    fprintf(stderr, "Unknown slab_hugepages option (thp, 2m, 1g)\n");
+                    return 1;
+                }
+                break;
+            case NUMA:
+#ifdef HAVE_GCC_ATOMICS
+                settings.numa = true;
+#else
+                fprintf(stderr, "numa needs a compiler with atomic builtins\n");
+                return 1;
+#endif
+                break;
+            case SLAB_MAGAZINES:
+                if (subopts_value == NULL) {
+                    fprintf(stderr, "Missing slab_magazines argument\n");
+                    return 1;
+                }
+#ifdef HAVE_GCC_ATOMICS
+                settings.slab_magazines = atoi(subopts_value);
+                if (settings.slab_magazines < 2 || settings.slab_magazines > 1024) {
+                    fprintf(stderr, "slab_magazines must be between 2 and 1024\n");
+                    return 1;
+                }
+#else
+                fprintf(stderr, "slab_magazines needs a compiler with atomic builtins\n");
+                return 1;
+#endif
+                break;
+            case LARGE_ITEM_MAX:
+                if (subopts_value == NULL) {
+                    fprintf(stderr, "Missing large_item_max argument\n");
+                    return 1;
+                }
+                size_max = atoi(subopts_value);
+                unit = subopts_value[strlen(subopts_value)-1];
+                if (size_max < 1 || size_max > 1024 * 1024 * 1024
+                    || ((unit == 'k' || unit == 'K') && size_max > 1024 * 1024)
+                    || ((unit == 'm' || unit == 'M') && size_max > 1024)) {
+                    fprintf(stderr, "large_item_max must be between 1 byte and 1 gb\n");
+                    return 1;
+                }
+                if (unit == 'k' || unit == 'K')
+                    size_max *= 1024;
+                if (unit == 'm' || unit == 'M')
+                    size_max *= 1024 * 1024;
+                settings.large_item_max = size_max;
+                break;
+            case EXPIRY_WHEEL:
+                settings.expiry_wheel = true;
+                break;
+            case ITEM_LOCK_GROW_WAITS:
+                if (subopts_value == NULL) {
+                    fprintf(stderr, "Missing item_lock_grow_waits argument\n");
+                    return 1;
+                }
+                settings.item_lock_grow_waits = atoi(subopts_value);
+                if (settings.item_lock_grow_waits < 1) {
+                    fprintf(stderr, "item_lock_grow_waits must be at least 1\n");
+                    return 1;
+                }
+                break;
             default:
                 printf("Illegal suboption \"%s\"\n", subopts_value);
                 return 1;
@@ -5895,6 +6454,65 @@ int main (int argc, char **argv) {
         }
     }
 
+    if (settings.lru_engine != LRU_ENGINE_LIST &&
+        (start_lru_maintainer || start_lru_crawler || settings.lru_bump_buffers)) {
+        fprintf(stderr, "lru_engine=%s keeps no LRU lists, so it can't be used with "
+                "lru_maintainer, lru_crawler or lru_bump_buffers\n",
+                settings.lru_engine == LRU_ENGINE_CLOCK ? "clock" : "sampled");
+        exit(EX_USAGE);
+    }
+
+    if (settings.lru_admission && settings.lru_engine != LRU_ENGINE_LIST) {
+        fprintf(stderr, "lru_admission compares against the COLD LRU tail, so it "
+                "needs lru_engine=list\n");
+        exit(EX_USAGE);
+    }
+
+    if (settings.lru_cost && settings.lru_engine != LRU_ENGINE_LIST) {
+        fprintf(stderr, "lru_cost spares items at the COLD LRU tail, so it needs "
+                "lru_engine=list\n");
+        exit(EX_USAGE);
+    }
+
+    if (settings.large_item_max &&
+        settings.large_item_max <= settings.item_size_max) {
+        fprintf(stderr, "large_item_max is for values past item_size_max, so "
+                "it must be larger than -I\n");
+        exit(EX_USAGE);
+    }
+
+    if (settings.slab_magazines && settings.slab_profile != NULL) {
+        fprintf(stderr, "slab_profile samples every allocation under the slab "
+                "lock, so it can't be used with slab_magazines\n");
+        exit(EX_USAGE);
+    }
+
+    if (settings.slab_magazines && settings.lru_engine != LRU_ENGINE_LIST) {
+        fprintf(stderr, "lru_engine=clock|sampled evicts straight from slab "
+                "pages under the slab lock, which magazines bypass, so "
+                "slab_magazines needs lru_engine=list\n");
+        exit(EX_USAGE);
+    }
+
+    if (settings.lru_ghosts && !start_lru_maintainer) {
+        fprintf(stderr, "lru_ghosts sizes the segmented LRU, so it needs "
+                "lru_maintainer\n");
+        exit(EX_USAGE);
+    }
+
+    if (settings.lru_reserve && !start_lru_maintainer) {
+        fprintf(stderr, "lru_reserve is kept by the LRU maintainer, so it needs "
+                "lru_maintainer\n");
+        exit(EX_USAGE);
+    }
+
+    if (settings.lru_reserve && settings.lru_admission) {
+        fprintf(stderr, "lru_admission is only asked when an allocation fails, "
+                "which lru_reserve keeps from happening, so they can't be "
+                "used together\n");
+        exit(EX_USAGE);
+    }
+
     if (settings.lru_maintainer_thread && settings.hot_lru_pct + settings.warm_lru_pct > 80) {
         fprintf(stderr, "hot_lru_pct + warm_lru_pct cannot be more than 80%% combined\n");
         exit(EX_USAGE);
@@ -6047,10 +6665,14 @@ int main (int argc, char **argv) {
 
     /* initialize other stuff */
     stats_init();
-    assoc_init(settings.hashpower_init);
+    assoc_init(settings.hashpower_init, assoc_type);
 	//ӹconnгʼ
     conn_init();
     slabs_init(settings.maxbytes, settings.factor, preallocate);
+    if (settings.lru_admission && lru_admission_init(settings.maxbytes) != 0) {
+        fprintf(stderr, "Failed to allocate the lru_admission sketch\n");
+        exit(EX_OSERR);
+    }
 
     /*
      * ignore SIGPIPE signals; we can use errno == EPIPE if we
@@ -6074,7 +6696,11 @@ int main (int argc, char **argv) {
         exit(EXIT_FAILURE);
     }
 
-    if (start_lru_maintainer && start_lru_maintainer_thread() != 0) {
+    /* The bump rings, the expiry wheel and the admission sketch's aging need
+     * the thread even without the segmented LRU. */
+    if ((start_lru_maintainer || settings.lru_bump_buffers ||
+         settings.expiry_wheel || settings.lru_admission) &&
+        start_lru_maintainer_thread(start_lru_maintainer) != 0) {
         fprintf(stderr, "Failed to enable LRU maintainer thread\n");
         return 1;
     }
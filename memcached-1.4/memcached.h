@@ -107,12 +107,23 @@
          + (item)->nsuffix \
          + (((item)->it_flags & ITEM_CAS) ? sizeof(uint64_t) : 0))
 
-#define ITEM_ntotal(item) (sizeof(struct _stritem) + (item)->nkey + 1 \
+/* A chunked item's header always fills a chunk of the largest class; the
+ * rest of its value sits in the chain of item_chunks. */
+#define ITEM_ntotal(item) (((item)->it_flags & ITEM_CHUNKED) \
+         ? (size_t)settings.item_size_max \
+         : sizeof(struct _stritem) + (item)->nkey + 1 \
          + (item)->nsuffix + (item)->nbytes \
          + (((item)->it_flags & ITEM_CAS) ? sizeof(uint64_t) : 0))
 
+/* Hash of the item's key, from the header when -o item_hash cached it there. */
+#define ITEM_hash(item) (((item)->it_flags & ITEM_HASHED) ? (item)->hv \
+         : hash(ITEM_key(item), (item)->nkey))
+
 #define ITEM_clsid(item) ((item)->slabs_clsid & ~(3<<6))
 
+/* Largest recompute cost hint an item's header holds; bigger ones clamp. */
+#define ITEM_COST_MAX 255
+
 #define STAT_KEY_LEN 128
 #define STAT_VAL_LEN 128
 
@@ -165,6 +176,7 @@ enum conn_states { //conn
     conn_closing,    /**< closing this connection */
     conn_mwrite,     /**< writing out many items sequentially */
     conn_closed,     /**< connection is closed */
+    conn_watch,      /**< held by another thread, e.g. a metadump */
     conn_max_state   /**< Max state value (used for assertion) */
 };
 
@@ -202,6 +214,26 @@ enum pause_thread_types {
     RESUME_WORKER_THREADS
 };
 
+/* How victims are found when a slab class is full, see -o lru_engine */
+enum lru_engine_type {
+    LRU_ENGINE_LIST = 0, /* LRU lists, segmented with -o lru_maintainer */
+    LRU_ENGINE_CLOCK,    /* CLOCK hand over the slab pages */
+    LRU_ENGINE_SAMPLED   /* least recently used of a few random chunks */
+};
+
+/* What backs the slab arena, see -o slab_hugepages */
+enum slab_hugepages_type {
+    SLAB_HUGEPAGES_OFF = 0, /* malloc'd pages, or one malloc with -L */
+    SLAB_HUGEPAGES_THP,     /* anonymous mapping with madvise(MADV_HUGEPAGE) */
+    SLAB_HUGEPAGES_2M,      /* MAP_HUGETLB, 2MB pages */
+    SLAB_HUGEPAGES_1G       /* MAP_HUGETLB, 1GB pages */
+};
+
+/* -o numa: nodes workers and slab memory are spread over, and the node ids
+ * looked for in sysfs. */
+#define NUMA_MAX_NODES 8
+#define NUMA_NODE_IDS 256
+
 #define IS_UDP(x) (x == udp_transport)
 
 //Ӧ add set replace append prepend cas
@@ -255,6 +287,9 @@ struct thread_stats { //
     uint64_t          conn_yields; /* # of yields for connections (-R option)*/
     uint64_t          auth_cmds;
     uint64_t          auth_errors;
+    uint64_t          seqlock_retries; /* optimistic gets that took the lock */
+    uint64_t          numa_local_hits;  /* hits on memory of our own node */
+    uint64_t          numa_remote_hits; /* hits on another node's memory */
     struct slab_stats slab_stats[MAX_NUMBER_OF_SLAB_CLASSES];
 };
 
@@ -290,6 +325,9 @@ struct stats_t { //struct stats_t stats;
     unsigned int  hash_power_level; /* Better hope it's not over 9000 */
     uint64_t      hash_bytes;       /* size used for hash tables */
     bool          hash_is_expanding; /* If the hash table is being expanded */
+    unsigned int  hash_expand_buckets; /* old buckets migrated by the current expansion */
+    uint64_t      hash_expansions;  /* completed hash table expansions */
+    uint64_t      hash_shrinks;     /* completed hash table shrinks */
     uint64_t      expired_unfetched; /* items reclaimed but never touched */
     uint64_t      evicted_unfetched; /* items evicted but never touched */
     bool          slab_reassign_running; /* slab reassign in progress */ //ǷڽҳǨ slab_rebalance_finish
@@ -301,6 +339,7 @@ struct stats_t { //struct stats_t stats;
     uint64_t      lru_crawler_starts; /* Number of item crawlers kicked off */
     bool          lru_crawler_running; /* crawl in progress */
     uint64_t      lru_maintainer_juggles; /* number of LRU bg pokes */
+    unsigned int  lru_maintainer_sleep; /* usecs until the next poke */
     uint64_t      time_in_listen_disabled_us;  /* elapsed time in microseconds while server unable to process new connections */
     struct timeval maxconns_entered;  /* last time maxconns entered */
 };
@@ -391,11 +430,32 @@ struct settings {
     bool flush_enabled;     /* flush_all enabled */
     //hash㷨hash_init
     char *hash_algorithm;     /* Hash algorithm in use */
+    char *hash_engine;        /* Hash table layout in use */
+    const char *hash_tag_match; /* Bucket tag compare (auto, sse2, scalar),
+                                 * the one in use once assoc_init() picks */
+    double hash_shrink_load;  /* Halve the hash table below this many items per bucket */
+    bool item_hash;           /* Cache the key's hash in the item header */
+    bool seqlock_gets;        /* Gets read under stripe sequence counters */
+    bool lru_bump_buffers;    /* Workers queue LRU bumps for the maintainer */
+    enum lru_engine_type lru_engine; /* How eviction victims are picked */
+    int lru_samples;          /* Chunks looked at per lru_engine=sampled eviction */
+    bool lru_admission;       /* New items must outrank the COLD tail to evict it */
+    bool lru_ghosts;          /* Size WARM per class from ghosts of evicted keys */
+    int lru_reserve;          /* Pct of each full class the maintainer keeps free */
+    int lru_cost;             /* Seconds of recency a unit of item cost is worth */
+    char *slab_profile;       /* File of class sizes fitted to allocations */
+    enum slab_hugepages_type slab_hugepages; /* Page size asked for the slab arena */
+    bool numa;                /* Slab arena per node, workers pinned by node */
+    int slab_magazines;       /* Free chunks cached per worker and class */
+    int large_item_max;       /* Largest value kept as a chain of chunks */
+    bool expiry_wheel;        /* Index items by exptime and free them on time */
+    int item_lock_grow_waits; /* Grow item locks past this many waits a second */
     //LRU̹߳ʱ߼λ΢
     int lru_crawler_sleep;  /* Microsecond sleep between items */
     //LRUÿLRUеĶٸitemLRU湤޸ֵ
     //ʵЧlru_crawler tocrawl numָ
     uint32_t lru_crawler_tocrawl; /* Number of items to crawl per run */
+    int lru_crawler_threads;  /* Crawler threads walking LRUs side by side */
 
     int hot_lru_pct; /* percentage of slab space for HOT_LRU */
     int warm_lru_pct; /* percentage of slab space for WARM_LRU */
@@ -420,6 +480,13 @@ extern struct settings settings;
 #define ITEM_FETCHED 8 //ͻgetitemʱITEM_FETCHED
 /* Appended on fetch, removed on LRU shuffling */
 #define ITEM_ACTIVE 16 //ͻgetitemʱITEM_FETCHED
+/* hv holds the hash of the key, set on link with -o item_hash */
+#define ITEM_HASHED 32
+/* Waiting in a worker's LRU bump ring, with -o lru_bump_buffers */
+#define ITEM_BUMPED 64
+/* Value is larger than item_size_max and continues in item_chunks, with
+ * -o large_item_max. Set on the header and on each chunk. */
+#define ITEM_CHUNKED 128
 
 /*
 //itemɾ
@@ -453,6 +520,10 @@ typedef struct _stritem {
     uint8_t         slabs_clsid;/* which slab class we're in */
 	//ֵĳ 
     uint8_t         nkey;       /* key length, w/terminating null and padding */
+    /* Also fits in padding: set with "cost=" or binary set extras. */
+    uint8_t         cost;       /* client's recompute cost hint, 0..ITEM_COST_MAX */
+    /* Fits in what used to be padding before data on 64 bit builds. */
+    uint32_t        hv;         /* hash of the key, if ITEM_HASHED */
     /* this odd type prevents type-punning issues when we do
      * the little shuffle to save space when not using CAS. */
     union {
@@ -482,10 +553,43 @@ typedef struct { //
     uint8_t         it_flags;   /* ITEM_* above */ //ʶһαitem,Ϊ1ʶҪڵslabclassοitem_crawler_thread
     uint8_t         slabs_clsid;/* which slab class we're in */
     uint8_t         nkey;       /* key length, w/terminating null and padding */
+    uint8_t         cost;       /* unused, mirrors item */
+    uint32_t        hv;         /* unused, mirrors item */
     //lru_crawler tocrawl numָ
     uint32_t        remaining;  /* Max keys to crawl per slab per invocation */
 } crawler;
 
+/* One piece of a chunked item's value, in a chunk of the largest slab class.
+ * Mirrors item so the slab code and the slab mover can tell it apart: it has
+ * ITEM_CHUNKED and no key. The header's data starts with a pointer to the
+ * first one, followed by as much of the value as fits. */
+typedef struct _strchunk {
+    struct _strchunk *next;     /* next piece of the value */
+    struct _strchunk *prev;     /* previous piece, NULL for the first */
+    struct _stritem *head;      /* header item the value belongs to */
+    rel_time_t      time;       /* unused, mirrors item */
+    rel_time_t      exptime;    /* unused, mirrors item */
+    int             nbytes;     /* bytes of the value held here */
+    unsigned short  refcount;   /* unused, mirrors item */
+    uint8_t         nsuffix;    /* unused, mirrors item */
+    uint8_t         it_flags;   /* ITEM_CHUNKED */
+    uint8_t         slabs_clsid;/* which slab class we're in */
+    uint8_t         nkey;       /* always 0 */
+    uint8_t         cost;       /* unused, mirrors item */
+    uint32_t        hv;         /* unused, mirrors item */
+    char            data[];
+} item_chunk;
+
+/* A chunk is filled in outside slabs_lock, so the slab mover can find it
+ * while it's being written. The writer puts this between filling in the
+ * chunk and setting ITEM_CHUNKED; the mover between seeing ITEM_CHUNKED and
+ * following head. */
+#ifdef HAVE_GCC_ATOMICS
+#define chunk_barrier() __sync_synchronize()
+#else
+#define chunk_barrier()
+#endif
+
 //memcached߳̽ṹķװṹ
 typedef struct {
     pthread_t thread_id;        /* unique ID of this thread */ //߳id
@@ -501,6 +605,11 @@ typedef struct {
     //dispatch_conn_new߳̽acceptͻ˷fd󴴽һCQ_ITEMУ߳thread_libevent_processӶȡ
     struct conn_queue *new_conn_queue; /* queue of new connections to handle */
     cache_t *suffix_cache;      /* suffix cache */
+    /* -o seqlock_gets: odd while inside an optimistic read */
+    volatile unsigned int read_epoch;
+    struct lru_bump_buf *lru_bump_buf; /* -o lru_bump_buffers, see items.c */
+    int numa_node;              /* -o numa: node we're pinned to, see thread.c */
+    struct slab_mags *slab_mags; /* -o slab_magazines, see slabs.c */
 
 } LIBEVENT_THREAD; //static LIBEVENT_THREAD *threads;
 
@@ -553,6 +662,10 @@ struct conn {
     char   *ritem;  /** when we read in an item's value, it goes here */
     //ʼrlbytesΪݲܳȣݲúֵ͸պΪ0
     int    rlbytes; //ݲֻ ֵprocess_update_commanddrive_machine
+    /* A chunked item's value is read one piece at a time: rloff is where
+     * the piece at ritem ends and rlend is where the whole value does. */
+    int    rloff;
+    int    rlend;
 
 
     /* data for the nread state */
@@ -700,6 +813,8 @@ extern int daemonize(int nochdir, int noclose);
 void memcached_thread_init(int nthreads, struct event_base *main_base);
 int  dispatch_event_add(int thread, conn *c);
 void dispatch_conn_new(int sfd, enum conn_states init_state, int event_flags, int read_buffer_size, enum network_transport transport);
+void redispatch_conn(conn *c, enum conn_states state);
+void conn_worker_readd(conn *c, enum conn_states state);
 
 /* Lock wrappers for cache functions that are called from main loop. */
 enum delta_result_type add_delta(conn *c, const char *key,
@@ -712,6 +827,9 @@ bool  conn_add_to_freelist(conn *c);
 int   is_listen_thread(void);
 item *item_alloc(char *key, size_t nkey, int flags, rel_time_t exptime, int nbytes);
 item *item_get(const char *key, const size_t nkey);
+/* Keys item_get_batch() hashes and prefetches at a time. */
+#define ITEM_GET_BATCH 16
+void  item_get_batch(const char **keys, const size_t *nkeys, item **its, const int count);
 item *item_touch(const char *key, const size_t nkey, uint32_t exptime);
 int   item_link(item *it);
 void  item_remove(item *it);
@@ -723,6 +841,14 @@ void item_lock(uint32_t hv);
 void *item_trylock(uint32_t hv);
 void item_trylock_unlock(void *arg);
 void item_unlock(uint32_t hv);
+void item_read_quiesce(void);
+struct lru_bump_buf *worker_bump_buf(void);
+struct slab_mags *worker_slab_mags(void);
+int numa_init(int *node_ids);
+int numa_node_self(void);
+int numa_key_node(const uint32_t hv);
+void item_locks_check(void);
+void item_lock_stats_append(ADD_STAT add_stats, void *c);
 void pause_threads(enum pause_thread_types type);
 unsigned short refcount_incr(unsigned short *refcount);
 unsigned short refcount_decr(unsigned short *refcount);
@@ -12,6 +12,7 @@
 #include <sys/socket.h>
 #include <sys/signal.h>
 #include <sys/resource.h>
+#include <sys/mman.h>
 #include <fcntl.h>
 #include <netinet/in.h>
 #include <errno.h>
@@ -20,6 +21,10 @@
 #include <string.h>
 #include <assert.h>
 #include <pthread.h>
+#include <limits.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
 
 //#define DEBUG_SLAB_MOVER
 /* powers-of-N allocation structures */
@@ -31,7 +36,8 @@ typedef struct {  //
     unsigned int perslab;   /* how many items per slab */
 
 	//ָitem
-    void *slots;           /* list of item ptrs */
+    void *slots[NUMA_MAX_NODES]; /* list of item ptrs, one per -o numa node */
+    unsigned int sl_free[NUMA_MAX_NODES]; /* free items in each node's list */
 	//itemĸ  ÿȡһitem1do_slabs_alloc
     unsigned int sl_curr;   /* total free items in list */
 
@@ -49,6 +55,10 @@ typedef struct {  //
 
 	//slabclass_tȥֽ do_slabs_alloc   ʵռõchunkеʵʹֽʵҪchunk٣Ϊһ㲻պô洢key-valueȸպΪchunk
     size_t requested; /* The number of requested bytes */
+
+    unsigned int clock_hand; /* -o lru_engine=clock: next chunk to look at */
+
+    uint64_t allocs;         /* chunks handed out, see slabs_alloc_counts() */
 } slabclass_t;
 
 
@@ -70,6 +80,23 @@ static void *mem_base = NULL;  //
 static void *mem_current = NULL;
 static size_t mem_avail = 0; //mem_availָжڴʹ
 
+/* -o slab_hugepages: what the arena at mem_base really got, and its size. */
+static enum slab_hugepages_type arena_hugepages = SLAB_HUGEPAGES_OFF;
+static size_t arena_size = 0;
+
+/* -o numa: an arena per node, see slabs_numa_map(). Without one chunks all
+ * go on free list 0. */
+static struct {
+    char *base;
+    char *current;
+    size_t size;
+    size_t avail;
+    size_t malloced;
+    uint64_t pages_spilled;  /* pages for this node carved from another */
+    uint64_t remote_chunks;  /* chunks for this node taken off another's list */
+} slab_nodes[NUMA_MAX_NODES];
+static int slab_node_count = 0;
+
 /**
  * Access to the slab allocator is protected by this lock
  */
@@ -79,9 +106,11 @@ static pthread_mutex_t slabs_rebalance_lock = PTHREAD_MUTEX_INITIALIZER;
 /*
  * Forward Declarations
  */
-static int do_slabs_newslab(const unsigned int id);
-static void *memory_allocate(size_t size);
+static int do_slabs_newslab(const unsigned int id, const int node);
+static void *memory_allocate(size_t size, const int node);
 static void do_slabs_free(void *ptr, const size_t size, unsigned int id);
+static void slabs_mags_sum(const unsigned int id, unsigned int *count,
+                           int64_t *requested, uint64_t *allocs);
 
 /* Preallocate as many slab pages as possible (called from slabs_init)
    on start-up, so users don't get confused out-of-memory errors when
@@ -113,6 +142,271 @@ unsigned int slabs_clsid(const size_t size) {
     return res;
 }
 
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#define HUGEPAGE_2M ((size_t)1 << 21)
+#define HUGEPAGE_1G ((size_t)1 << 30)
+
+/* -o slab_hugepages: maps the whole slab arena at once, with a page's worth
+ * per class of room over the limit as malloc'd pages would have. Tries
+ * hugetlbfs pages of the size asked for first, then transparent huge pages,
+ * and returns NULL to fall back to malloc. */
+static void *slabs_arena_map(const size_t limit) {
+    const size_t size = limit + (size_t)settings.item_size_max * MAX_NUMBER_OF_SLAB_CLASSES;
+    void *ptr = MAP_FAILED;
+    size_t huge;
+    char *start;
+
+#ifdef MAP_HUGETLB
+    if (settings.slab_hugepages == SLAB_HUGEPAGES_2M
+        || settings.slab_hugepages == SLAB_HUGEPAGES_1G) {
+        const int shift = settings.slab_hugepages == SLAB_HUGEPAGES_1G ? 30 : 21;
+        huge = (size_t)1 << shift;
+        arena_size = (size + huge - 1) & ~(huge - 1);
+        ptr = mmap(NULL, arena_size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (shift << MAP_HUGE_SHIFT),
+                   -1, 0);
+        if (ptr != MAP_FAILED) {
+            arena_hugepages = settings.slab_hugepages;
+            return ptr;
+        }
+        fprintf(stderr, "Failed to map %lu bytes of %s huge pages: %s\n"
+                "Will try transparent huge pages\n", (unsigned long)arena_size,
+                shift == 30 ? "1GB" : "2MB", strerror(errno));
+    }
+#endif
+#ifdef MADV_HUGEPAGE
+    /* Map one huge page more so the arena can start on a boundary. */
+    huge = HUGEPAGE_2M;
+    arena_size = (size + huge - 1) & ~(huge - 1);
+    ptr = mmap(NULL, arena_size + huge, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (ptr != MAP_FAILED) {
+        start = (char *)(((uintptr_t)ptr + huge - 1) & ~(uintptr_t)(huge - 1));
+        if (start != ptr)
+            munmap(ptr, start - (char *)ptr);
+        munmap(start + arena_size, huge - (start - (char *)ptr));
+        if (madvise(start, arena_size, MADV_HUGEPAGE) == 0) {
+            arena_hugepages = SLAB_HUGEPAGES_THP;
+            return start;
+        }
+        fprintf(stderr, "Failed to madvise huge pages: %s\n", strerror(errno));
+        munmap(start, arena_size);
+    }
+#endif
+    fprintf(stderr, "Huge pages unavailable, will use default page size\n");
+    arena_size = 0;
+    return NULL;
+}
+
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED 1
+#endif
+
+/* -o numa: maps an arena per node with that node's share of the limit and
+ * the same per-class slack as slabs_arena_map(), and asks the kernel to
+ * put its pages on the node. With slab_hugepages they are madvise()d for
+ * transparent huge pages. Stays with a single arena on one node. */
+static void slabs_numa_map(const size_t limit) {
+    int ids[NUMA_MAX_NODES];
+    const int nodes = numa_init(ids);
+
+    if (nodes < 2 || limit == 0)
+        return;
+#if defined(__linux__) && defined(SYS_mbind)
+    {
+        const size_t bits = 8 * sizeof(unsigned long);
+        unsigned long mask[NUMA_NODE_IDS / (8 * sizeof(unsigned long))];
+        size_t size = limit / nodes
+            + (size_t)settings.item_size_max * MAX_NUMBER_OF_SLAB_CLASSES;
+        void *ptr;
+        int i;
+
+        size = (size + HUGEPAGE_2M - 1) & ~(HUGEPAGE_2M - 1);
+        for (i = 0; i < nodes; i++) {
+            ptr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+            if (ptr == MAP_FAILED)
+                break;
+            memset(mask, 0, sizeof(mask));
+            mask[ids[i] / bits] |= 1UL << (ids[i] % bits);
+            if (syscall(SYS_mbind, ptr, size, MPOL_PREFERRED, mask,
+                        sizeof(mask) * 8 + 1, 0) != 0) {
+                fprintf(stderr, "Failed to bind slab memory to node %d: %s\n",
+                        ids[i], strerror(errno));
+                munmap(ptr, size);
+                break;
+            }
+#ifdef MADV_HUGEPAGE
+            if (settings.slab_hugepages != SLAB_HUGEPAGES_OFF
+                && madvise(ptr, size, MADV_HUGEPAGE) == 0)
+                arena_hugepages = SLAB_HUGEPAGES_THP;
+#endif
+            slab_nodes[i].base = slab_nodes[i].current = ptr;
+            slab_nodes[i].size = slab_nodes[i].avail = size;
+        }
+        if (i == nodes) {
+            slab_node_count = nodes;
+            return;
+        }
+        while (i-- > 0)
+            munmap(slab_nodes[i].base, size);
+        memset(slab_nodes, 0, sizeof(slab_nodes));
+        arena_hugepages = SLAB_HUGEPAGES_OFF;
+    }
+#endif
+    fprintf(stderr, "Can't place slab memory per NUMA node, will use one arena\n");
+}
+
+/* -o numa: which node arena ptr is in, -1 without node arenas. */
+int slabs_node(const void *ptr) {
+    int i;
+
+    for (i = 0; i < slab_node_count; i++) {
+        if ((const char *)ptr >= slab_nodes[i].base
+            && (const char *)ptr < slab_nodes[i].base + slab_nodes[i].size)
+            return i;
+    }
+    return -1;
+}
+
+/* The free list a chunk goes on. */
+static inline int slabs_free_node(const void *ptr) {
+    const int n = slab_node_count > 0 ? slabs_node(ptr) : 0;
+    return n < 0 ? 0 : n;
+}
+
+/* Whether [start, end) overlaps any slab arena. */
+static int slabs_arena_overlaps(const uintptr_t start, const uintptr_t end) {
+    int i;
+
+    if (mem_base != NULL && arena_size
+        && start < (uintptr_t)mem_base + arena_size && end > (uintptr_t)mem_base)
+        return 1;
+    for (i = 0; i < slab_node_count; i++) {
+        if (start < (uintptr_t)slab_nodes[i].base + slab_nodes[i].size
+            && end > (uintptr_t)slab_nodes[i].base)
+            return 1;
+    }
+    return 0;
+}
+
+/* How many huge pages back the arena. hugetlbfs pages are all there from
+ * the start; transparent ones show up in /proc/self/smaps as the kernel
+ * hands them out. Reading that walks every mapping, so don't call this with
+ * slabs_lock held. The arenas don't move once slabs_init() is done. */
+static uint64_t slabs_arena_hugepages(void) {
+    unsigned long long kb = 0, n;
+    unsigned long start, end;
+    char line[256], perms[8];
+    int in = 0;
+    FILE *f;
+
+    if (arena_hugepages == SLAB_HUGEPAGES_2M)
+        return arena_size / HUGEPAGE_2M;
+    if (arena_hugepages == SLAB_HUGEPAGES_1G)
+        return arena_size / HUGEPAGE_1G;
+    if (arena_hugepages != SLAB_HUGEPAGES_THP)
+        return 0;
+    if ((f = fopen("/proc/self/smaps", "r")) == NULL)
+        return 0;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (sscanf(line, "%lx-%lx %7s", &start, &end, perms) == 3) {
+            in = slabs_arena_overlaps(start, end);
+        } else if (in && sscanf(line, "AnonHugePages: %llu kB", &n) == 1) {
+            kb += n;
+        }
+    }
+    fclose(f);
+    return kb * 1024 / HUGEPAGE_2M;
+}
+
+/* -o slab_profile: every size handed to do_slabs_alloc() is counted into
+ * 8 byte buckets up to 1KB and 64 buckets per power of two above that, so
+ * "stats slab_profile" can fit class sizes to the sizes actually stored. */
+#define PROFILE_LINEAR_TOP 1024
+#define PROFILE_LINEAR_BUCKETS (PROFILE_LINEAR_TOP / CHUNK_ALIGN_BYTES)
+#define PROFILE_SUB_BITS 6
+#define PROFILE_BUCKETS (PROFILE_LINEAR_BUCKETS + (22 << PROFILE_SUB_BITS))
+
+static uint64_t profile_counts[PROFILE_BUCKETS];
+static uint64_t profile_bytes[PROFILE_BUCKETS];
+
+static unsigned int profile_bucket(const size_t size) {
+    unsigned int p = 10, b;
+    if (size <= PROFILE_LINEAR_TOP)
+        return size ? (size - 1) / CHUNK_ALIGN_BYTES : 0;
+    while (p < 31 && (size - 1) >> (p + 1))
+        p++;
+    b = PROFILE_LINEAR_BUCKETS + ((p - 10) << PROFILE_SUB_BITS)
+        + (((size - 1) - ((size_t)1 << p)) >> (p - PROFILE_SUB_BITS));
+    return b < PROFILE_BUCKETS ? b : PROFILE_BUCKETS - 1;
+}
+
+/* Largest size that falls in bucket b. */
+static size_t profile_bucket_top(const unsigned int b) {
+    unsigned int p;
+    if (b < PROFILE_LINEAR_BUCKETS)
+        return (size_t)(b + 1) * CHUNK_ALIGN_BYTES;
+    p = 10 + ((b - PROFILE_LINEAR_BUCKETS) >> PROFILE_SUB_BITS);
+    return ((size_t)1 << p) + ((size_t)(((b - PROFILE_LINEAR_BUCKETS)
+        & ((1 << PROFILE_SUB_BITS) - 1)) + 1) << (p - PROFILE_SUB_BITS));
+}
+
+/* Called with slabs_lock held. */
+static inline void slabs_profile_record(const size_t size) {
+    unsigned int b = profile_bucket(size);
+    profile_counts[b]++;
+    profile_bytes[b] += size;
+}
+
+/* Reads the chunk sizes saved by "slabs profile save", one per line. Returns
+ * how many there are, or 0 if the file isn't there or doesn't fit the
+ * current -n, -I and class limits. */
+static int slabs_profile_load(const char *path, unsigned int *sizes) {
+    const unsigned int smallest = sizeof(item) + settings.chunk_size;
+    char line[64];
+    unsigned long size;
+    int n = 0;
+    char *end;
+    FILE *f = fopen(path, "r");
+
+    if (f == NULL) {
+        if (errno != ENOENT)
+            fprintf(stderr, "Can't read slab profile %s: %s\n", path, strerror(errno));
+        return 0;
+    }
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (line[0] == '#') {
+            /* The header "slabs profile save" writes is longer than line. */
+            while (strchr(line, '\n') == NULL
+                   && fgets(line, sizeof(line), f) != NULL)
+                ;
+            continue;
+        }
+        if (line[0] == '\n')
+            continue;
+        size = strtoul(line, &end, 10);
+        if ((*end != '\n' && *end != '\0') || size < smallest
+            || size > settings.item_size_max || size % CHUNK_ALIGN_BYTES
+            || (n > 0 && size <= sizes[n - 1]) || n == MAX_NUMBER_OF_SLAB_CLASSES - 2) {
+            n = -1;
+            break;
+        }
+        sizes[n++] = size;
+    }
+    fclose(f);
+    if (n <= 0) {
+        fprintf(stderr, "Slab profile %s doesn't fit this -n/-I, ignoring it\n", path);
+        return 0;
+    }
+    /* The largest class is always item_size_max, as with -f. */
+    if (sizes[n - 1] == settings.item_size_max)
+        n--;
+    return n;
+}
+
 /**
  * Determines the chunk sizes and initializes the slab class descriptors
  * accordingly.
@@ -121,6 +415,8 @@ unsigned int slabs_clsid(const size_t size) {
  //factorӣĬֵ1.25
 void slabs_init(const size_t limit, const double factor, const bool prealloc) {
     int i = POWER_SMALLEST - 1;
+    unsigned int profile[MAX_NUMBER_OF_SLAB_CLASSES];
+    int profiled = 0;
 	//settings.chunk_sizeĬֵΪ48memcachedʱͨ-nѡ
 	//size: itemṹ屾itemӦ
 	//ҲsetaddеǸݣѭԿsize
@@ -131,7 +427,17 @@ void slabs_init(const size_t limit, const double factor, const bool prealloc) {
     mem_limit = limit;
 
 	//ûҪԤһڴ棬ԺҪڴ棬ڴ
-    if (prealloc) { //Ĭfalse
+    if (settings.numa)
+        slabs_numa_map(mem_limit);
+    if (settings.slab_hugepages != SLAB_HUGEPAGES_OFF && slab_node_count == 0) {
+        mem_base = slabs_arena_map(mem_limit);
+        if (mem_base != NULL) {
+            mem_current = mem_base;
+            mem_avail = arena_size;
+        }
+    }
+
+    if (prealloc && mem_base == NULL && slab_node_count == 0) { //Ĭfalse
         /* Allocate everything in a big chunk with malloc */
         mem_base = malloc(mem_limit);
         if (mem_base != NULL) {
@@ -146,9 +452,26 @@ void slabs_init(const size_t limit, const double factor, const bool prealloc) {
 	//ʼ飬ҪԪصĳԱΪ0
     memset(slabclass, 0, sizeof(slabclass));
 
+    if (settings.slab_profile != NULL)
+        profiled = slabs_profile_load(settings.slab_profile, profile);
+    if (profiled) {
+        for (i = POWER_SMALLEST; i <= profiled; i++) {
+            slabclass[i].size = profile[i - 1];
+            slabclass[i].perslab = settings.item_size_max / slabclass[i].size;
+            if (settings.verbose > 1) {
+                fprintf(stderr, "slab class %3d: chunk size %9u perslab %7u\n",
+                        i, slabclass[i].size, slabclass[i].perslab);
+            }
+        }
+        /* Skip the -f classes below. */
+        size = settings.item_size_max;
+    }
+
 	//slabclassеĵһԪزʹ
 	//settings.item_size_maxmemecachedֵ֧itemߴ磬ĬΪ1M
 	//Ҳ˵memcahced洢Ϊ1MB
+    if (profiled)
+        i--;
     while (++i < MAX_NUMBER_OF_SLAB_CLASSES-1 && size <= settings.item_size_max / factor) {
         /* Make sure items are always n-byte aligned */
         if (size % CHUNK_ALIGN_BYTES) //8ֽڶ
@@ -205,7 +528,7 @@ static void slabs_preallocate (const unsigned int maxslabs) {
 		//ȻֻǱʹ˵Ԫ
         if (++prealloc > maxslabs)
             return;
-        if (do_slabs_newslab(i) == 0) {
+        if (do_slabs_newslab(i, -1) == 0) {
 			//Ϊÿһslabclass_tһڴҳ
 			//ʧܣ˳ΪԤڴǺеĻ
 			//ʧˣĴ޴ִСֱ˳
@@ -242,19 +565,28 @@ static void split_slab_page_into_freelist(char *ptr, const unsigned int id) {
     }
 }
 
-/* Fast FIFO queue */
-static void *get_page_from_global_pool(void) {
+/* Fast FIFO queue. With -o numa a page on the node asked for is preferred. */
+static void *get_page_from_global_pool(const int node) {
     slabclass_t *p = &slabclass[SLAB_GLOBAL_PAGE_POOL];
+    unsigned int i;
     if (p->slabs < 1) {
         return NULL;
     }
+    for (i = 0; node >= 0 && i < p->slabs; i++) {
+        if (slabs_node(p->slab_list[i]) == node) {
+            void *tmp = p->slab_list[i];
+            p->slab_list[i] = p->slab_list[p->slabs - 1];
+            p->slab_list[p->slabs - 1] = tmp;
+            break;
+        }
+    }
     char *ret = p->slab_list[p->slabs - 1];
     p->slabs--;
     return ret;
 }
 //slabclass_tslabĿġúΪslabclass_tһslab
 //idָslabclassеǸslabclass_t
-static int do_slabs_newslab(const unsigned int id) {
+static int do_slabs_newslab(const unsigned int id, const int node) {
     slabclass_t *p = &slabclass[id];
     slabclass_t *g = &slabclass[SLAB_GLOBAL_PAGE_POOL];
     int len = settings.slab_reassign ? settings.item_size_max
@@ -270,8 +602,8 @@ static int do_slabs_newslab(const unsigned int id) {
     }
 
         (grow_slab_list(id) == 0) || //slab_list(ʧܷ0)һɹ޷ڴ
-        (((ptr = get_page_from_global_pool()) == NULL) &&
-        ((ptr = memory_allocate((size_t)len)) == 0)) { //lenֽڴ(Ҳһҳ)
+        (((ptr = get_page_from_global_pool(node)) == NULL) &&
+        ((ptr = memory_allocate((size_t)len, node)) == 0)) { //lenֽڴ(Ҳһҳ)
 
         MEMCACHED_SLABS_SLABCLASS_ALLOCATE_FAILED(id);
         return 0;
@@ -294,47 +626,72 @@ static int do_slabs_newslab(const unsigned int id) {
 //itemslabclass_tпitemôʹӿеitemзһ
 //ûпitemôһڴҳٴҳзһitem
 // ֵΪõitemûڴˣNULL
-static void *do_slabs_alloc(const size_t size, unsigned int id, unsigned int *total_chunks,
-        unsigned int flags) {
-    slabclass_t *p;
-    void *ret = NULL;
+/* Takes a chunk off class id's free list, making a new page if there is
+ * none and flags allow. CALLED WITH slabs_lock HELD. */
+static item *do_slabs_pop(const unsigned int id, unsigned int flags, int node) {
+    slabclass_t *p = &slabclass[id];
     item *it = NULL;
+    /* -o numa: the key's node; with none anything free will do. */
+    const bool local = node >= 0 && node < slab_node_count;
 
-    if (id < POWER_SMALLEST || id > power_largest) {//±Խ
-        MEMCACHED_SLABS_ALLOCATE_FAILED(size, 0);
-        return NULL;
-    }
-    p = &slabclass[id];
-    assert(p->sl_curr == 0 || ((item *)p->slots)->slabs_clsid == 0);
+    if (!local)
+        node = 0;
+    assert(p->sl_free[node] == 0 || ((item *)p->slots[node])->slabs_clsid == 0);
 	//p->sl_curr0˵slabclass_tûпеitemˡ
 	//ʱҪdo_slabs_newslabһڴҳ
-    if (total_chunks != NULL) {
-        *total_chunks = p->slabs * p->perslab;
-    }
     /* fail unless we have space at the end of a recently allocated page,
        we have something on our freelist, or we could allocate a new page */
-    if (p->sl_curr == 0 && flags != SLABS_ALLOC_NO_NEWPAGE) {
-        do_slabs_newslab(id);
+    if ((local ? p->sl_free[node] : p->sl_curr) == 0
+        && flags != SLABS_ALLOC_NO_NEWPAGE) {
+        do_slabs_newslab(id, local ? node : -1);
+    }
+
+    if (p->sl_free[node] == 0 && p->sl_curr != 0) {
+        /* Nothing left on this node's list; take another node's chunk. */
+        int n;
+        for (n = 0; p->sl_free[n] == 0; n++)
+            ;
+        if (local)
+            slab_nodes[node].remote_chunks++;
+        node = n;
     }
 
-    if (p->sl_curr != 0) {
+    if (p->sl_free[node] != 0) {
         /* return off our freelist */
 		//do_slabs_newslabʧܣ򶼻һʼsl_currǷΪ0.
 		//p->slotsָһеitemʱҪѵһеitemȥ
-        it = (item *)p->slots;
-        p->slots = it->next;//slotsָһеitem
+        it = (item *)p->slots[node];
+        p->slots[node] = it->next;//slotsָһеitem
         if (it->next) it->next->prev = 0;
         /* Kill flag and initialize refcount here for lock safety in slab
          * mover's freeness detection. */
         it->it_flags &= ~ITEM_SLABBED;
         it->refcount = 1;
+        p->sl_free[node]--;
         p->sl_curr--; //Ŀһ
-        ret = (void *)it;
-    } else {
-        ret = NULL;
     }
+    return it;
+}
+
+static void *do_slabs_alloc(const size_t size, unsigned int id, unsigned int *total_chunks,
+        unsigned int flags, int node) {
+    slabclass_t *p;
+    void *ret = NULL;
+
+    if (id < POWER_SMALLEST || id > power_largest) {//±Խ
+        MEMCACHED_SLABS_ALLOCATE_FAILED(size, 0);
+        return NULL;
+    }
+    p = &slabclass[id];
+    if (total_chunks != NULL) {
+        *total_chunks = p->slabs * p->perslab;
+    }
+    ret = do_slabs_pop(id, flags, node);
 
     if (ret) {
+        p->allocs++;
+        if (settings.slab_profile != NULL)
+            slabs_profile_record(size);
         p->requested += size;//slabclassȥֽ
         MEMCACHED_SLABS_ALLOCATE(size, id, p->size, ret);
     } else {
@@ -348,6 +705,7 @@ static void *do_slabs_alloc(const size_t size, unsigned int id, unsigned int *to
 static void do_slabs_free(void *ptr, const size_t size, unsigned int id) {
     slabclass_t *p;
     item *it;
+    int node;
 
     assert(id >= POWER_SMALLEST && id <= power_largest);
     if (id < POWER_SMALLEST || id > power_largest)
@@ -364,11 +722,13 @@ static void do_slabs_free(void *ptr, const size_t size, unsigned int id) {
 	//Щitemprevnext໥ָ򣬰Щitem
 	//worker߳ڴع黹ڴʱãô4еǣ
 	//ʹͷ巨Ѹitem뵽item
+    node = slabs_free_node(ptr);
     it->prev = 0;
-    it->next = p->slots;
+    it->next = p->slots[node];
     if (it->next) it->next->prev = it;
-    p->slots = it; //slotָһпʹõitem
+    p->slots[node] = it; //slotָһпʹõitem
 
+    p->sl_free[node]++;
     p->sl_curr++; //пʹõitem
     p->requested -= size;//slabclass_tȥֽ
     return;
@@ -402,6 +762,9 @@ bool get_stats(const char *stat_type, int nkey, ADD_STAT add_stats, void *c) {
             slabs_stats(add_stats, c);
         } else if (nz_strcmp(nkey, stat_type, "sizes") == 0) {
             item_stats_sizes(add_stats, c);
+        } else if (nz_strcmp(nkey, stat_type, "slab_profile") == 0
+                   && settings.slab_profile != NULL) {
+            slabs_profile_stats(add_stats, c);
         } else {
             ret = false;
         }
@@ -451,7 +814,8 @@ STAT total_malloced 2097024
 END
 */
 /*@null@*/
-static void do_slabs_stats(ADD_STAT add_stats, void *c) {
+static void do_slabs_stats(ADD_STAT add_stats, void *c,
+                           const uint64_t hugepages_mapped) {
     int i, total;
     /* Get the per-thread stats which contain some interesting aggregates */
     struct thread_stats thread_stats;
@@ -462,8 +826,11 @@ static void do_slabs_stats(ADD_STAT add_stats, void *c) {
         slabclass_t *p = &slabclass[i];
         if (p->slabs != 0) {
             uint32_t perslab, slabs;
+            unsigned int mag_chunks;
+            int64_t mag_requested;
             slabs = p->slabs;
             perslab = p->perslab;
+            slabs_mags_sum(i, &mag_chunks, &mag_requested, NULL);
 
             char key_str[STAT_KEY_LEN];
             char val_str[STAT_VAL_LEN];
@@ -474,12 +841,15 @@ static void do_slabs_stats(ADD_STAT add_stats, void *c) {
             APPEND_NUM_STAT(i, "total_pages", "%u", slabs);
             APPEND_NUM_STAT(i, "total_chunks", "%u", slabs * perslab);
             APPEND_NUM_STAT(i, "used_chunks", "%u",
-                            slabs*perslab - p->sl_curr);
-            APPEND_NUM_STAT(i, "free_chunks", "%u", p->sl_curr);
+                            slabs*perslab - p->sl_curr - mag_chunks);
+            APPEND_NUM_STAT(i, "free_chunks", "%u", p->sl_curr + mag_chunks);
+            if (settings.slab_magazines) {
+                APPEND_NUM_STAT(i, "magazine_chunks", "%u", mag_chunks);
+            }
             /* Stat is dead, but displaying zero instead of removing it. */
             APPEND_NUM_STAT(i, "free_chunks_end", "%u", 0);
             APPEND_NUM_STAT(i, "mem_requested", "%llu",
-                            (unsigned long long)p->requested);
+                            (unsigned long long)(p->requested + mag_requested));
             APPEND_NUM_STAT(i, "get_hits", "%llu",
                     (unsigned long long)thread_stats.slab_stats[i].get_hits);
             APPEND_NUM_STAT(i, "cmd_set", "%llu",
@@ -504,19 +874,73 @@ static void do_slabs_stats(ADD_STAT add_stats, void *c) {
 
     APPEND_STAT("active_slabs", "%d", total);
     APPEND_STAT("total_malloced", "%llu", (unsigned long long)mem_malloced);
+    if (settings.slab_hugepages != SLAB_HUGEPAGES_OFF) {
+        APPEND_STAT("hugepages", "%s",
+                    arena_hugepages == SLAB_HUGEPAGES_THP ? "thp" :
+                    arena_hugepages == SLAB_HUGEPAGES_2M ? "2m" :
+                    arena_hugepages == SLAB_HUGEPAGES_1G ? "1g" : "no");
+        APPEND_STAT("hugepages_mapped", "%llu",
+                    (unsigned long long)hugepages_mapped);
+    }
+    for (i = 0; i < slab_node_count; i++) {
+        char key_str[STAT_KEY_LEN];
+        char val_str[STAT_VAL_LEN];
+        int klen = 0, vlen = 0, j;
+        uint64_t free_chunks = 0;
+
+        for (j = POWER_SMALLEST; j <= power_largest; j++)
+            free_chunks += slabclass[j].sl_free[i];
+        APPEND_NUM_FMT_STAT("node%d:%s", i, "malloced", "%llu",
+                            (unsigned long long)slab_nodes[i].malloced);
+        APPEND_NUM_FMT_STAT("node%d:%s", i, "free_chunks", "%llu",
+                            (unsigned long long)free_chunks);
+        APPEND_NUM_FMT_STAT("node%d:%s", i, "pages_spilled", "%llu",
+                            (unsigned long long)slab_nodes[i].pages_spilled);
+        APPEND_NUM_FMT_STAT("node%d:%s", i, "remote_chunks", "%llu",
+                            (unsigned long long)slab_nodes[i].remote_chunks);
+    }
     add_stats(NULL, 0, NULL, 0, c);
 }
 
+/* -o numa: carves a page from the node's arena, or from the one with the
+ * most room left once that is full. */
+static void *slabs_node_allocate(size_t size, const int node) {
+    int n = node, i;
+    void *ret;
+
+    if (size % CHUNK_ALIGN_BYTES)
+        size += CHUNK_ALIGN_BYTES - (size % CHUNK_ALIGN_BYTES);
+    if (n < 0 || n >= slab_node_count || slab_nodes[n].avail < size) {
+        n = -1;
+        for (i = 0; i < slab_node_count; i++) {
+            if (slab_nodes[i].avail >= size
+                && (n < 0 || slab_nodes[i].avail > slab_nodes[n].avail))
+                n = i;
+        }
+        if (n < 0)
+            return NULL;
+        if (node >= 0 && node < slab_node_count)
+            slab_nodes[node].pages_spilled++;
+    }
+    ret = slab_nodes[n].current;
+    slab_nodes[n].current += size;
+    slab_nodes[n].avail -= size;
+    slab_nodes[n].malloced += size;
+    mem_malloced += size;
+    return ret;
+}
 
 //ڴ棬ԤڴģԤڴڴ
 //mallocڴ
-static void *memory_allocate(size_t size) { //sizeһsettings.item_size_maxСҲĬ1M
+static void *memory_allocate(size_t size, const int node) { //sizeһsettings.item_size_maxСҲĬ1M
     void *ret;
 
 	//ҪԤȷڴ棬ǵҪʱŷڴ棬ô
 	//mem_baseָǿԤȷڴ
 	//mem_currentָ򻹿ʹõڴĿʼλ
 	//mem_availָжڴǿʹõ
+    if (slab_node_count > 0)
+        return slabs_node_allocate(size, node);
     if (mem_base == NULL) { //Ԥڴ
 
         /* We are not using a preallocated large memory chunk */
@@ -549,27 +973,254 @@ static void *memory_allocate(size_t size) { //
     return ret;
 }
 
+/* -o slab_magazines: every worker keeps a small stack of free chunks per
+ * class, refilled from and flushed to the class free lists half a magazine
+ * at a time, so most allocs and frees skip slabs_lock. A magazine's chunks
+ * are off the free lists, so neither the slab mover nor lru_engine looks at
+ * them, but the stats still count them as free. Classes whose magazine
+ * would hold fewer than two chunks of SLAB_MAG_BYTES aren't cached. */
+#define SLAB_MAG_BYTES (64 * 1024)
+
+struct slab_mag {
+    void **chunks;
+    unsigned int count;
+    unsigned int cap;      /* 0 if the class isn't cached */
+    int64_t requested;     /* bytes allocated from it less those freed to it */
+    uint64_t allocs;
+};
+
+struct slab_mags {
+    pthread_mutex_t lock;  /* only ever waited on by stats and the slab mover */
+    struct slab_mags *next;
+    struct slab_mag mag[MAX_NUMBER_OF_SLAB_CLASSES];
+};
+
+/* Every worker's magazines, newest first. Only ever added to. */
+static struct slab_mags *slab_mags_all = NULL;
+/* The class the slab mover is taking a page from: its magazines are
+ * drained and then bypassed until the move is over. */
+static volatile unsigned int slab_mags_bypass = 0;
+
+struct slab_mags *slabs_mags_create(void) {
+    struct slab_mags *mags = calloc(1, sizeof(*mags));
+    unsigned int cap;
+    int i;
+
+    if (mags == NULL)
+        return NULL;
+    pthread_mutex_init(&mags->lock, NULL);
+    for (i = POWER_SMALLEST; i <= power_largest; i++) {
+        cap = SLAB_MAG_BYTES / slabclass[i].size;
+        if (cap > (unsigned int)settings.slab_magazines)
+            cap = settings.slab_magazines;
+        if (cap < 2)
+            continue;
+        if ((mags->mag[i].chunks = calloc(cap, sizeof(void *))) == NULL) {
+            while (i-- > POWER_SMALLEST)
+                free(mags->mag[i].chunks);
+            free(mags);
+            return NULL;
+        }
+        mags->mag[i].cap = cap;
+    }
+
+    pthread_mutex_lock(&slabs_lock);
+    mags->next = slab_mags_all;
+    slab_mags_all = mags;
+    pthread_mutex_unlock(&slabs_lock);
+    return mags;
+}
+
+/* Fills an empty magazine half way. CALLED WITH the magazine's lock HELD. */
+static void slabs_mag_refill(struct slab_mag *m, const unsigned int id,
+                             unsigned int *total_chunks, unsigned int flags,
+                             const int node) {
+    item *it;
+
+    pthread_mutex_lock(&slabs_lock);
+    while (m->count < m->cap / 2 && (it = do_slabs_pop(id, flags, node)) != NULL) {
+        m->chunks[m->count++] = it;
+        /* Only the first chunk is worth a new page. */
+        flags = SLABS_ALLOC_NO_NEWPAGE;
+    }
+    if (total_chunks != NULL)
+        *total_chunks = slabclass[id].slabs * slabclass[id].perslab;
+    pthread_mutex_unlock(&slabs_lock);
+}
+
+/* Puts the oldest n chunks of a magazine back on the free lists. CALLED
+ * WITH the magazine's lock HELD. */
+static void slabs_mag_flush(struct slab_mag *m, const unsigned int id,
+                            const unsigned int n) {
+    unsigned int i;
+
+    pthread_mutex_lock(&slabs_lock);
+    for (i = 0; i < n; i++)
+        do_slabs_free(m->chunks[i], 0, id);
+    pthread_mutex_unlock(&slabs_lock);
+    m->count -= n;
+    memmove(m->chunks, m->chunks + n, m->count * sizeof(void *));
+}
+
+/* CALLED WITH the magazine's lock HELD. */
+static void *slabs_mag_alloc(struct slab_mag *m, const size_t size,
+                             const unsigned int id, unsigned int *total_chunks,
+                             const unsigned int flags, const int node) {
+    item *it;
+
+    if (m->count == 0) {
+        slabs_mag_refill(m, id, total_chunks, flags, node);
+    } else if (total_chunks != NULL) {
+        *total_chunks = slabclass[id].slabs * slabclass[id].perslab;
+    }
+    if (m->count == 0) {
+        MEMCACHED_SLABS_ALLOCATE_FAILED(size, id);
+        return NULL;
+    }
+    it = m->chunks[--m->count];
+    it->refcount = 1;
+    m->requested += size;
+    m->allocs++;
+    MEMCACHED_SLABS_ALLOCATE(size, id, slabclass[id].size, it);
+    return it;
+}
+
+/* CALLED WITH the magazine's lock HELD. */
+static void slabs_mag_free(struct slab_mag *m, item *it, const size_t size,
+                           const unsigned int id) {
+    MEMCACHED_SLABS_FREE(size, id, it);
+    if (m->count == m->cap)
+        slabs_mag_flush(m, id, m->cap / 2);
+    it->it_flags = 0;
+    it->slabs_clsid = 0;
+    m->chunks[m->count++] = it;
+    m->requested -= size;
+}
+
+/* The calling worker's magazine for class id, locked, or NULL to go
+ * through slabs_lock. */
+static struct slab_mag *slabs_mag_get(const unsigned int id,
+                                      struct slab_mags **mags) {
+    if (!settings.slab_magazines || id > (unsigned int)power_largest
+        || (*mags = worker_slab_mags()) == NULL || (*mags)->mag[id].cap == 0)
+        return NULL;
+    pthread_mutex_lock(&(*mags)->lock);
+    if (slab_mags_bypass == id) {
+        pthread_mutex_unlock(&(*mags)->lock);
+        return NULL;
+    }
+    return &(*mags)->mag[id];
+}
+
+static struct slab_mags *slabs_mags_head(void) {
+    struct slab_mags *mags;
+
+    pthread_mutex_lock(&slabs_lock);
+    mags = slab_mags_all;
+    pthread_mutex_unlock(&slabs_lock);
+    return mags;
+}
+
+/* Empties class id's magazines onto its free lists, and bypasses them
+ * until slabs_mags_resume(). */
+static void slabs_mags_drain(const unsigned int id) {
+    struct slab_mags *mags;
+
+    slab_mags_bypass = id;
+    for (mags = slabs_mags_head(); mags != NULL; mags = mags->next) {
+        pthread_mutex_lock(&mags->lock);
+        if (mags->mag[id].count != 0)
+            slabs_mag_flush(&mags->mag[id], id, mags->mag[id].count);
+        pthread_mutex_unlock(&mags->lock);
+    }
+}
+
+static void slabs_mags_resume(void) {
+    slab_mags_bypass = 0;
+}
+
+/* Locks or unlocks every magazine, in list order, for a consistent count.
+ * Taken before slabs_lock, as the workers do. */
+static void slabs_mags_lock_all(const bool lock) {
+    struct slab_mags *mags;
+
+    for (mags = slabs_mags_head(); mags != NULL; mags = mags->next) {
+        if (lock)
+            pthread_mutex_lock(&mags->lock);
+        else
+            pthread_mutex_unlock(&mags->lock);
+    }
+}
+
+/* What class id's magazines hold, over all workers. Exact with
+ * slabs_mags_lock_all() held, a hint without it. */
+static void slabs_mags_sum(const unsigned int id, unsigned int *count,
+                           int64_t *requested, uint64_t *allocs) {
+    struct slab_mags *mags;
+
+    *count = 0;
+    if (requested != NULL)
+        *requested = 0;
+    if (allocs != NULL)
+        *allocs = 0;
+    for (mags = slab_mags_all; mags != NULL; mags = mags->next) {
+        *count += mags->mag[id].count;
+        if (requested != NULL)
+            *requested += mags->mag[id].requested;
+        if (allocs != NULL)
+            *allocs += mags->mag[id].allocs;
+    }
+}
+
 //idӦslabclass[id]еһchunkлȡsizeռ
 void *slabs_alloc(size_t size, unsigned int id, unsigned int *total_chunks,
-        unsigned int flags) {
+        unsigned int flags, int node) {
     void *ret;
-
+    const int self = slab_node_count > 0 ? numa_node_self() : -1;
+    struct slab_mags *mags;
+    struct slab_mag *m;
+
+    if (slab_node_count == 0)
+        node = -1;
+    else if (node < 0)
+        node = self;
+    /* A worker's magazine only holds chunks off its own node. */
+    if (node == self && (m = slabs_mag_get(id, &mags)) != NULL) {
+        ret = slabs_mag_alloc(m, size, id, total_chunks, flags, node);
+        pthread_mutex_unlock(&mags->lock);
+        return ret;
+    }
     pthread_mutex_lock(&slabs_lock);
-    ret = do_slabs_alloc(size, id, total_chunks, flags);
+    ret = do_slabs_alloc(size, id, total_chunks, flags, node);
     pthread_mutex_unlock(&slabs_lock);
     return ret;
 }
 
 void slabs_free(void *ptr, size_t size, unsigned int id) {
+    struct slab_mags *mags;
+    struct slab_mag *m;
+
+    if ((slab_node_count == 0 || slabs_node(ptr) == numa_node_self())
+        && (m = slabs_mag_get(id, &mags)) != NULL) {
+        slabs_mag_free(m, ptr, size, id);
+        pthread_mutex_unlock(&mags->lock);
+        return;
+    }
     pthread_mutex_lock(&slabs_lock);
     do_slabs_free(ptr, size, id);
     pthread_mutex_unlock(&slabs_lock);
 }
 
 void slabs_stats(ADD_STAT add_stats, void *c) {
+    uint64_t hugepages_mapped = 0;
+
+    if (settings.slab_hugepages != SLAB_HUGEPAGES_OFF)
+        hugepages_mapped = slabs_arena_hugepages();
+    slabs_mags_lock_all(true);
     pthread_mutex_lock(&slabs_lock);
-    do_slabs_stats(add_stats, c);
+    do_slabs_stats(add_stats, c, hugepages_mapped);
     pthread_mutex_unlock(&slabs_lock);
+    slabs_mags_lock_all(false);
 }
 
 //µitemֱӰռɵitemͻ   ¼һslabclass_tȥڴС  
@@ -589,12 +1240,13 @@ void slabs_adjust_mem_requested(unsigned int id, size_t old, size_t ntotal)
 
 unsigned int slabs_available_chunks(const unsigned int id, bool *mem_flag,
         unsigned int *total_chunks, unsigned int *chunks_perslab) {
-    unsigned int ret;
+    unsigned int ret, mag_chunks;
     slabclass_t *p;
 
     pthread_mutex_lock(&slabs_lock);
     p = &slabclass[id];
-    ret = p->sl_curr;
+    slabs_mags_sum(id, &mag_chunks, NULL, NULL);
+    ret = p->sl_curr + mag_chunks;
     if (mem_flag != NULL)
         *mem_flag = mem_limit_reached;
     if (total_chunks != NULL)
@@ -605,6 +1257,326 @@ unsigned int slabs_available_chunks(const unsigned int id, bool *mem_flag,
     return ret;
 }
 
+/* Adds a candidate class size to the fit, merging it with the last one if
+ * they're the same size. is_class marks the current classes. */
+static void profile_point(size_t *tops, uint64_t *cnt_sum, uint64_t *byte_sum,
+                          uint8_t *is_class, int *n, const size_t top,
+                          const uint64_t count, const uint64_t bytes,
+                          const bool cls) {
+    if (*n == 0 || top != tops[*n]) {
+        (*n)++;
+        cnt_sum[*n] = cnt_sum[*n - 1];
+        byte_sum[*n] = byte_sum[*n - 1];
+        is_class[*n] = 0;
+    }
+    tops[*n] = top;
+    is_class[*n] |= cls;
+    cnt_sum[*n] += count;
+    byte_sum[*n] += bytes;
+}
+
+/* No fitted class is more than this many times (or -f times, if that's
+ * more) the size of the one below, so a size that was never sampled still
+ * gets a chunk at most that much too big. */
+#define PROFILE_MAX_RATIO 2
+
+/* The fit is O(classes * candidates^2) and runs on a worker thread, so the
+ * bucket tops are thinned out to about this many candidates. The current
+ * classes are always kept, which keeps a fit within the ratio possible. */
+#define PROFILE_MAX_POINTS 256
+
+/* Fits power_largest class sizes to the sampled sizes with a dynamic program
+ * over candidate sizes, which are the tops of the non-empty buckets (at most
+ * PROFILE_MAX_POINTS of them) and the current classes: f[k][j] is the least
+ * waste of covering everything up to candidate j with k classes, the last
+ * one of candidate j's size. Fills
+ * sizes[] (the last is always item_size_max) and returns how many, or 0 when
+ * nothing was sampled or memory ran out. */
+static int slabs_profile_fit(unsigned int *sizes, uint64_t *samples,
+                             uint64_t *bytes, uint64_t *waste_now,
+                             uint64_t *waste_fit) {
+    const size_t smallest = sizeof(item) + settings.chunk_size;
+    const int classes = power_largest;
+    const double ratio = settings.factor > PROFILE_MAX_RATIO ?
+        settings.factor : PROFILE_MAX_RATIO;
+    uint64_t *counts = NULL, *sums = NULL, *cnt_sum = NULL, *byte_sum = NULL;
+    uint64_t *prev = NULL, *cur = NULL, *swap, w;
+    size_t *tops = NULL, top;
+    uint16_t *choice = NULL;
+    uint8_t *is_class = NULL;
+    unsigned int b, id, cls = POWER_SMALLEST;
+    int n = 0, m, stride, i, j, k, ret = 0;
+
+    counts = malloc(sizeof(profile_counts));
+    sums = malloc(sizeof(profile_bytes));
+    tops = malloc(sizeof(size_t) * (PROFILE_BUCKETS + MAX_NUMBER_OF_SLAB_CLASSES + 1));
+    cnt_sum = malloc(sizeof(uint64_t) * (PROFILE_BUCKETS + MAX_NUMBER_OF_SLAB_CLASSES + 1));
+    byte_sum = malloc(sizeof(uint64_t) * (PROFILE_BUCKETS + MAX_NUMBER_OF_SLAB_CLASSES + 1));
+    is_class = malloc(PROFILE_BUCKETS + MAX_NUMBER_OF_SLAB_CLASSES + 1);
+    if (!counts || !sums || !tops || !cnt_sum || !byte_sum || !is_class)
+        goto out;
+    pthread_mutex_lock(&slabs_lock);
+    memcpy(counts, profile_counts, sizeof(profile_counts));
+    memcpy(sums, profile_bytes, sizeof(profile_bytes));
+    pthread_mutex_unlock(&slabs_lock);
+
+    /* Prefix sums over the non-empty buckets, tops clamped to what a class
+     * may be. What the current classes waste on the same sizes is worked
+     * out from each bucket's mean. */
+    *samples = *bytes = *waste_now = 0;
+    cnt_sum[0] = byte_sum[0] = 0;
+    for (b = 0; b < PROFILE_BUCKETS; b++) {
+        if (counts[b] == 0)
+            continue;
+        *samples += counts[b];
+        *bytes += sums[b];
+        id = slabs_clsid((sums[b] + counts[b] - 1) / counts[b]);
+        if (id != 0)
+            *waste_now += counts[b] * slabclass[id].size - sums[b];
+        top = profile_bucket_top(b);
+        if (top < smallest)
+            top = smallest;
+        if (top > settings.item_size_max)
+            top = settings.item_size_max;
+        for (; cls <= power_largest && slabclass[cls].size < top; cls++)
+            profile_point(tops, cnt_sum, byte_sum, is_class, &n,
+                          slabclass[cls].size, 0, 0, true);
+        profile_point(tops, cnt_sum, byte_sum, is_class, &n, top,
+                      counts[b], sums[b], false);
+    }
+    if (*samples == 0)
+        goto out;
+    /* The largest current class is item_size_max. */
+    for (; cls <= power_largest; cls++)
+        profile_point(tops, cnt_sum, byte_sum, is_class, &n,
+                      slabclass[cls].size, 0, 0, true);
+
+    /* Dropping a candidate hands its samples to the next one kept, as the
+     * sums are cumulative. */
+    if (n > PROFILE_MAX_POINTS) {
+        stride = (n + PROFILE_MAX_POINTS - 1) / PROFILE_MAX_POINTS;
+        for (i = 1, m = 0; i <= n; i++) {
+            if (!is_class[i] && i % stride != 0 && i != n)
+                continue;
+            m++;
+            tops[m] = tops[i];
+            cnt_sum[m] = cnt_sum[i];
+            byte_sum[m] = byte_sum[i];
+        }
+        n = m;
+    }
+
+#define PROFILE_WASTE(i, j) ((cnt_sum[j] - cnt_sum[i]) * tops[j] \
+                             - (byte_sum[j] - byte_sum[i]))
+    if (n <= classes) {
+        /* Room for a class per bucket. */
+        *waste_fit = 0;
+        for (j = 1; j <= n; j++) {
+            *waste_fit += PROFILE_WASTE(j - 1, j);
+            sizes[j - 1] = tops[j];
+        }
+        ret = n;
+        goto out;
+    }
+
+    prev = malloc(sizeof(uint64_t) * (n + 1));
+    cur = malloc(sizeof(uint64_t) * (n + 1));
+    choice = malloc(sizeof(uint16_t) * (n + 1) * (classes + 1));
+    if (!prev || !cur || !choice)
+        goto out;
+    for (j = 0; j <= n; j++)
+        prev[j] = j ? UINT64_MAX : 0;
+    for (k = 1; k <= classes; k++) {
+        for (j = 0; j <= n; j++) {
+            cur[j] = UINT64_MAX;
+            for (i = k - 1; i < j; i++) {
+                if (prev[i] == UINT64_MAX
+                    || (i > 0 && tops[j] > tops[i] * ratio))
+                    continue;
+                w = prev[i] + PROFILE_WASTE(i, j);
+                if (w < cur[j]) {
+                    cur[j] = w;
+                    choice[k * (n + 1) + j] = i;
+                }
+            }
+        }
+        swap = prev;
+        prev = cur;
+        cur = swap;
+    }
+#undef PROFILE_WASTE
+    if (prev[n] == UINT64_MAX)
+        goto out;
+    *waste_fit = prev[n];
+    for (k = classes, j = n; k > 0; k--) {
+        sizes[k - 1] = tops[j];
+        j = choice[k * (n + 1) + j];
+    }
+    ret = classes;
+
+out:
+    free(counts);
+    free(sums);
+    free(tops);
+    free(cnt_sum);
+    free(byte_sum);
+    free(is_class);
+    free(prev);
+    free(cur);
+    free(choice);
+    return ret;
+}
+
+/*
+stats slab_profile
+STAT samples 1000
+STAT bytes 1064000
+STAT waste_current 129000
+STAT waste_profile 8000
+STAT 1:chunk_size 96
+...
+STAT 42:chunk_size 1048576
+END
+*/
+void slabs_profile_stats(ADD_STAT add_stats, void *c) {
+    unsigned int sizes[MAX_NUMBER_OF_SLAB_CLASSES];
+    uint64_t samples = 0, bytes = 0, waste_now = 0, waste_fit = 0;
+    char key_str[STAT_KEY_LEN];
+    char val_str[STAT_VAL_LEN];
+    int klen = 0, vlen = 0;
+    int n, i;
+
+    n = slabs_profile_fit(sizes, &samples, &bytes, &waste_now, &waste_fit);
+    APPEND_STAT("samples", "%llu", (unsigned long long)samples);
+    APPEND_STAT("bytes", "%llu", (unsigned long long)bytes);
+    APPEND_STAT("waste_current", "%llu", (unsigned long long)waste_now);
+    if (n > 0) {
+        APPEND_STAT("waste_profile", "%llu", (unsigned long long)waste_fit);
+    }
+    for (i = 0; i < n; i++) {
+        APPEND_NUM_STAT(i + 1, "chunk_size", "%u", sizes[i]);
+    }
+    add_stats(NULL, 0, NULL, 0, c);
+}
+
+/* Writes the fitted class sizes where the next start's slabs_init() will
+ * find them. Returns 0 on success, -1 with nothing sampled yet or when the
+ * file can't be written. */
+int slabs_profile_save(const char *path) {
+    unsigned int sizes[MAX_NUMBER_OF_SLAB_CLASSES];
+    uint64_t samples, bytes, waste_now, waste_fit;
+    char tmp[PATH_MAX];
+    FILE *f;
+    int n, i, err;
+
+    n = slabs_profile_fit(sizes, &samples, &bytes, &waste_now, &waste_fit);
+    if (n == 0)
+        return -1;
+    if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int)sizeof(tmp))
+        return -1;
+    if ((f = fopen(tmp, "w")) == NULL)
+        return -1;
+    fprintf(f, "# memcached slab profile: %llu allocations, %llu bytes "
+            "wasted by the current classes, %llu by these\n",
+            (unsigned long long)samples, (unsigned long long)waste_now,
+            (unsigned long long)waste_fit);
+    for (i = 0; i < n; i++)
+        fprintf(f, "%u\n", sizes[i]);
+    err = ferror(f);
+    if (fclose(f) != 0 || err || rename(tmp, path) != 0) {
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+/* Chunks handed out so far by every class, for the LRU maintainer to work
+ * out allocation rates from. One lock for all of them. */
+void slabs_alloc_counts(uint64_t *counts) {
+    unsigned int mag_chunks;
+    uint64_t mag_allocs;
+    int i;
+
+    pthread_mutex_lock(&slabs_lock);
+    for (i = 0; i < MAX_NUMBER_OF_SLAB_CLASSES; i++) {
+        slabs_mags_sum(i, &mag_chunks, NULL, &mag_allocs);
+        counts[i] = slabclass[i].allocs + mag_allocs;
+    }
+    pthread_mutex_unlock(&slabs_lock);
+}
+
+/*
+ * -o lru_engine=clock and sampled keep no LRU lists, so eviction candidates
+ * come straight out of the class's pages. As in the slab mover, holding
+ * slabs_lock is what stops a chunk from being freed, or its page moved to
+ * another class, while we look at it.
+ *
+ * With samples == 0 the class's CLOCK hand moves on by one chunk; otherwise
+ * the least recently used of that many random chunks is taken. Returns NULL
+ * if that's free, being written or in use; the caller just tries again.
+ */
+static uint64_t sample_state = 88172645463325252ULL; /* under slabs_lock */
+
+static unsigned int slabs_sample(const unsigned int total) {
+    sample_state ^= sample_state << 13;
+    sample_state ^= sample_state >> 7;
+    sample_state ^= sample_state << 17;
+    return sample_state % total;
+}
+
+static item *slabs_chunk(slabclass_t *p, const unsigned int pos) {
+    return (item *)((char *)p->slab_list[pos / p->perslab]
+                    + (size_t)(pos % p->perslab) * p->size);
+}
+
+/* Only linked items are known to have their key written. */
+#define CHUNK_LINKED(it) (((it)->it_flags & (ITEM_LINKED|ITEM_SLABBED)) == ITEM_LINKED)
+
+item *slabs_evict_candidate(const unsigned int id, const unsigned int samples,
+                            const uint32_t cur_hv, uint32_t *hv, void **hold_lock) {
+    slabclass_t *p;
+    item *it = NULL, *search;
+    unsigned int total, i;
+
+    if (id < POWER_SMALLEST || id > power_largest)
+        return NULL;
+    pthread_mutex_lock(&slabs_lock);
+    p = &slabclass[id];
+    total = p->slabs * p->perslab;
+    if (total == 0) {
+        pthread_mutex_unlock(&slabs_lock);
+        return NULL;
+    }
+    if (samples == 0) {
+        if (p->clock_hand >= total)
+            p->clock_hand = 0;
+        search = slabs_chunk(p, p->clock_hand++);
+        if (CHUNK_LINKED(search))
+            it = search;
+    } else {
+        for (i = 0; i < samples; i++) {
+            search = slabs_chunk(p, slabs_sample(total));
+            if (CHUNK_LINKED(search) && (it == NULL || search->time < it->time))
+                it = search;
+        }
+    }
+
+    if (it != NULL) {
+        *hv = ITEM_hash(it);
+        if (*hv == cur_hv || (*hold_lock = item_trylock(*hv)) == NULL) {
+            it = NULL;
+        } else if (refcount_incr(&it->refcount) != 2 ||
+                   (it->it_flags & ITEM_LINKED) == 0) {
+            /* Busy, or unlinked before we got the lock. */
+            refcount_decr(&it->refcount);
+            item_trylock_unlock(*hold_lock);
+            it = NULL;
+        }
+    }
+    pthread_mutex_unlock(&slabs_lock);
+    return it;
+}
+
 static pthread_cond_t slab_rebalance_cond = PTHREAD_COND_INITIALIZER;
 static volatile int do_run_slab_thread = 1;
 static volatile int do_run_slab_rebalance_thread = 1;
@@ -616,6 +1588,12 @@ static int slab_rebalance_start(void) { //
     slabclass_t *s_cls;
     int no_go = 0;
 
+    /* Chunks of the page we're about to take may be sitting in workers'
+     * magazines, where we wouldn't find them. */
+    if (settings.slab_magazines && slab_rebal.s_clsid >= POWER_SMALLEST
+        && slab_rebal.s_clsid <= power_largest)
+        slabs_mags_drain(slab_rebal.s_clsid);
+
     pthread_mutex_lock(&slabs_lock);
 
     if (slab_rebal.s_clsid < POWER_SMALLEST ||
@@ -637,6 +1615,7 @@ static int slab_rebalance_start(void) { //
         no_go = -3;
 
     if (no_go != 0) {
+        slabs_mags_resume();
         pthread_mutex_unlock(&slabs_lock);
         return no_go; /* Should use a wrapper function... */
     }
@@ -677,7 +1656,9 @@ static void *slab_rebalance_alloc(const size_t size, unsigned int id) {
     item *new_it = NULL;
 
     for (x = 0; x < s_cls->perslab; x++) {
-        new_it = do_slabs_alloc(size, id, NULL, SLABS_ALLOC_NO_NEWPAGE);
+        /* Keep the item on the node of the page it's leaving. */
+        new_it = do_slabs_alloc(size, id, NULL, SLABS_ALLOC_NO_NEWPAGE,
+                                slabs_node(slab_rebal.slab_start));
         /* check that memory isn't within the range to clear */
         if (new_it == NULL) {
             break;
@@ -702,7 +1683,8 @@ static void *slab_rebalance_alloc(const size_t size, unsigned int id) {
 enum move_status {
     MOVE_PASS=0, MOVE_FROM_SLAB, MOVE_FROM_LRU, 
 	MOVE_BUSY, //ʱһworker߳ڹ黹item  
-	MOVE_LOCKED
+	MOVE_LOCKED,
+	MOVE_CHUNKED /* part of a chunked item, which is evicted whole */
 };
 
 /* refcount == 0 is safe since nobody can incr while item_lock is held.
@@ -745,6 +1727,7 @@ static int slab_rebalance_move(void) {
     int refcount = 0;
     uint32_t hv;
     void *hold_lock;
+    item *head = NULL;
     enum move_status status = MOVE_PASS;
 
     pthread_mutex_lock(&slabs_lock);
@@ -769,12 +1752,14 @@ static int slab_rebalance_move(void) {
                     //ȥˣڹ黹;Сοdo_item_get  
                     //ж䣬slab_rebalance_signalΪжǸ 
             if (it->it_flags & ITEM_SLABBED) {
+                const int node = slabs_free_node(it);
                 /* remove from slab freelist */
-                if (s_cls->slots == it) {
-                    s_cls->slots = it->next;
+                if (s_cls->slots[node] == it) {
+                    s_cls->slots[node] = it->next;
                 }
                 if (it->next) it->next->prev = it->prev;
                 if (it->prev) it->prev->next = it->next;
+                s_cls->sl_free[node]--;
                 s_cls->sl_curr--;
                 status = MOVE_FROM_SLAB;
             } else if ((it->it_flags & ITEM_LINKED) != 0) {
@@ -783,7 +1768,7 @@ static int slab_rebalance_move(void) {
                  * ITEM_SLABBED, but it's had ITEM_LINKED, it must be active
                  * and have the key written to it already.
                  */
-                hv = hash(ITEM_key(it), it->nkey);
+                hv = ITEM_hash(it);
                 if ((hold_lock = item_trylock(hv)) == NULL) {
                     status = MOVE_LOCKED;
                 } else {
@@ -793,6 +1778,10 @@ static int slab_rebalance_move(void) {
                          * past a memory barrier from the mutex. *///ûworker߳item  
                         if ((it->it_flags & ITEM_LINKED) != 0) {
                             status = MOVE_FROM_LRU;
+                            if (it->it_flags & ITEM_CHUNKED) {
+                                head = it;
+                                status = MOVE_CHUNKED;
+                            }
                     } else { //worker߳item  
                             /* refcount == 1 + !ITEM_LINKED means the item is being
                              * uploaded to, or was just unlinked but hasn't been freed
@@ -812,6 +1801,22 @@ static int slab_rebalance_move(void) {
                         item_trylock_unlock(hold_lock);
                     }
                 }
+            } else if ((it->it_flags & ITEM_CHUNKED) && it->nkey == 0) {
+                /* A chunk of a chunked item's value. Its header is only
+                 * freed after its chunks, so it's still there. */
+                chunk_barrier();
+                head = ((item_chunk *)it)->head;
+                hv = ITEM_hash(head);
+                if ((hold_lock = item_trylock(hv)) == NULL) {
+                    status = MOVE_LOCKED;
+                } else if (refcount_incr(&head->refcount) == 2
+                           && (head->it_flags & ITEM_LINKED) != 0) {
+                    status = MOVE_CHUNKED;
+                } else {
+                    refcount_decr(&head->refcount);
+                    item_trylock_unlock(hold_lock);
+                    status = MOVE_BUSY;
+                }
             } else {
                 /* See above comment. No ITEM_SLABBED or ITEM_LINKED. Mark
                  * busy and wait for item to complete its upload. */
@@ -862,6 +1867,15 @@ static int slab_rebalance_move(void) {
                 }
                 item_trylock_unlock(hold_lock);
                 pthread_mutex_lock(&slabs_lock);
+                /* A -o seqlock_gets reader may have taken a reference after
+                 * we checked, since those don't need the item lock. Whoever
+                 * drops the last one frees the chunk and we pick it up from
+                 * the freelist on a later pass. */
+                if (refcount_decr(&it->refcount) != 0) {
+                    slab_rebal.busy_items++;
+                    was_busy++;
+                    break;
+                }
                 /* Always remove the ntotal, as we added it in during
                  * do_slabs_alloc() when copying the item.
                  */
@@ -873,6 +1887,17 @@ static int slab_rebalance_move(void) {
                 memcpy(ITEM_key(it), "deadbeef", 8);
 #endif
                 break;
+            case MOVE_CHUNKED:
+                /* Chunks aren't copied one at a time: unlink the item and
+                 * let item_free() put its header and chunks on the freelist,
+                 * where a second pass over the page picks them up. */
+                pthread_mutex_unlock(&slabs_lock);
+                do_item_unlink(head, hv);
+                do_item_remove(head);
+                item_trylock_unlock(hold_lock);
+                pthread_mutex_lock(&slabs_lock);
+                slab_rebal.busy_items++;
+                break;
             case MOVE_BUSY:
             case MOVE_LOCKED:
                 slab_rebal.busy_items++;//¼Ƿвϴitem  
@@ -920,6 +1945,10 @@ static void slab_rebalance_finish(void) {
     uint32_t evictions_nomem;
     uint32_t inline_reclaim;
 
+    /* A lock-free get may still be reading an item header on this page,
+     * which is about to be carved up for another class. */
+    item_read_quiesce();
+
     pthread_mutex_lock(&slabs_lock);
 
     s_cls = &slabclass[slab_rebal.s_clsid];
@@ -972,6 +2001,7 @@ static void slab_rebalance_finish(void) {
     slab_rebal.evictions_nomem    = 0;
     slab_rebal.inline_reclaim = 0;
     slab_rebal.rescues  = 0;
+    slabs_mags_resume();
 
     slab_rebalance_signal = 0; //rebalance߳ɹٴν״̬  
 
@@ -20,7 +20,9 @@ unsigned int slabs_clsid(const size_t size);
 
 /** Allocate object of given length. 0 on error */ /*@null@*/
 #define SLABS_ALLOC_NO_NEWPAGE 1
-void *slabs_alloc(const size_t size, unsigned int id, unsigned int *total_chunks, unsigned int flags);
+/* node is the -o numa node to take memory from, -1 for the calling worker's */
+void *slabs_alloc(const size_t size, unsigned int id, unsigned int *total_chunks,
+                  unsigned int flags, int node);
 
 /** Free previously allocated object */
 void slabs_free(void *ptr, size_t size, unsigned int id);
@@ -37,6 +39,25 @@ void slabs_stats(ADD_STAT add_stats, void *c);
 /* Hints as to freespace in slab class */
 unsigned int slabs_available_chunks(unsigned int id, bool *mem_flag, unsigned int *total_chunks, unsigned int *chunks_perslab);
 
+/* -o slab_magazines: a worker's per-class caches of free chunks. */
+struct slab_mags *slabs_mags_create(void);
+
+/* -o numa: the node arena a chunk is in, -1 without node arenas. */
+int slabs_node(const void *ptr);
+
+/* Allocations so far, per class (MAX_NUMBER_OF_SLAB_CLASSES entries) */
+void slabs_alloc_counts(uint64_t *counts);
+
+/* -o slab_profile: class sizes fitted to the sizes allocated so far, as
+ * "stats slab_profile" and as the file the next start reads them from. */
+void slabs_profile_stats(ADD_STAT add_stats, void *c);
+int slabs_profile_save(const char *path);
+
+/* Eviction candidate for -o lru_engine=clock (samples == 0) or sampled.
+ * Returned linked, item locked and with a reference held. */
+item *slabs_evict_candidate(const unsigned int id, const unsigned int samples,
+                            const uint32_t cur_hv, uint32_t *hv, void **hold_lock);
+
 int start_slab_maintenance_thread(void);
 void stop_slab_maintenance_thread(void);
 
@@ -0,0 +1,66 @@
+#!/usr/bin/perl
+# -o expiry_wheel frees items the second they expire, without anyone asking
+# for them. Store a batch of short lived keys next to some that don't expire,
+# touch and replace a few, and make sure only the expired ones disappear.
+
+use strict;
+use Test::More tests => 15;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+{
+    my $server = new_memcached();
+    my $settings = mem_stats($server->sock, "settings");
+    is($settings->{expiry_wheel}, "no", "expiry_wheel off by default");
+    my $stats = mem_stats($server->sock);
+    ok(!exists $stats->{expiry_wheel_entries}, "no wheel stats without it");
+}
+
+my $server = new_memcached("-o expiry_wheel");
+my $sock = $server->sock;
+
+my $settings = mem_stats($sock, "settings");
+is($settings->{expiry_wheel}, "yes", "expiry_wheel on");
+
+my $errors = 0;
+for my $key (0 .. 99) {
+    print $sock "set short$key 0 1 5\r\nhello\r\n";
+    $errors++ unless scalar <$sock> eq "STORED\r\n";
+}
+for my $key (0 .. 9) {
+    print $sock "set long$key 0 0 5\r\nhello\r\n";
+    $errors++ unless scalar <$sock> eq "STORED\r\n";
+}
+is($errors, 0, "stored everything");
+
+# A touch moves the key to a later slot; a replace drops its TTL.
+print $sock "touch short0 100\r\n";
+is(scalar <$sock>, "TOUCHED\r\n", "touched short0");
+print $sock "set short1 0 0 5\r\nworld\r\n";
+is(scalar <$sock>, "STORED\r\n", "replaced short1 without a TTL");
+
+# Overwriting a key over and over mustn't pile up entries for it.
+for (0 .. 49) {
+    print $sock "set churn 0 100 5\r\nhello\r\n";
+    $errors++ unless scalar <$sock> eq "STORED\r\n";
+}
+
+my $stats = mem_stats($sock);
+is($stats->{expiry_wheel_entries}, 100, "one entry per item with a TTL");
+cmp_ok($stats->{expiry_wheel_bytes}, '>', 100 * 16, "wheel memory reported");
+
+# Wait for the maintainer to turn the wheel without reading anything.
+for (0 .. 5) {
+    sleep 1;
+    $stats = mem_stats($sock);
+    last if $stats->{curr_items} == 13;
+}
+is($stats->{curr_items}, 13, "expired items freed without being fetched");
+is($stats->{expiry_wheel_reclaimed}, 98, "wheel counted what it freed");
+is($stats->{expiry_wheel_entries}, 2, "only the touched and churned keys are left");
+is($stats->{expired_unfetched}, 0, "nothing left for the LRU tail to find");
+
+mem_get_is($sock, "short0", "hello", "touched key survived");
+mem_get_is($sock, "short1", "world", "replaced key survived");
+mem_get_is($sock, "long0", "hello", "key without a TTL survived");
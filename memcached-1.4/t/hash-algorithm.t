@@ -0,0 +1,42 @@
+#!/usr/bin/perl
+# Every hash_algorithm has to agree with itself between the single key path
+# (sets) and the batched one multigets use (hash_batch).
+
+use strict;
+use Test::More tests => 16;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+foreach my $algo (qw(jenkins murmur3 wyhash crc32c)) {
+    my $server = new_memcached("-o hash_algorithm=$algo");
+    my $sock = $server->sock;
+
+    my $settings = mem_stats($sock, "settings");
+    is($settings->{hash_algorithm}, $algo, "$algo: in use");
+
+    # Lengths from empty-ish to well past a few words, so the hashes' tail
+    # handling gets exercised along with the full blocks.
+    my @keys = map { "k$_" . ("x" x ($_ * 7 % 190)) } (1 .. 60);
+    for my $key (@keys) {
+        print $sock "set $key 0 0 1 noreply\r\na\r\n";
+    }
+    mem_get_is($sock, $keys[-1], "a");
+
+    # Windows of up to 23 keys, so the batch sees both full and partial
+    # groups.
+    my $found = 0;
+    for (my $i = 0; $i < @keys; $i += 23) {
+        my @window = @keys[$i .. ($i + 22 < $#keys ? $i + 22 : $#keys)];
+        print $sock "get @window\r\n";
+        while (my $line = <$sock>) {
+            last if $line eq "END\r\n";
+            $found++;
+            <$sock>;
+        }
+    }
+    is($found, scalar @keys, "$algo: multigets find every key");
+
+    my $stats = mem_stats($sock);
+    is($stats->{curr_items}, scalar @keys, "$algo: no duplicates stored");
+}
@@ -0,0 +1,89 @@
+#!/usr/bin/perl
+
+use strict;
+use Test::More tests => 14;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+my $server = new_memcached('-m 64 -o hash_engine=bucketed,hashpower=13');
+my $sock = $server->sock;
+
+{
+    my $stats = mem_stats($sock, "settings");
+    is($stats->{hash_engine}, "bucketed", "bucketed hash engine selected");
+    like($stats->{hash_tag_match}, qr/^(sse2|scalar)$/, "tag matcher picked");
+}
+
+my $stats = mem_stats($sock);
+is($stats->{hash_power_level}, 13, "starting hash power level");
+my $start_bytes = $stats->{hash_bytes};
+
+# Enough keys to overflow buckets and force at least one expansion.
+my $keys = 30000;
+my $stored = 0;
+for my $key (1 .. $keys) {
+    my $val = "value$key";
+    print $sock "set key$key 0 0 " . length($val) . "\r\n$val\r\n";
+    $stored++ if scalar <$sock> eq "STORED\r\n";
+}
+is($stored, $keys, "stored all keys");
+
+# Expansion runs in the background; give it a moment to finish.
+for (1 .. 10) {
+    $stats = mem_stats($sock);
+    last if $stats->{hash_is_expanding} == 0;
+    sleep 1;
+}
+cmp_ok($stats->{hash_power_level}, '>', 13, "hash table expanded");
+cmp_ok($stats->{hash_bytes}, '>', $start_bytes, "hash_bytes grew");
+is($stats->{curr_items}, $keys, "all items accounted for");
+
+my $found = 0;
+for my $key (1 .. $keys) {
+    print $sock "get key$key\r\n";
+    my $line = <$sock>;
+    if ($line =~ /^VALUE key$key 0 \d+\r\n$/) {
+        $found++ if scalar <$sock> eq "value$key\r\n";
+        <$sock>;
+    }
+}
+is($found, $keys, "found every key after expansion");
+
+# Deleting out of both the slots and the overflow chains.
+my $deleted = 0;
+for (my $key = 1; $key <= $keys; $key += 2) {
+    print $sock "delete key$key\r\n";
+    $deleted++ if scalar <$sock> eq "DELETED\r\n";
+}
+is($deleted, $keys / 2, "deleted every other key");
+
+my $missing = 0;
+my $left = 0;
+for my $key (1 .. $keys) {
+    print $sock "get key$key\r\n";
+    my $line = <$sock>;
+    if ($line eq "END\r\n") {
+        $missing++;
+    } else {
+        $left++;
+        <$sock>; <$sock>;
+    }
+}
+is($missing, $keys / 2, "deleted keys are gone");
+is($left, $keys / 2, "remaining keys still found");
+
+# Slots freed by deletes get reused.
+print $sock "set key1 0 0 6\r\nvalue1\r\n";
+is(scalar <$sock>, "STORED\r\n", "reinserted a deleted key");
+
+# The tag compare can be forced instead of timed at startup.
+{
+    my $server = new_memcached('-o hash_engine=bucketed,hash_tag_match=scalar');
+    my $stats = mem_stats($server->sock, "settings");
+    is($stats->{hash_tag_match}, "scalar", "forced scalar tag matcher");
+}
+eval {
+    new_memcached('-o hash_engine=bucketed,hash_tag_match=avx');
+};
+ok($@ && $@ =~ m/^Failed/, "unknown tag matcher refused");
@@ -0,0 +1,67 @@
+#!/usr/bin/perl
+# Grow the hash table while several clients keep mutating it, and make sure
+# nothing gets lost across the table swap or the bucket migration.
+
+use strict;
+use Test::More tests => 14;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+my $clients = 4;
+my $keys = 20000;
+
+foreach my $engine (qw(chained bucketed)) {
+    my $server = new_memcached("-m 256 -t 8 -o hashpower=14,hash_engine=$engine");
+    my $sock = $server->sock;
+
+    my $stats = mem_stats($sock);
+    is($stats->{hash_power_level}, 14, "$engine: starting hash power level");
+
+    # Each client only checks its own keys, so the result doesn't depend on
+    # how the clients interleave.
+    my $failed = run_clients($server, $clients, sub {
+        my ($csock, $client) = @_;
+        my $errors = 0;
+        for my $i (1 .. $keys) {
+            my $val = "v$client.$i";
+            print $csock "set c$client:$i 0 0 " . length($val) . "\r\n$val\r\n";
+            $errors++ unless scalar <$csock> eq "STORED\r\n";
+            if ($i % 3 == 0) {
+                my $j = $i - 1;
+                print $csock "delete c$client:$j\r\n";
+                $errors++ unless scalar <$csock> eq "DELETED\r\n";
+            }
+        }
+        for my $i (1 .. $keys) {
+            print $csock "get c$client:$i\r\n";
+            my $line = <$csock>;
+            if ($i % 3 == 2 && $i < $keys) {
+                $errors++ unless $line eq "END\r\n";
+                next;
+            }
+            if ($line =~ /^VALUE /) {
+                $errors++ unless scalar <$csock> eq "v$client.$i\r\n";
+                <$csock>;
+            } else {
+                $errors++;
+            }
+        }
+        return $errors;
+    });
+    is($failed, 0, "$engine: every client saw consistent results");
+
+    for (1 .. 10) {
+        $stats = mem_stats($sock);
+        last if $stats->{hash_is_expanding} == 0;
+        sleep 1;
+    }
+    is($stats->{hash_is_expanding}, 0, "$engine: expansion finished");
+    cmp_ok($stats->{hash_power_level}, '>', 14, "$engine: hash table grew");
+    cmp_ok($stats->{hash_expansions}, '>=', 1, "$engine: expansions counted");
+    is($stats->{hash_expand_buckets}, 2 ** ($stats->{hash_power_level} - 1),
+       "$engine: every old bucket migrated");
+
+    my $live = $clients * ($keys - int($keys / 3));
+    is($stats->{curr_items}, $live, "$engine: item count matches");
+}
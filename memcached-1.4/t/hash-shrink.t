@@ -0,0 +1,92 @@
+#!/usr/bin/perl
+
+use strict;
+use Test::More tests => 21;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+my $keys = 30000;
+my $keep = 1000;
+
+sub wait_for_migration {
+    my $sock = shift;
+    my $stats;
+    for (1 .. 10) {
+        $stats = mem_stats($sock);
+        last if $stats->{hash_is_expanding} == 0;
+        sleep 1;
+    }
+    return $stats;
+}
+
+foreach my $engine (qw(chained bucketed)) {
+    my $server = new_memcached("-m 64 -o hashpower=13,hash_engine=$engine,hash_shrink_load=0.25");
+    my $sock = $server->sock;
+
+    {
+        my $settings = mem_stats($sock, "settings");
+        is($settings->{hash_shrink_load}, "0.25", "$engine: shrink load set");
+    }
+
+    for my $key (1 .. $keys) {
+        print $sock "set key$key 0 0 1 noreply\r\na\r\n";
+    }
+    mem_get_is($sock, "key$keys", "a");
+
+    my $grown = wait_for_migration($sock);
+    cmp_ok($grown->{hash_power_level}, '>', 13, "$engine: hash table grew");
+
+    for my $key ($keep + 1 .. $keys) {
+        print $sock "delete key$key noreply\r\n";
+    }
+    mem_get_is($sock, "key$keys", undef);
+
+    my $stats;
+    for (1 .. 10) {
+        $stats = wait_for_migration($sock);
+        last if $stats->{hash_power_level} == 13;
+        sleep 1;
+    }
+    is($stats->{hash_power_level}, 13, "$engine: shrunk back to the starting size");
+    cmp_ok($stats->{hash_shrinks}, '>=', 1, "$engine: shrink counted");
+    cmp_ok($stats->{hash_bytes}, '<', $grown->{hash_bytes}, "$engine: hash_bytes went down");
+    is($stats->{curr_items}, $keep, "$engine: remaining items counted");
+
+    my $found = 0;
+    for my $key (1 .. $keep) {
+        print $sock "get key$key\r\n";
+        if (scalar <$sock> =~ /^VALUE key$key /) {
+            $found++;
+            <$sock>; <$sock>;
+        }
+    }
+    is($found, $keep, "$engine: remaining keys survived the shrink");
+}
+
+# Items that go all at once, like after a flush_all, only leave the table as
+# the crawler finds them. The table keeps halving after that until it's
+# back at the starting size.
+{
+    my $server = new_memcached("-m 64 -o hashpower=13,hash_shrink_load=0.25,lru_crawler");
+    my $sock = $server->sock;
+
+    for my $key (1 .. $keys) {
+        print $sock "set key$key 0 2 1 noreply\r\na\r\n";
+    }
+    mem_get_is($sock, "key1", "a");
+    my $grown = wait_for_migration($sock);
+    cmp_ok($grown->{hash_power_level}, '>', 14, "grew more than one size");
+
+    sleep 3;
+    print $sock "lru_crawler crawl all\r\n";
+    <$sock>;
+
+    my $stats;
+    for (1 .. 10) {
+        $stats = wait_for_migration($sock);
+        last if $stats->{hash_power_level} == 13;
+        sleep 1;
+    }
+    is($stats->{hash_power_level}, 13, "crawled out items shrink it all the way");
+}
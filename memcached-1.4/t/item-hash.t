@@ -0,0 +1,71 @@
+#!/usr/bin/perl
+# With -o item_hash the background paths use the hash cached in the item
+# header instead of rehashing the key. Run each of them once and make sure
+# they still find and lock the right items.
+
+use strict;
+use warnings;
+use Test::More tests => 19;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+foreach my $engine (qw(chained bucketed)) {
+    my $server = new_memcached("-m 8 -o item_hash,slab_reassign,hash_engine=$engine,hashpower=13");
+    my $sock = $server->sock;
+
+    my $settings = mem_stats($sock, "settings");
+    is($settings->{item_hash}, "yes", "$engine: item_hash enabled");
+
+    # Evictions through lru_pull_tail(), and enough items to grow the table.
+    my $data = 'x' x 100;
+    for my $i (1 .. 60000) {
+        print $sock "set ev$i 0 0 100 noreply\r\n$data\r\n";
+    }
+    mem_get_is($sock, "ev60000", $data);
+    my $stats = mem_stats($sock);
+    cmp_ok($stats->{evictions}, '>', 0, "$engine: evicted");
+    cmp_ok($stats->{hash_power_level}, '>', 13, "$engine: table grew");
+
+    # The crawler reclaims expired items. The immortal ones keep the class
+    # listed in "stats items" once the rest are gone.
+    for my $i (1 .. 10) {
+        print $sock "set keep$i 0 0 2 noreply\r\nok\r\n";
+    }
+    for my $i (1 .. 50) {
+        print $sock "set short$i 0 1 2 noreply\r\nok\r\n";
+    }
+    mem_get_is($sock, "short50", "ok");
+    sleep 2;
+    print $sock "lru_crawler enable\r\n";
+    is(scalar <$sock>, "OK\r\n", "$engine: crawler enabled");
+    print $sock "lru_crawler crawl 1\r\n";
+    is(scalar <$sock>, "OK\r\n", "$engine: crawl started");
+    for (1 .. 10) {
+        $stats = mem_stats($sock);
+        last unless $stats->{lru_crawler_running};
+        sleep 1;
+    }
+    my $items = mem_stats($sock, "items");
+    is($items->{"items:1:crawler_reclaimed"}, 50, "$engine: crawler reclaimed expired items");
+
+    # And items still in the slab being moved get unlinked by it.
+    my $slabs = mem_stats($sock, "slabs");
+    my ($src) = map { /^(\d+):/ } grep { /^\d+:total_pages$/ && $slabs->{$_} > 1 } keys %$slabs;
+    for my $try (1 .. 10) {
+        print $sock "slabs reassign $src 0\r\n";
+        last if scalar <$sock> eq "OK\r\n";
+        sleep 1;
+    }
+    for (1 .. 10) {
+        $stats = mem_stats($sock);
+        last unless $stats->{slab_reassign_running};
+        sleep 1;
+    }
+    cmp_ok($stats->{slabs_moved}, '>=', 1, "$engine: slab page moved");
+}
+
+# Without the option the header hash isn't trusted, and nothing changes.
+my $server = new_memcached();
+my $settings = mem_stats($server->sock, "settings");
+is($settings->{item_hash}, "no", "item_hash off by default");
@@ -0,0 +1,76 @@
+#!/usr/bin/perl
+# "stats locks" reports item lock contention, and -o item_lock_grow_waits
+# doubles the lock table while the server is running. Hammer a handful of
+# keys from several connections with the lowest threshold and make sure the
+# table stays within its limit and every key is still intact afterwards.
+
+use strict;
+use Test::More tests => 16;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+my $clients = 4;
+my $rounds = 3000;
+
+{
+    my $server = new_memcached("-t 4");
+    my $settings = mem_stats($server->sock, "settings");
+    is($settings->{item_lock_grow_waits}, 0, "item_lock_grow_waits off by default");
+    my $locks = mem_stats($server->sock, "locks");
+    is($locks->{item_lock_hashpower}, 12, "four workers get 4096 locks");
+    is($locks->{item_locks}, 4096, "item_locks matches the hashpower");
+    is($locks->{item_lock_resizes}, 0, "no resizes yet");
+    ok(exists $locks->{item_lock_waits} && exists $locks->{item_lock_wait_us}
+       && exists $locks->{item_trylock_fails}, "contention counters reported");
+}
+
+my $server = new_memcached("-t 4 -o item_lock_grow_waits=1,hashpower=14");
+my $sock = $server->sock;
+
+my $settings = mem_stats($sock, "settings");
+is($settings->{item_lock_grow_waits}, 1, "item_lock_grow_waits set");
+
+my $locks = mem_stats($sock, "locks");
+is($locks->{item_lock_hashpower_max}, 13, "locks may grow to hashpower - 1");
+
+print $sock "set foo 0 0 3\r\nbar\r\n";
+is(scalar <$sock>, "STORED\r\n", "stored foo");
+print $sock "set num 0 0 1\r\n0\r\n";
+is(scalar <$sock>, "STORED\r\n", "stored num");
+
+my $failed = run_clients($server, $clients, sub {
+    my ($csock, $client) = @_;
+    my $errors = 0;
+    for my $i (1 .. $rounds) {
+        # Everyone fights over the same few keys.
+        my $key = "hot" . ($i % 8);
+        print $csock "set $key 0 0 " . length("$client.$i") . "\r\n$client.$i\r\n";
+        $errors++ unless scalar <$csock> eq "STORED\r\n";
+        print $csock "incr num 1\r\n";
+        $errors++ unless scalar <$csock> =~ /^\d+\r\n$/;
+        print $csock "get $key foo\r\n";
+        while (my $line = <$csock>) {
+            last if $line eq "END\r\n";
+            my ($got, $len) = $line =~ /^VALUE (\S+) 0 (\d+)\r\n$/;
+            my $data = <$csock>;
+            $errors++ unless defined $got && length($data) == $len + 2;
+        }
+    }
+    return $errors;
+});
+is($failed, 0, "every client saw consistent results");
+
+# Give the clock a chance to act on the last second's waits.
+sleep(2);
+
+mem_get_is($sock, "foo", "bar");
+print $sock "get num\r\n";
+is(scalar <$sock>, "VALUE num 0 5\r\n", "num header");
+is(scalar <$sock>, $clients * $rounds . "\r\n", "every incr landed");
+is(scalar <$sock>, "END\r\n", "num end");
+
+$locks = mem_stats($sock, "locks");
+cmp_ok($locks->{item_lock_hashpower}, '<=', 13, "lock table within its limit");
+is($locks->{item_locks}, 1 << $locks->{item_lock_hashpower},
+   "item_locks follows resizes");
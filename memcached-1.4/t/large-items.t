@@ -0,0 +1,108 @@
+#!/usr/bin/perl
+# -o large_item_max stores values past item_size_max as a header plus a chain
+# of chunks from the largest slab class. Store a few MB through both paths
+# that read values in, read them back whole, and make sure the chunks are
+# given back when the items go.
+
+use strict;
+use Test::More tests => 18;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+# Numbered so a chunk read back out of order can't go unnoticed.
+my $value = join("", map { sprintf("%07d,", $_) } 0 .. (5 * 1024 * 1024 / 8 - 1));
+my $len = length($value);
+
+sub get_big {
+    my ($sock, $key) = @_;
+    print $sock "get $key\r\n";
+    my $line = <$sock>;
+    return undef unless $line =~ /^VALUE \S+ \d+ (\d+)\r\n$/;
+    my $got = '';
+    while (length($got) < $1 + 2) {
+        read($sock, $got, $1 + 2 - length($got), length($got)) or last;
+    }
+    my $end = <$sock>;
+    return undef unless $end eq "END\r\n";
+    return substr($got, 0, $1);
+}
+
+{
+    my $server = new_memcached();
+    my $sock = $server->sock;
+    my $settings = mem_stats($sock, "settings");
+    is($settings->{large_item_max}, 0, "large_item_max off by default");
+    print $sock "set big 0 0 $len\r\n$value\r\n";
+    is(scalar <$sock>, "SERVER_ERROR object too large for cache\r\n",
+       "too large without it");
+}
+
+eval {
+    new_memcached("-o large_item_max=512k");
+};
+ok($@ && $@ =~ m/^Failed/, "must be larger than -I");
+
+my $server = new_memcached("-m 64 -o large_item_max=8m,lru_crawler");
+my $sock = $server->sock;
+
+my $settings = mem_stats($sock, "settings");
+is($settings->{large_item_max}, 8 * 1024 * 1024, "large_item_max set");
+
+print $sock "set big 0 0 $len\r\n$value\r\n";
+is(scalar <$sock>, "STORED\r\n", "stored a 5MB value");
+ok(get_big($sock, "big") eq $value, "got it back whole");
+
+print $sock "lru_crawler metadump all\r\n";
+my $dumped = 0;
+while (my $line = <$sock>) {
+    last if $line eq "END\r\n";
+    $dumped = $1 if $line =~ /^key=big .* size=(\d+)\n$/;
+}
+cmp_ok($dumped, '>', $len, "metadump size counts the chunks");
+
+my $stats = mem_stats($sock);
+cmp_ok($stats->{bytes}, '>', $len, "chunks counted in bytes");
+
+print $sock "append big 0 0 4\r\ntail\r\n";
+is(scalar <$sock>, "STORED\r\n", "appended to it");
+ok(get_big($sock, "big") eq $value . "tail", "appended value intact");
+
+print $sock "incr big 1\r\n";
+is(scalar <$sock>, "CLIENT_ERROR cannot increment or decrement non-numeric value\r\n",
+   "no incr on a chunked value");
+
+my $toobig = 9 * 1024 * 1024;
+print $sock "set huge 0 0 $toobig\r\n", "B" x $toobig, "\r\n";
+is(scalar <$sock>, "SERVER_ERROR object too large for cache\r\n",
+   "still capped at large_item_max");
+
+# The binary protocol reads values in through the same path. A connection
+# speaks one protocol, so this needs one of its own.
+my $bvalue = "B" x (3 * 1024 * 1024);
+my $blen = length($bvalue);
+my $bsock = $server->new_sock;
+print $bsock pack("CCnCCnNNNN", 0x80, 0x01, 4, 8, 0, 0, 8 + 4 + $blen, 0, 0, 0),
+    pack("NN", 0, 0), "bbig", $bvalue;
+my $header;
+read($bsock, $header, 24);
+my (undef, undef, undef, undef, undef, $status, $bodylen) = unpack("CCnCCnN", $header);
+is($status, 0, "binary set of a 3MB value");
+read($bsock, my $junk, $bodylen) if $bodylen;
+ok(get_big($sock, "bbig") eq $bvalue, "binary value read back");
+
+print $sock "delete big\r\n";
+is(scalar <$sock>, "DELETED\r\n", "deleted");
+print $sock "delete bbig\r\n";
+is(scalar <$sock>, "DELETED\r\n", "deleted");
+$stats = mem_stats($sock);
+is($stats->{bytes}, 0, "chunks given back");
+
+# More than fits: older values get evicted whole to make room.
+my $errors = 0;
+for my $key (0 .. 19) {
+    print $sock "set big$key 0 0 $len\r\n$value\r\n";
+    $errors++ unless scalar <$sock> eq "STORED\r\n";
+}
+ok($errors == 0 && get_big($sock, "big19") eq $value,
+   "evicted to make room for new ones");
@@ -4,6 +4,7 @@ use IO::Socket::INET;
 use IO::Socket::UNIX;
 use Exporter 'import';
 use Carp qw(croak);
+use POSIX qw(_exit);
 use vars qw(@EXPORT);
 
 # Instead of doing the substitution with Autoconf, we assume that
@@ -13,7 +14,7 @@ my $builddir = getcwd;
 
 
 @EXPORT = qw(new_memcached sleep mem_get_is mem_gets mem_gets_is mem_stats
-             supports_sasl free_port);
+             supports_sasl free_port run_clients);
 
 sub sleep {
     my $n = shift;
@@ -136,6 +137,33 @@ sub free_port {
     return $port;
 }
 
+# Runs $code in $count forked clients, each on its own connection to
+# $server. $code gets the socket and the client's number (from 1) and returns
+# how many errors it saw. Returns how many clients saw any.
+sub run_clients {
+    my ($server, $count, $code) = @_;
+    my @pids;
+    for my $client (1 .. $count) {
+        my $pid = fork();
+        croak("fork failed: $!") unless defined $pid;
+        if ($pid == 0) {
+            my $sock = $server->new_sock;
+            my $errors = $code->($sock, $client);
+            close($sock);
+            # _exit() so the child doesn't run the server's destructor.
+            _exit($errors > 250 ? 250 : $errors);
+        }
+        push(@pids, $pid);
+    }
+
+    my $failed = 0;
+    for my $pid (@pids) {
+        waitpid($pid, 0);
+        $failed++ if $? != 0;
+    }
+    return $failed;
+}
+
 sub supports_udp {
     my $output = `$builddir/memcached-debug -h`;
     return 0 if $output =~ /^memcached 1\.1\./;
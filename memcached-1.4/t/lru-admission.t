@@ -0,0 +1,56 @@
+#!/usr/bin/perl
+# With -o lru_admission a new item only gets to evict the COLD tail when its
+# key has been asked for at least as often. Read a few keys repeatedly, then
+# run a one-off scan of new keys through a full cache and make sure the scan
+# is refused instead of flushing the hot keys out.
+
+use strict;
+use Test::More tests => 15;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+{
+    my $server = new_memcached();
+    my $settings = mem_stats($server->sock, "settings");
+    is($settings->{lru_admission}, "no", "lru_admission off by default");
+}
+
+my $server = new_memcached("-m 6 -o lru_admission");
+my $sock = $server->sock;
+
+my $settings = mem_stats($sock, "settings");
+is($settings->{lru_admission}, "yes", "lru_admission on");
+
+my $value = "B"x66560;
+
+for my $key (0 .. 4) {
+    print $sock "set hot$key 0 0 66560\r\n$value\r\n";
+    is(scalar <$sock>, "STORED\r\n", "stored hot$key");
+}
+
+for (1 .. 3) {
+    for my $key (0 .. 4) {
+        print $sock "get hot$key\r\n";
+        while (my $line = <$sock>) {
+            last if $line eq "END\r\n";
+        }
+    }
+}
+
+my $refused = 0;
+for my $key (0 .. 99) {
+    print $sock "set scan$key 0 0 66560\r\n$value\r\n";
+    my $res = scalar <$sock>;
+    $refused++ if $res eq "SERVER_ERROR out of memory storing object\r\n";
+}
+
+isnt($refused, 0, "some of the scan was refused");
+my $stats = mem_stats($sock);
+is($stats->{admission_rejects}, $refused, "every refusal counted");
+$stats = mem_stats($sock, "items");
+is($stats->{"items:31:outofmemory"}, 0, "refusals aren't counted as OOM");
+
+for my $key (0 .. 4) {
+    mem_get_is($sock, "hot$key", $value, "hot$key survived the scan");
+}
@@ -0,0 +1,67 @@
+#!/usr/bin/perl
+# With -o lru_bump_buffers gets hand their LRU bumps to the maintainer
+# thread through a ring per worker. Push an item down into COLD, hit it and
+# make sure the maintainer moves it back up to WARM before it's evicted.
+
+use strict;
+use Test::More tests => 113;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+{
+    my $server = new_memcached();
+    my $settings = mem_stats($server->sock, "settings");
+    is($settings->{lru_bump_buffers}, "no", "lru_bump_buffers off by default");
+}
+
+{
+    # Without the segmented LRU the thread only drains the rings.
+    my $server = new_memcached("-o lru_bump_buffers");
+    my $sock = $server->sock;
+    my $settings = mem_stats($sock, "settings");
+    is($settings->{lru_bump_buffers}, "yes", "lru_bump_buffers on");
+    is($settings->{lru_maintainer_thread}, "no", "LRU isn't segmented");
+    print $sock "set foo 0 0 3\r\nbar\r\n";
+    is(scalar <$sock>, "STORED\r\n", "stored foo");
+    mem_get_is($sock, "foo", "bar");
+    my $stats = mem_stats($sock, "items");
+    is($stats->{"items:1:bumps_dropped"}, 0, "nothing dropped");
+}
+
+my $server = new_memcached("-m 6 -o lru_maintainer,lru_bump_buffers");
+my $sock = $server->sock;
+
+my $value = "B"x66560;
+
+print $sock "set canary 0 0 66560\r\n$value\r\n";
+is(scalar <$sock>, "STORED\r\n", "stored canary key");
+
+my $stats;
+for (my $key = 0; $key < 100; $key++) {
+    if ($key == 30) {
+        for (0..2) {
+            $stats = mem_stats($sock, "items");
+            if ($stats->{"items:31:moves_to_cold"} == 0) { sleep 1; next; }
+            last;
+        }
+        isnt($stats->{"items:31:moves_to_cold"}, 0, "moved some items to cold");
+        # A hit queues the canary for a move back up to WARM.
+        mem_get_is($sock, "canary", $value);
+        for (0..2) {
+            $stats = mem_stats($sock, "items");
+            if ($stats->{"items:31:bumps_drained"} == 0) { sleep 1; next; }
+            last;
+        }
+        isnt($stats->{"items:31:bumps_drained"}, 0, "maintainer drained the bump");
+    }
+    print $sock "set key$key 0 0 66560\r\n$value\r\n";
+    is(scalar <$sock>, "STORED\r\n", "stored key$key");
+}
+
+$stats = mem_stats($sock);
+isnt($stats->{evictions}, 0, "some evictions happened");
+mem_get_is($sock, "canary", $value);
+
+$stats = mem_stats($sock, "items");
+is($stats->{"items:31:bumps_dropped"}, 0, "no bumps dropped");
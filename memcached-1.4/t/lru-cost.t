@@ -0,0 +1,68 @@
+#!/usr/bin/perl
+# Stores take an optional "cost=<n>" hint, and with -o lru_cost the COLD tail
+# sends costly items round again for lru_cost seconds per unit of cost.
+# Check the token is parsed, then overfill a class where every tenth key is
+# costly and make sure those are the ones left.
+
+use strict;
+use Test::More tests => 14;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+{
+    my $server = new_memcached();
+    my $sock = $server->sock;
+    my $settings = mem_stats($sock, "settings");
+    is($settings->{lru_cost}, 0, "lru_cost off by default");
+
+    print $sock "set foo 0 0 3 cost=7\r\nbar\r\n";
+    is(scalar <$sock>, "STORED\r\n", "cost accepted without lru_cost");
+    mem_get_is($sock, "foo", "bar");
+    print $sock "set foo 0 0 3 cost=9999 noreply\r\nbaz\r\n";
+    mem_get_is($sock, "foo", "baz", "big cost clamped, with noreply");
+    print $sock "set foo 0 0 3 cost=x\r\n";
+    is(scalar <$sock>, "CLIENT_ERROR bad command line format\r\n",
+       "cost must be a number");
+    print $sock "set foo 0 0 3 bogus extra\r\n";
+    is(scalar <$sock>, "CLIENT_ERROR bad command line format\r\n",
+       "only cost may come before noreply");
+
+    print $sock "gets foo\r\n";
+    my $line = <$sock>;
+    my ($cas) = $line =~ /^VALUE foo 0 3 (\d+)\r\n$/;
+    <$sock>; <$sock>;
+    print $sock "cas foo 0 0 3 $cas cost=3\r\nqux\r\n";
+    is(scalar <$sock>, "STORED\r\n", "cost after the cas unique");
+    mem_get_is($sock, "foo", "qux");
+}
+
+my $server = new_memcached("-m 6 -o lru_cost=3600");
+my $sock = $server->sock;
+
+my $settings = mem_stats($sock, "settings");
+is($settings->{lru_cost}, 3600, "lru_cost set");
+
+my $value = "B"x66560;
+my $errors = 0;
+for my $key (0 .. 249) {
+    my $cost = ($key < 100 && $key % 10 == 0) ? " cost=255" : "";
+    print $sock "set key$key 0 0 66560$cost\r\n$value\r\n";
+    $errors++ unless scalar <$sock> eq "STORED\r\n";
+}
+is($errors, 0, "stored everything");
+
+my $stats = mem_stats($sock, "items");
+isnt($stats->{"items:31:evicted"}, 0, "some evictions happened");
+cmp_ok($stats->{"items:31:cost_spared"}, '>', 0, "costly items sent round");
+
+my ($costly, $cheap) = (0, 0);
+for my $key (0 .. 99) {
+    print $sock "get key$key\r\n";
+    my $line = <$sock>;
+    next if $line eq "END\r\n";
+    <$sock>; <$sock>;
+    if ($key % 10 == 0) { $costly++ } else { $cheap++ }
+}
+cmp_ok($costly, '>=', 8, "costly keys survived");
+is($cheap, 0, "cheap keys of the same age are gone");
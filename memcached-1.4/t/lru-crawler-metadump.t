@@ -0,0 +1,86 @@
+#!/usr/bin/perl
+# "lru_crawler metadump" streams a line per live item to the client from a
+# crawler thread. Dump a few classes, leave a big dump unread for a while to
+# make sure other clients still get served, and check the connection takes
+# commands again once the dump is over.
+
+use strict;
+use Test::More tests => 16;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+{
+    my $server = new_memcached();
+    my $sock = $server->sock;
+    print $sock "lru_crawler metadump all\r\n";
+    is(scalar <$sock>, "CLIENT_ERROR lru crawler disabled\r\n",
+       "no metadump without the crawler");
+}
+
+my $server = new_memcached("-o lru_crawler");
+my $sock = $server->sock;
+
+print $sock "lru_crawler metadump 0\r\n";
+is(scalar <$sock>, "BADCLASS invalid class id\r\n", "bad class refused");
+
+my $errors = 0;
+for my $key (0 .. 99) {
+    print $sock "set small$key 0 0 5\r\nhello\r\n";
+    $errors++ unless scalar <$sock> eq "STORED\r\n";
+}
+my $big = "B"x2000;
+for my $key (0 .. 9) {
+    print $sock "set big$key 0 3600 2000\r\n$big\r\n";
+    $errors++ unless scalar <$sock> eq "STORED\r\n";
+}
+print $sock "set gone 0 0 5\r\nhello\r\n";
+$errors++ unless scalar <$sock> eq "STORED\r\n";
+print $sock "delete gone\r\n";
+$errors++ unless scalar <$sock> eq "DELETED\r\n";
+is($errors, 0, "stored everything");
+
+sub read_dump {
+    my $sock = shift;
+    my %keys;
+    while (my $line = <$sock>) {
+        last if $line eq "END\r\n";
+        $keys{$1} = { exp => $2, la => $3, cls => $4, size => $5 }
+            if $line =~ /^key=(\S+) exp=(-?\d+) la=(\d+) cls=(\d+) size=(\d+)\n$/;
+    }
+    return \%keys;
+}
+
+my $now = time();
+print $sock "lru_crawler metadump all\r\n";
+my $keys = read_dump($sock);
+is(scalar keys %$keys, 110, "every live item dumped");
+ok(!exists $keys->{gone}, "deleted item left out");
+is($keys->{small0}->{exp}, -1, "no TTL shows as -1");
+cmp_ok(abs($keys->{big0}->{exp} - ($now + 3600)), '<=', 2,
+       "exptime is a unix time");
+cmp_ok(abs($keys->{small0}->{la} - $now), '<=', 2,
+       "last access is a unix time");
+isnt($keys->{small0}->{cls}, $keys->{big0}->{cls}, "classes reported");
+cmp_ok($keys->{big0}->{size}, '>', 2000, "size includes the header");
+
+# Ask for one class only, with a command pipelined behind the dump.
+my $cls = $keys->{big0}->{cls};
+print $sock "lru_crawler metadump $cls\r\nget small1\r\n";
+$keys = read_dump($sock);
+is(scalar keys %$keys, 10, "only the requested class dumped");
+is(scalar <$sock>, "VALUE small1 0 5\r\n", "pipelined get answered after the dump");
+is(scalar <$sock>, "hello\r\n", "value");
+is(scalar <$sock>, "END\r\n", "end");
+
+# Fill up a dump much bigger than any socket buffer and don't read it yet;
+# other clients shouldn't notice.
+for my $key (0 .. 19999) {
+    print $sock "set filler$key 0 0 5 noreply\r\nhello\r\n";
+}
+print $sock "lru_crawler metadump all\r\n";
+sleep 1;
+my $other = $server->new_sock;
+mem_get_is($other, "small2", "hello", "others served while the dump waits");
+$keys = read_dump($sock);
+is(scalar keys %$keys, 20110, "slow reader still got the whole dump");
@@ -0,0 +1,75 @@
+#!/usr/bin/perl
+# -o lru_crawler_threads runs a pool of crawlers, each on a different LRU.
+# Spread short lived items over a few slab classes, crawl them all at once and
+# check every expired item was freed and each thread reported its share.
+
+use strict;
+use warnings;
+use Test::More tests => 14;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+{
+    my $server = new_memcached();
+    my $settings = mem_stats($server->sock, "settings");
+    is($settings->{lru_crawler_threads}, 1, "one crawler thread by default");
+}
+
+my $server = new_memcached("-m 32 -o lru_crawler,lru_crawler_threads=4");
+my $sock = $server->sock;
+
+my $settings = mem_stats($sock, "settings");
+is($settings->{lru_crawler_threads}, 4, "four crawler threads");
+
+my $crawlers = mem_stats($sock, "crawlers");
+is($crawlers->{crawler_threads}, 4, "stats crawlers sees them");
+is($crawlers->{"crawler:3:lru"}, 0, "idle before any crawl");
+
+my @sizes = (2, 200, 2000, 20000);
+my $errors = 0;
+for my $size (@sizes) {
+    my $value = "x" x $size;
+    for (1 .. 30) {
+        print $sock "set short${size}_$_ 0 1 $size\r\n$value\r\n";
+        $errors++ unless scalar <$sock> eq "STORED\r\n";
+        print $sock "set long${size}_$_ 0 0 $size\r\n$value\r\n";
+        $errors++ unless scalar <$sock> eq "STORED\r\n";
+    }
+}
+is($errors, 0, "stored items in four classes");
+
+sleep 3;
+
+print $sock "lru_crawler crawl all\r\n";
+is(scalar <$sock>, "OK\r\n", "kicked lru crawler");
+while (1) {
+    my $stats = mem_stats($sock);
+    last unless $stats->{lru_crawler_running};
+    sleep 1;
+}
+
+# A set can reclaim an expired item off its class's tail itself before the
+# crawl; those never reach the crawlers.
+my $items = mem_stats($sock, "items");
+my $inline = 0;
+$inline += $items->{$_} for grep { /^items:\d+:reclaimed$/ } keys %$items;
+
+my $stats = mem_stats($sock);
+is($stats->{curr_items}, 120, "only the immortal items are left");
+is($stats->{crawler_reclaimed} + $inline, 120, "crawlers freed every expired item");
+
+$crawlers = mem_stats($sock, "crawlers");
+is($crawlers->{crawler_lrus_pending}, 0, "nothing left queued");
+my ($reclaimed, $lrus, $checked) = (0, 0, 0);
+for my $n (0 .. 3) {
+    $reclaimed += $crawlers->{"crawler:$n:reclaimed"};
+    $lrus += $crawlers->{"crawler:$n:lrus_crawled"};
+    $checked += $crawlers->{"crawler:$n:items_checked"};
+}
+is($reclaimed + $inline, 120, "per thread reclaims add up");
+cmp_ok($lrus, '>=', 4, "every class's LRU was crawled");
+is($checked + $inline, 240, "every item was checked once");
+is($crawlers->{"lru:129:last_yield"}, 30, "class 1 COLD yield remembered");
+
+mem_get_is($sock, "long2_1", "xx", "immortal item still there");
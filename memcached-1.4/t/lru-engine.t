@@ -0,0 +1,60 @@
+#!/usr/bin/perl
+# -o lru_engine=clock|sampled evict out of the slab pages instead of the LRU
+# lists. Overfill a small cache under each and make sure evictions happen,
+# new items stay readable and, under CLOCK, a key that keeps getting hit
+# survives the hand.
+
+use strict;
+use Test::More tests => 216;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+{
+    my $server = new_memcached();
+    my $settings = mem_stats($server->sock, "settings");
+    is($settings->{lru_engine}, "list", "list engine by default");
+}
+
+my $value = "B"x66560;
+
+for my $engine ("clock", "sampled") {
+    my $server = new_memcached("-m 6 -o lru_engine=$engine");
+    my $sock = $server->sock;
+
+    my $settings = mem_stats($sock, "settings");
+    is($settings->{lru_engine}, $engine, "$engine engine selected");
+
+    print $sock "lru_crawler enable\r\n";
+    like(scalar <$sock>, qr/^ERROR/, "no crawler without LRU lists");
+
+    print $sock "set canary 0 0 66560\r\n$value\r\n";
+    is(scalar <$sock>, "STORED\r\n", "stored canary key");
+
+    for my $key (0 .. 99) {
+        print $sock "set key$key 0 0 66560\r\n$value\r\n";
+        is(scalar <$sock>, "STORED\r\n", "stored key$key");
+        # Keep the canary's reference bit set for the CLOCK hand.
+        if ($engine eq "clock") {
+            print $sock "get canary\r\n";
+            my $hit = scalar <$sock>;
+            if ($hit =~ /^VALUE/) {
+                <$sock>;
+                <$sock>;
+            }
+        }
+    }
+
+    my $stats = mem_stats($sock);
+    my $curr_items = $stats->{curr_items};
+    isnt($stats->{evictions}, 0, "some evictions happened");
+    cmp_ok($stats->{curr_items}, '<', 101, "not everything fit");
+    mem_get_is($sock, "key99", $value, "newest item still there");
+    # Sampled eviction makes no promises about any one key.
+    mem_get_is($sock, "canary", $value, "active item got its second chances")
+        if $engine eq "clock";
+
+    $stats = mem_stats($sock, "items");
+    is($stats->{"items:31:number"}, $curr_items,
+       "items counted without LRU lists");
+}
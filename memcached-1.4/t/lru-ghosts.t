@@ -0,0 +1,47 @@
+#!/usr/bin/perl
+# -o lru_ghosts remembers the hashes of keys evicted off COLD and moves a
+# class's WARM target when they come back. Overfill a class with keys that
+# are never read, store the evicted ones again and check WARM gave way to
+# COLD.
+
+use strict;
+use Test::More tests => 10;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+{
+    my $server = new_memcached();
+    my $settings = mem_stats($server->sock, "settings");
+    is($settings->{lru_ghosts}, "no", "lru_ghosts off by default");
+}
+
+my $server = new_memcached("-m 6 -o lru_maintainer,lru_ghosts");
+my $sock = $server->sock;
+
+my $settings = mem_stats($sock, "settings");
+is($settings->{lru_ghosts}, "yes", "lru_ghosts on");
+
+my $value = "B"x66560;
+my $errors = 0;
+for my $key (0 .. 99) {
+    print $sock "set key$key 0 0 66560\r\n$value\r\n";
+    $errors++ unless scalar <$sock> eq "STORED\r\n";
+}
+is($errors, 0, "stored everything");
+
+my $stats = mem_stats($sock, "items");
+isnt($stats->{"items:31:evicted"}, 0, "some evictions happened");
+is($stats->{"items:31:target_warm_pct"}, "32.00", "WARM starts at warm_lru_pct");
+cmp_ok($stats->{"items:31:ghosts_recent"}, '>', 0, "unfetched evictions remembered");
+is($stats->{"items:31:ghosts_frequent"}, 0, "nothing fetched was evicted");
+
+# Bring the first keys back; their ghosts say COLD was too small.
+for my $key (0 .. 9) {
+    print $sock "set key$key 0 0 66560\r\n$value\r\n";
+    $errors++ unless scalar <$sock> eq "STORED\r\n";
+}
+$stats = mem_stats($sock, "items");
+cmp_ok($stats->{"items:31:ghost_hits_recent"}, '>', 0, "evicted keys found");
+cmp_ok($stats->{"items:31:target_warm_pct"}, '<', 32, "WARM shrank");
+cmp_ok($stats->{"items:31:ghost_hit_rate"}, '>', 0, "hit rate reported");
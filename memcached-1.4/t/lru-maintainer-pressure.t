@@ -0,0 +1,39 @@
+#!/usr/bin/perl
+# The LRU maintainer sizes its sleeps and batches from each class's
+# allocation rate. Push a burst of large items through a full cache and
+# check the rate and the work workers still had to do inline get reported.
+
+use strict;
+use Test::More tests => 9;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+my $server = new_memcached('-m 6 -o lru_maintainer');
+my $sock = $server->sock;
+
+my $stats = mem_stats($sock);
+ok(exists $stats->{lru_maintainer_sleep}, "maintainer sleep reported");
+
+my $value = "B"x66560;
+my $errors = 0;
+for my $key (0 .. 299) {
+    print $sock "set key$key 0 0 66560\r\n$value\r\n";
+    $errors++ unless scalar <$sock> eq "STORED\r\n";
+}
+is($errors, 0, "stored the burst");
+
+$stats = mem_stats($sock, "items");
+cmp_ok($stats->{"items:31:alloc_rate"}, '>', 0, "allocation rate measured");
+isnt($stats->{"items:31:evicted"}, 0, "burst caused evictions");
+cmp_ok($stats->{"items:31:inline_evictions"}, '<=', $stats->{"items:31:evicted"},
+       "inline evictions counted");
+ok(exists $stats->{"items:31:inline_moves"}, "inline moves counted");
+cmp_ok($stats->{"items:31:inline_moves"}, '<', 300,
+       "workers didn't have to push everything to COLD themselves");
+
+# With nothing allocating the maintainer backs off again.
+sleep 2;
+$stats = mem_stats($sock);
+cmp_ok($stats->{lru_maintainer_sleep}, '>', 1000, "maintainer backed off");
+mem_get_is($sock, "key299", $value, "newest item still there");
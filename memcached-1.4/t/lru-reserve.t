@@ -0,0 +1,50 @@
+#!/usr/bin/perl
+# With -o lru_reserve the LRU maintainer evicts ahead of demand to keep a
+# share of each full class free. Write through a small cache at a pace the
+# maintainer can keep up with and make sure it, not the workers, did most
+# of the evicting.
+
+use strict;
+use Test::More tests => 10;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+{
+    my $server = new_memcached();
+    my $settings = mem_stats($server->sock, "settings");
+    is($settings->{lru_reserve}, 0, "lru_reserve off by default");
+}
+
+eval {
+    new_memcached("-o lru_maintainer,lru_reserve=10,lru_admission");
+};
+ok($@ && $@ =~ m/^Failed/, "not with lru_admission, which it would bypass");
+
+my $server = new_memcached("-m 6 -o lru_maintainer,lru_reserve=10");
+my $sock = $server->sock;
+
+my $settings = mem_stats($sock, "settings");
+is($settings->{lru_reserve}, 10, "lru_reserve set");
+
+my $value = "B"x66560;
+my $errors = 0;
+for my $key (0 .. 199) {
+    print $sock "set key$key 0 0 66560\r\n$value\r\n";
+    $errors++ unless scalar <$sock> eq "STORED\r\n";
+    select(undef, undef, undef, 0.01);
+}
+is($errors, 0, "stored everything");
+
+my $stats = mem_stats($sock, "items");
+my $evicted = $stats->{"items:31:evicted"};
+isnt($evicted, 0, "some evictions happened");
+cmp_ok($stats->{"items:31:reserve_evictions"}, '>', 0, "maintainer evicted ahead");
+cmp_ok($stats->{"items:31:inline_evictions"}, '<', $evicted / 2,
+       "workers did less than half the evicting");
+cmp_ok($stats->{"items:31:reserve_misses"}, '<', 100, "reserve mostly there");
+
+$stats = mem_stats($sock, "slabs");
+cmp_ok($stats->{"31:free_chunks"}, '>', 0, "free chunks kept");
+
+mem_get_is($sock, "key199", $value, "newest item still there");
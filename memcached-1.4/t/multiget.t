@@ -0,0 +1,43 @@
+#!/usr/bin/perl
+# Multigets are looked up in batches (item_get_batch), make sure hits,
+# misses and expired keys still come back in request order across the
+# tokenizer's windows.
+
+use strict;
+use Test::More tests => 8;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+foreach my $engine (qw(chained bucketed)) {
+    my $server = new_memcached("-o hash_engine=$engine");
+    my $sock = $server->sock;
+
+    my @keys = map { "mkey$_" } (1 .. 100);
+    for my $i (1 .. 100) {
+        next if $i % 5 == 0;
+        print $sock "set mkey$i 0 0 " . length("v$i") . " noreply\r\nv$i\r\n";
+    }
+    print $sock "set mkey7 0 -1 3\r\nold\r\n";
+    is(scalar <$sock>, "STORED\r\n", "$engine: stored an expired key");
+
+    print $sock "get " . join(' ', @keys) . "\r\n";
+    my @got;
+    while (my $line = <$sock>) {
+        last if $line eq "END\r\n";
+        my ($key) = $line =~ /^VALUE (\S+) /;
+        my $val = <$sock>;
+        chomp $val; chop $val;
+        push(@got, "$key=$val");
+    }
+    my @want = map { "mkey$_=v$_" } grep { $_ % 5 != 0 && $_ != 7 } (1 .. 100);
+    is_deeply(\@got, \@want, "$engine: multiget returns hits in order");
+
+    # An overlong key still fails the whole command, wherever it is.
+    my $long = "a" x 251;
+    print $sock "get mkey1 mkey2 mkey3 mkey4 mkey6 mkey8 mkey9 $long mkey11\r\n";
+    is(scalar <$sock>, "CLIENT_ERROR bad command line format\r\n",
+       "$engine: overlong key rejected");
+
+    mem_get_is($sock, "mkey1", "v1");
+}
@@ -0,0 +1,55 @@
+#!/usr/bin/perl
+# -o numa pins workers to nodes and gives each node its own slab arena and
+# free lists. Whatever the box's topology, stores and gets have to keep
+# working and the hits have to be counted as local or remote.
+
+use strict;
+use Test::More tests => 9;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+{
+    my $server = new_memcached();
+    my $sock = $server->sock;
+    my $settings = mem_stats($sock, "settings");
+    is($settings->{numa}, "no", "numa off by default");
+    my $stats = mem_stats($sock);
+    ok(!exists $stats->{numa_local_hits}, "no numa stats without it");
+}
+
+my $server = new_memcached("-m 32 -t 4 -o numa");
+my $sock = $server->sock;
+
+my $settings = mem_stats($sock, "settings");
+is($settings->{numa}, "yes", "numa on");
+
+my $value = "B"x1000;
+my $errors = 0;
+for my $key (0 .. 499) {
+    print $sock "set key$key 0 0 1000\r\n$value\r\n";
+    $errors++ unless scalar <$sock> eq "STORED\r\n";
+}
+is($errors, 0, "stored everything");
+
+my $misses = 0;
+for my $key (0 .. 499) {
+    print $sock "get key$key\r\n";
+    my $line = <$sock>;
+    if ($line eq "END\r\n") { $misses++; next }
+    <$sock>; <$sock>;
+}
+is($misses, 0, "got everything back");
+mem_get_is($sock, "key42", $value);
+
+my $stats = mem_stats($sock);
+ok(exists $stats->{numa_local_hits}, "local hits reported");
+ok(exists $stats->{numa_remote_hits}, "remote hits reported");
+
+# Node arenas only exist on a multi-node box; with them every byte of
+# the slab arena is accounted to one of the nodes.
+$stats = mem_stats($sock, "slabs");
+my $node_bytes = 0;
+$node_bytes += $stats->{$_} for grep { /^node\d+:malloced$/ } keys %$stats;
+ok($node_bytes == 0 || $node_bytes == $stats->{total_malloced},
+   "per-node usage adds up");
@@ -0,0 +1,87 @@
+#!/usr/bin/perl
+# With -o seqlock_gets a get looks its key up without the item lock. Race
+# readers against writers replacing and deleting the same keys, on a small
+# table that has to grow meanwhile, and make sure nobody ever gets back an
+# item for the wrong key or a value that was half overwritten.
+
+use strict;
+use Test::More tests => 14;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+my $hot = 50;
+my $rounds = 4000;
+
+{
+    my $server = new_memcached("-t 4");
+    my $stats = mem_stats($server->sock);
+    ok(!exists $stats->{seqlock_retries}, "no seqlock stats by default");
+    my $settings = mem_stats($server->sock, "settings");
+    is($settings->{seqlock_gets}, "no", "seqlock_gets off by default");
+}
+
+my $server = new_memcached("-t 2 -o seqlock_gets,hashpower=12");
+my $sock = $server->sock;
+
+my $settings = mem_stats($sock, "settings");
+is($settings->{seqlock_gets}, "yes", "seqlock_gets on");
+
+print $sock "set foo 0 0 3\r\nbar\r\n";
+is(scalar <$sock>, "STORED\r\n", "stored foo");
+mem_get_is($sock, "foo", "bar");
+
+print $sock "set brief 0 1 2\r\nhi\r\n";
+is(scalar <$sock>, "STORED\r\n", "stored brief");
+sleep(2);
+mem_get_is($sock, "brief", undef, "expired item isn't returned");
+
+sub value_for {
+    my ($key, $gen) = @_;
+    # Vary the length so a torn read can't go unnoticed.
+    return "$key:$gen:" . ("x" x ($gen % 97));
+}
+
+my $failed = run_clients($server, 4, sub {
+    my ($csock, $client) = @_;
+    my $errors = 0;
+    for my $i (1 .. $rounds) {
+        my $key = "hot" . ($i % $hot);
+        if ($client == 1) {
+            # Fill the table up so it expands under the readers: two per
+            # round is past 1.5 items a bucket at hashpower 12. The fills go
+            # out in the same write as the set; on their own, Nagle holds
+            # the set back until the server's delayed ack.
+            my $val = value_for($key, $i);
+            print $csock "set fill$i 0 0 1 noreply\r\nf\r\n"
+                . "set fillb$i 0 0 1 noreply\r\nf\r\n"
+                . "set $key 0 0 " . length($val) . "\r\n$val\r\n";
+            $errors++ unless scalar <$csock> eq "STORED\r\n";
+        } elsif ($client == 2) {
+            print $csock "delete $key\r\n";
+            $errors++ unless scalar <$csock> =~ /^(DELETED|NOT_FOUND)\r\n$/;
+        } else {
+            print $csock "get $key hot" . (($i + 7) % $hot) . "\r\n";
+            while (my $line = <$csock>) {
+                last if $line eq "END\r\n";
+                my ($got, $len) = $line =~ /^VALUE (\S+) 0 (\d+)\r\n$/;
+                my $data = <$csock>;
+                $errors++ unless defined $got && $data =~ /^\Q$got\E:(\d+):(x*)\r\n$/
+                    && length($2) == $1 % 97 && length($data) == $len + 2;
+            }
+        }
+    }
+    return $errors;
+});
+is($failed, 0, "every client saw consistent results");
+
+mem_get_is($sock, "foo", "bar");
+mem_get_is($sock, "fill$rounds", "f");
+
+my $stats = mem_stats($sock);
+cmp_ok($stats->{hash_power_level}, '>', 12, "table grew under the readers");
+ok(exists $stats->{seqlock_retries}, "seqlock_retries reported");
+
+print $sock "delete foo\r\n";
+is(scalar <$sock>, "DELETED\r\n", "deleted foo");
+mem_get_is($sock, "foo", undef, "deleted item isn't returned");
@@ -0,0 +1,50 @@
+#!/usr/bin/perl
+# -o slab_hugepages maps the slab arena in one go on huge pages, falling back
+# to smaller ones when the system has none to give. Whatever it got, items
+# must store and read back as usual.
+
+use strict;
+use Test::More tests => 10;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+{
+    my $server = new_memcached();
+    my $settings = mem_stats($server->sock, "settings");
+    is($settings->{slab_hugepages}, "no", "slab_hugepages off by default");
+    my $stats = mem_stats($server->sock, "slabs");
+    ok(!exists $stats->{hugepages}, "no arena stats without it");
+}
+
+my $value = "B"x100000;
+
+sub fill {
+    my $sock = shift;
+    my $errors = 0;
+    for my $key (0 .. 99) {
+        print $sock "set key$key 0 0 100000\r\n$value\r\n";
+        $errors++ unless scalar <$sock> eq "STORED\r\n";
+    }
+    return $errors;
+}
+
+my $server = new_memcached("-o slab_hugepages=thp");
+my $sock = $server->sock;
+my $settings = mem_stats($sock, "settings");
+is($settings->{slab_hugepages}, "thp", "asked for transparent huge pages");
+is(fill($sock), 0, "stored everything");
+my $stats = mem_stats($sock, "slabs");
+like($stats->{hugepages}, qr/^(thp|no)$/, "arena backing reported");
+like($stats->{hugepages_mapped}, qr/^\d+$/, "huge pages counted");
+mem_get_is($sock, "key99", $value, "value read back");
+
+# Hardly any test box has a 1GB page pool; this should fall back.
+$server = new_memcached("-o slab_hugepages=1g");
+$sock = $server->sock;
+$settings = mem_stats($sock, "settings");
+is($settings->{slab_hugepages}, "1g", "asked for 1GB pages");
+fill($sock);
+$stats = mem_stats($sock, "slabs");
+like($stats->{hugepages}, qr/^(1g|thp|no)$/, "fell back gracefully");
+mem_get_is($sock, "key0", $value, "value read back");
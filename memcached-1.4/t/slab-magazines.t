@@ -0,0 +1,75 @@
+#!/usr/bin/perl
+# -o slab_magazines keeps a few free chunks per class in each worker. Make
+# sure the slab stats still add up with chunks sitting in magazines, and
+# that the slab mover can take a page from a class that has some.
+
+use strict;
+use Test::More tests => 14;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+{
+    my $server = new_memcached();
+    my $settings = mem_stats($server->sock, "settings");
+    is($settings->{slab_magazines}, 0, "slab_magazines off by default");
+}
+
+eval {
+    new_memcached("-o slab_magazines=16,lru_engine=clock");
+};
+ok($@ && $@ =~ m/^Failed/, "not with an lru_engine that evicts from pages");
+
+my $server = new_memcached("-m 64 -o slab_magazines=16,slab_reassign");
+my $sock = $server->sock;
+
+my $settings = mem_stats($sock, "settings");
+is($settings->{slab_magazines}, 16, "slab_magazines set");
+
+# Keys of one length, so every item asks for the same number of bytes.
+my $value = "B"x1000;
+my $errors = 0;
+for my $key (map { sprintf("key%04d", $_) } 0 .. 1999) {
+    print $sock "set $key 0 0 1000\r\n$value\r\n";
+    $errors++ unless scalar <$sock> eq "STORED\r\n";
+}
+is($errors, 0, "stored everything");
+
+sub class_of {
+    my $stats = shift;
+    for my $stat (keys %$stats) {
+        return $1 if $stat =~ /^(\d+):used_chunks$/ && $stats->{$stat} >= 1000;
+    }
+    return 0;
+}
+
+my $stats = mem_stats($sock, "slabs");
+my $id = class_of($stats);
+isnt($id, 0, "found the class");
+is($stats->{"$id:used_chunks"}, 2000, "every item uses a chunk");
+my $per_item = $stats->{"$id:mem_requested"} / 2000;
+
+for my $key (map { sprintf("key%04d", $_) } 0 .. 999) {
+    print $sock "delete $key\r\n";
+    $errors++ unless scalar <$sock> eq "DELETED\r\n";
+}
+is($errors, 0, "deleted half");
+
+$stats = mem_stats($sock, "slabs");
+is($stats->{"$id:used_chunks"}, 1000, "freed chunks no longer used");
+is($stats->{"$id:used_chunks"} + $stats->{"$id:free_chunks"},
+   $stats->{"$id:total_chunks"}, "used and free add up");
+cmp_ok($stats->{"$id:magazine_chunks"}, '>', 0, "some freed chunks cached");
+is($stats->{"$id:mem_requested"}, 1000 * $per_item, "requested bytes exact");
+
+# Take a page away from the class; the chunks in magazines must be handed
+# back first or the move never finishes.
+print $sock "slabs reassign $id 0\r\n";
+is(scalar <$sock>, "OK\r\n", "slab rebalancer started");
+sleep 2;
+$stats = mem_stats($sock);
+isnt($stats->{slabs_moved}, 0, "page moved");
+
+$stats = mem_stats($sock, "slabs");
+is($stats->{"$id:used_chunks"} + $stats->{"$id:free_chunks"},
+   $stats->{"$id:total_chunks"}, "still adds up after the move");
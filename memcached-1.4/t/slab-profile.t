@@ -0,0 +1,77 @@
+#!/usr/bin/perl
+# -o slab_profile counts allocated item sizes, fits class sizes to them and
+# saves those for the next start. Store items of one size, save the profile
+# and restart from it to check they now fit their chunks snugly.
+
+use strict;
+use Test::More tests => 13;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+my $profile = "/tmp/memcached-slab-profile.$$";
+unlink $profile;
+
+{
+    my $server = new_memcached();
+    my $sock = $server->sock;
+    my $settings = mem_stats($sock, "settings");
+    is($settings->{slab_profile}, "NULL", "slab_profile off by default");
+    print $sock "slabs profile save\r\n";
+    is(scalar <$sock>, "CLIENT_ERROR slab profiling disabled\r\n",
+       "nothing to save without it");
+}
+
+sub store_all {
+    my $sock = shift;
+    my $value = "B"x1000;
+    my $errors = 0;
+    for my $key (0 .. 499) {
+        print $sock "set key$key 0 0 1000\r\n$value\r\n";
+        $errors++ unless scalar <$sock> eq "STORED\r\n";
+    }
+    return $errors;
+}
+
+sub class_waste {
+    my $sock = shift;
+    my $stats = mem_stats($sock, "slabs");
+    for my $stat (keys %$stats) {
+        next unless $stat =~ /^(\d+):used_chunks$/ && $stats->{$stat} == 500;
+        return $stats->{"$1:chunk_size"} * 500 - $stats->{"$1:mem_requested"};
+    }
+    return -1;
+}
+
+my $server = new_memcached("-o slab_profile=$profile");
+my $sock = $server->sock;
+
+my $settings = mem_stats($sock, "settings");
+is($settings->{slab_profile}, $profile, "slab_profile set");
+
+print $sock "slabs profile save\r\n";
+is(scalar <$sock>, "SERVER_ERROR failed to save slab profile\r\n",
+   "nothing sampled yet");
+
+is(store_all($sock), 0, "stored everything");
+my $before = class_waste($sock);
+cmp_ok($before, '>', 500 * 16, "-f classes waste some of each chunk");
+
+my $stats = mem_stats($sock, "slab_profile");
+is($stats->{samples}, 500, "every allocation counted");
+is($stats->{waste_current}, $before, "current waste matches stats slabs");
+cmp_ok($stats->{waste_profile}, '<', $stats->{waste_current}, "fitted classes waste less");
+ok(exists $stats->{"1:chunk_size"} && exists $stats->{"2:chunk_size"},
+   "fitted classes listed");
+
+print $sock "slabs profile save\r\n";
+is(scalar <$sock>, "OK\r\n", "profile saved");
+ok(-s $profile, "profile written");
+
+# Start again from the saved classes.
+$server = new_memcached("-o slab_profile=$profile");
+$sock = $server->sock;
+store_all($sock);
+cmp_ok(class_waste($sock), '<', 500 * 16, "items fit the profiled class snugly");
+
+unlink $profile;
@@ -54,6 +54,9 @@ my $sock = $server->sock;
 ## STAT hash_power_level 16
 ## STAT hash_bytes 524288
 ## STAT hash_is_expanding 0
+## STAT hash_expand_buckets 0
+## STAT hash_expansions 0
+## STAT hash_shrinks 0
 ## STAT malloc_fails 0
 ## STAT bytes 0
 ## STAT curr_items 0
@@ -71,7 +74,7 @@ my $sock = $server->sock;
 my $stats = mem_stats($sock);
 
 # Test number of keys
-is(scalar(keys(%$stats)), 53, "53 stats values");
+is(scalar(keys(%$stats)), 56, "56 stats values");
 
 # Test initial state
 foreach my $key (qw(curr_items total_items bytes cmd_get cmd_set get_hits evictions get_misses
@@ -9,6 +9,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <pthread.h>
+#include <sched.h>
 
 #ifdef __sun
 #include <atomic.h>
@@ -25,6 +26,7 @@ struct conn_queue_item { //
     int               event_flags; //EV_READ | EV_PERSIST
     int               read_buffer_size; //ĬDATA_BUFFER_SIZE
     enum network_transport     transport; //tcpӻudp
+    conn             *c;    /* set when a connection comes back, see redispatch_conn() */
     CQ_ITEM          *next;
 };
 
@@ -56,10 +58,36 @@ static pthread_mutex_t worker_hang_lock;
 static CQ_ITEM *cqi_freelist;
 static pthread_mutex_t cqi_freelist_lock;
 
-static pthread_mutex_t *item_locks;
-/* size of the item lock hash table */
-static uint32_t item_lock_count;
+/*
+ * The item lock table. item_locks_resize() builds a new one and swaps it in
+ * whole, so a locker reads the pointer once and sticks with that table.
+ */
+typedef struct {
+    pthread_mutex_t *locks;
+    /*
+     * -o seqlock_gets: one sequence counter per item lock, odd while the lock
+     * is held. A get reads without the lock and retries if the count moved.
+     */
+    volatile unsigned int *seqs;
+    unsigned int hashpower;
+} item_lock_table;
+
+static item_lock_table *volatile item_lock_tbl;
+/* mirrors item_lock_tbl->hashpower */
 unsigned int item_lock_hashpower;
+/* The table may grow up to this; one lock must still cover an expansion step. */
+static unsigned int item_lock_hashpower_max;
+
+/* Item lock contention, for "stats locks" and the resize check. */
+static struct {
+    uint64_t waits;         /* item_lock() calls which found the lock held */
+    uint64_t wait_ns;       /* time spent waiting in those */
+    uint64_t trylock_fails; /* item_trylock() calls which gave up */
+    uint64_t resizes;
+} item_lock_stats;
+#ifndef HAVE_GCC_ATOMICS
+static pthread_mutex_t item_lock_stats_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
 #define hashsize(n) ((unsigned long int)1<<(n))
 #define hashmask(n) (hashsize(n)-1)
 
@@ -78,8 +106,14 @@ static int init_count = 0;
 static pthread_mutex_t init_lock;
 static pthread_cond_t init_cond;
 
+#ifdef HAVE_GCC_ATOMICS
+/* The LIBEVENT_THREAD of the calling worker, NULL on every other thread. */
+static pthread_key_t worker_self_key;
+#endif
+
 
 static void thread_libevent_process(int fd, short which, void *arg);
+static void numa_pin(LIBEVENT_THREAD *me);
 
 unsigned short refcount_incr(unsigned short *refcount) {
 #ifdef HAVE_GCC_ATOMICS
@@ -117,26 +151,181 @@ unsigned short refcount_decr(unsigned short *refcount) {
  * LRU's accessing items must item_trylock() before modifying an item.
  * Items accessable from an LRU must not be freed or modified
  * without first locking and removing from the LRU.
+ * With -o seqlock_gets every holder also bumps the stripe's sequence count on
+ * the way in and out, which is what lock-free readers validate against.
  */
+#ifdef HAVE_GCC_ATOMICS
+#define item_seq_bump(t, stripe) do { \
+    if (settings.seqlock_gets) \
+        __sync_add_and_fetch(&(t)->seqs[stripe], 1); \
+} while (0)
+#define item_lock_stat_add(field, n) \
+    __sync_add_and_fetch(&item_lock_stats.field, (n))
+#else
+#define item_seq_bump(t, stripe)
+#define item_lock_stat_add(field, n) do { \
+    pthread_mutex_lock(&item_lock_stats_lock); \
+    item_lock_stats.field += (n); \
+    pthread_mutex_unlock(&item_lock_stats_lock); \
+} while (0)
+#endif
+
+/* The slow half of item_lock(), timed for "stats locks". */
+static void item_lock_wait(pthread_mutex_t *lock) {
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+    struct timespec start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    mutex_lock(lock);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    item_lock_stat_add(wait_ns, (end.tv_sec - start.tv_sec) * 1000000000ULL
+                                + end.tv_nsec - start.tv_nsec);
+#else
+    mutex_lock(lock);
+#endif
+    item_lock_stat_add(waits, 1);
+}
 
 void item_lock(uint32_t hv) {
-    mutex_lock(&item_locks[hv & hashmask(item_lock_hashpower)]);
+    item_lock_table *t;
+    uint32_t stripe;
+
+    /* If the table was swapped while we waited, we got a lock nobody else
+     * will be looking at any more. Drop it and go again. */
+    for (;;) {
+        t = item_lock_tbl;
+        stripe = hv & hashmask(t->hashpower);
+        if (pthread_mutex_trylock(&t->locks[stripe]) != 0)
+            item_lock_wait(&t->locks[stripe]);
+        if (t == item_lock_tbl)
+            break;
+        mutex_unlock(&t->locks[stripe]);
+    }
+    item_seq_bump(t, stripe);
 }
 
+/* A table can't be swapped while any of its locks is held, so a holder can
+ * always find its lock in the current one. */
 void *item_trylock(uint32_t hv) {
-    pthread_mutex_t *lock = &item_locks[hv & hashmask(item_lock_hashpower)];
+    item_lock_table *t = item_lock_tbl;
+    uint32_t stripe = hv & hashmask(t->hashpower);
+    pthread_mutex_t *lock = &t->locks[stripe];
     if (pthread_mutex_trylock(lock) == 0) {
-        return lock;
+        if (t == item_lock_tbl) {
+            item_seq_bump(t, stripe);
+            return lock;
+        }
+        mutex_unlock(lock);
     }
+    item_lock_stat_add(trylock_fails, 1);
     return NULL;
 }
 
 void item_trylock_unlock(void *lock) {
+    item_lock_table *t = item_lock_tbl;
+    item_seq_bump(t, (pthread_mutex_t *) lock - t->locks);
     mutex_unlock((pthread_mutex_t *) lock);
 }
 
 void item_unlock(uint32_t hv) {
-    mutex_unlock(&item_locks[hv & hashmask(item_lock_hashpower)]);
+    item_lock_table *t = item_lock_tbl;
+    uint32_t stripe = hv & hashmask(t->hashpower);
+    item_seq_bump(t, stripe);
+    mutex_unlock(&t->locks[stripe]);
+}
+
+static item_lock_table *item_lock_table_new(const unsigned int power) {
+    item_lock_table *t = calloc(1, sizeof(item_lock_table));
+    unsigned int i;
+
+    if (t == NULL)
+        return NULL;
+    t->hashpower = power;
+    t->locks = calloc(hashsize(power), sizeof(pthread_mutex_t));
+    if (settings.seqlock_gets)
+        t->seqs = calloc(hashsize(power), sizeof(unsigned int));
+    if (t->locks == NULL || (settings.seqlock_gets && t->seqs == NULL)) {
+        free(t->locks);
+        free((void *)t->seqs);
+        free(t);
+        return NULL;
+    }
+    for (i = 0; i < hashsize(power); i++) {
+        pthread_mutex_init(&t->locks[i], NULL);
+    }
+    return t;
+}
+
+/*
+ * Doubles the item lock table. Everything that takes item locks is paused
+ * except the hash table's maintenance thread, so we also sit on every lock
+ * of the old table while swapping. Whoever was blocked on one of them notices
+ * the swap and retries on the new table. That means the old table can't be
+ * freed; resizes are rare and bounded by item_lock_hashpower_max.
+ */
+static void item_locks_resize(void) {
+    item_lock_table *old = item_lock_tbl, *t;
+    unsigned int i;
+
+    if (old->hashpower >= item_lock_hashpower_max)
+        return;
+    if ((t = item_lock_table_new(old->hashpower + 1)) == NULL)
+        return;
+
+    pause_threads(PAUSE_ALL_THREADS);
+    for (i = 0; i < hashsize(old->hashpower); i++) {
+        mutex_lock(&old->locks[i]);
+    }
+    item_lock_tbl = t;
+    item_lock_hashpower = t->hashpower;
+    for (i = 0; i < hashsize(old->hashpower); i++) {
+        mutex_unlock(&old->locks[i]);
+    }
+    pause_threads(RESUME_ALL_THREADS);
+
+    item_lock_stat_add(resizes, 1);
+    if (settings.verbose > 1)
+        fprintf(stderr, "Item lock table grown to %u locks\n",
+                (unsigned int) hashsize(t->hashpower));
+}
+
+/*
+ * Called from the clock once a second. With -o item_lock_grow_waits=N, doubles
+ * the lock table when more than N item_lock() calls had to wait in a second.
+ * After a resize we give the new table a few seconds before judging it.
+ */
+#define ITEM_LOCK_RESIZE_SETTLE 5
+
+void item_locks_check(void) {
+    static uint64_t last_waits;
+    static unsigned int settle;
+    uint64_t waits;
+
+    if (settings.item_lock_grow_waits == 0 || item_lock_tbl == NULL)
+        return;
+    waits = item_lock_stats.waits;
+    if (settle > 0) {
+        settle--;
+    } else if (waits - last_waits > (uint64_t) settings.item_lock_grow_waits) {
+        item_locks_resize();
+        settle = ITEM_LOCK_RESIZE_SETTLE;
+        waits = item_lock_stats.waits;
+    }
+    last_waits = waits;
+}
+
+void item_lock_stats_append(ADD_STAT add_stats, void *c) {
+    APPEND_STAT("item_locks", "%u", (unsigned int) hashsize(item_lock_hashpower));
+    APPEND_STAT("item_lock_hashpower", "%u", item_lock_hashpower);
+    APPEND_STAT("item_lock_hashpower_max", "%u", item_lock_hashpower_max);
+    APPEND_STAT("item_lock_waits", "%llu",
+                (unsigned long long) item_lock_stats.waits);
+    APPEND_STAT("item_lock_wait_us", "%llu",
+                (unsigned long long) item_lock_stats.wait_ns / 1000);
+    APPEND_STAT("item_trylock_fails", "%llu",
+                (unsigned long long) item_lock_stats.trylock_fails);
+    APPEND_STAT("item_lock_resizes", "%llu",
+                (unsigned long long) item_lock_stats.resizes);
 }
 
 /*
@@ -150,7 +339,7 @@ static void wait_for_thread_registration(int nthreads) {
 }
 
 //wait_for_thread_registrationʹã֤߳
-static void register_thread_initialized(void) {
+static void register_thread_initialized(LIBEVENT_THREAD *me) {
     pthread_mutex_lock(&init_lock);
     init_count++;
     pthread_cond_signal(&init_cond);
@@ -398,6 +587,22 @@ static void setup_thread(LIBEVENT_THREAD *me) {
         fprintf(stderr, "Failed to create suffix cache\n");
         exit(EXIT_FAILURE);
     }
+
+    if (settings.lru_bump_buffers) {
+        me->lru_bump_buf = lru_bump_buf_create();
+        if (me->lru_bump_buf == NULL) {
+            fprintf(stderr, "Failed to create LRU bump buffer\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (settings.slab_magazines) {
+        me->slab_mags = slabs_mags_create();
+        if (me->slab_mags == NULL) {
+            fprintf(stderr, "Failed to create slab magazines\n");
+            exit(EXIT_FAILURE);
+        }
+    }
 }
 
 /*
@@ -409,8 +614,15 @@ static void *worker_libevent(void *arg) {
     /* Any per-thread setup can happen here; memcached_thread_init() will block until
      * all threads have finished initializing.
      */
+#ifdef HAVE_GCC_ATOMICS
+    if (settings.seqlock_gets ||
+        settings.lru_bump_buffers || settings.numa || settings.slab_magazines)
+        pthread_setspecific(worker_self_key, me);
+#endif
+    if (settings.numa)
+        numa_pin(me);
 
-    register_thread_initialized();
+    register_thread_initialized(me);
 
     event_base_loop(me->base, 0); //ȴ¼setup_threadеthread_libevent_processִ
     return NULL;
@@ -440,7 +652,10 @@ static void thread_libevent_process(int fd, short which, void *arg) {
 	//CQжȡһitemΪpopԶȡCQлitemӶɾ
     item = cq_pop(me->new_conn_queue);
 
-    if (NULL != item) {
+    if (NULL != item && item->c != NULL) {
+        conn_worker_readd(item->c, item->init_state);
+        cqi_free(item);
+    } else if (NULL != item) {
 		//Ϊsfdһconnṹ壬ΪsfdһeventȻbaseevent
 		//sfd¼صevent_handler
         conn *c = conn_new(item->sfd, item->init_state, item->event_flags,
@@ -465,7 +680,7 @@ static void thread_libevent_process(int fd, short which, void *arg) {
     //switch_item_lock_typeߵ
     /* we were told to pause and report in */
     case 'p':
-    register_thread_initialized();
+    register_thread_initialized(me);
         break;
     }
 }
@@ -510,6 +725,7 @@ void dispatch_conn_new(int sfd, enum conn_states init_state, int event_flags,
     item->event_flags = event_flags;
     item->read_buffer_size = read_buffer_size;
     item->transport = transport;
+    item->c = NULL;
 	//itemŵѡworker̵߳CQ
     cq_push(thread->new_conn_queue, item);
 
@@ -521,6 +737,31 @@ void dispatch_conn_new(int sfd, enum conn_states init_state, int event_flags,
     }
 }
 
+/*
+ * Hands a connection that was lent to another thread back to the worker it
+ * belongs to, which picks it up again in the given state.
+ */
+void redispatch_conn(conn *c, enum conn_states state) {
+    CQ_ITEM *item = cqi_new();
+    char buf[1];
+    if (item == NULL) {
+        /* Can't touch the connection from here; it's leaked. */
+        fprintf(stderr, "Failed to allocate memory for connection object\n");
+        return;
+    }
+    LIBEVENT_THREAD *thread = c->thread;
+
+    item->sfd = c->sfd;
+    item->init_state = state;
+    item->c = c;
+    cq_push(thread->new_conn_queue, item);
+
+    buf[0] = 'c';
+    if (write(thread->notify_send_fd, buf, 1) != 1) {
+        perror("Writing to thread notify pipe");
+    }
+}
+
 /*
  * Returns true if this is the thread that listens for new TCP connections.
  */
@@ -528,6 +769,336 @@ int is_listen_thread() {
     return pthread_self() == dispatcher_thread.thread_id;
 }
 
+/******************************* SEQLOCK GETS ********************************/
+
+/*
+ * With -o seqlock_gets a get doesn't take the item lock. It samples the
+ * stripe's sequence count, walks the bucket, takes a reference on what it
+ * found and checks the count again. If no writer held the lock in between,
+ * the item was linked the whole time and the reference is good. Otherwise
+ * the reference is dropped and we try again, and after a few goes fall back
+ * to the lock.
+ *
+ * Readers may briefly look at items being freed, or at an old hash table.
+ * Memory stays mapped either way, and whoever is about to reuse it for
+ * something else (the hash table swap, the slab mover) waits in
+ * item_read_quiesce() for readers already under way.
+ */
+#define ITEM_SEQLOCK_TRIES 4
+
+#ifdef HAVE_GCC_ATOMICS
+enum seq_read {
+    SEQ_OK, SEQ_RETRY, SEQ_GIVE_UP
+};
+
+/* Takes a reference unless the count has already hit zero, in which case
+ * the item is on its way back to the slab allocator. */
+static bool refcount_acquire(unsigned short *refcount) {
+    unsigned short rc;
+
+    do {
+        rc = *(volatile unsigned short *)refcount;
+        if (rc == 0)
+            return false;
+    } while (!__sync_bool_compare_and_swap(refcount, rc, rc + 1));
+    return true;
+}
+
+/* Drops a reference unless it's the last one. Dropping that frees the item,
+ * which is left to do_item_remove() under the lock. */
+static bool refcount_release(unsigned short *refcount) {
+    unsigned short rc;
+
+    do {
+        rc = *(volatile unsigned short *)refcount;
+        if (rc <= 1)
+            return false;
+    } while (!__sync_bool_compare_and_swap(refcount, rc, rc - 1));
+    return true;
+}
+
+/* One optimistic lookup. On SEQ_RETRY *itp may still hold a reference,
+ * which has to be dropped outside of the read section. */
+static enum seq_read item_read_once(LIBEVENT_THREAD *me, const char *key,
+                                    const size_t nkey, const uint32_t hv,
+                                    item **itp) {
+    item_lock_table *t = item_lock_tbl;
+    volatile unsigned int *seq = &t->seqs[hv & hashmask(t->hashpower)];
+    enum seq_read ret = SEQ_RETRY;
+    unsigned int start;
+    item *it = NULL;
+
+    me->read_epoch++;
+    __sync_synchronize();
+    if (((start = *seq) & 1) == 0) {
+        __sync_synchronize();
+        if (!assoc_find_unlocked(key, nkey, hv, &it)) {
+            it = NULL;
+            ret = SEQ_GIVE_UP;
+        } else if (it == NULL || refcount_acquire(&it->refcount)) {
+            __sync_synchronize();
+            if (*seq == start)
+                ret = SEQ_OK;
+        } else {
+            it = NULL;
+        }
+    }
+    __sync_synchronize();
+    me->read_epoch++;
+
+    *itp = it;
+    return ret;
+}
+
+/* Drops a reference item_read_once() took. */
+static void item_read_drop(item *it) {
+    uint32_t hv;
+
+    if (refcount_release(&it->refcount))
+        return;
+    hv = ITEM_hash(it);
+    item_lock(hv);
+    do_item_remove(it);
+    item_unlock(hv);
+}
+
+/*
+ * Returns true if the get was settled without the item lock, with *itp set
+ * as do_item_get() would have left it.
+ */
+static bool item_get_seqlock(const char *key, const size_t nkey,
+                             const uint32_t hv, item **itp) {
+    LIBEVENT_THREAD *me;
+    enum seq_read ret = SEQ_RETRY;
+    item *it = NULL;
+    int tries;
+
+    /* do_item_get() does the -vvv logging. */
+    if (settings.verbose > 2 || (me = pthread_getspecific(worker_self_key)) == NULL)
+        return false;
+
+    for (tries = 0; tries < ITEM_SEQLOCK_TRIES && ret == SEQ_RETRY; tries++) {
+        ret = item_read_once(me, key, nkey, hv, &it);
+        if (ret != SEQ_OK && it != NULL)
+            item_read_drop(it);
+    }
+    if (ret != SEQ_OK) {
+        pthread_mutex_lock(&me->stats.mutex);
+        me->stats.seqlock_retries++;
+        pthread_mutex_unlock(&me->stats.mutex);
+        return false;
+    }
+
+    if (it != NULL) {
+        /* Expiring the item or marking its first fetch both write to it, so
+         * those are left to the lock. */
+        if (item_is_flushed(it) ||
+            (it->exptime != 0 && it->exptime <= current_time)) {
+            item_read_drop(it);
+            return false;
+        }
+        if ((it->it_flags & (ITEM_FETCHED|ITEM_ACTIVE)) !=
+            (ITEM_FETCHED|ITEM_ACTIVE)) {
+            item_lock(hv);
+            it->it_flags |= ITEM_FETCHED|ITEM_ACTIVE;
+            item_unlock(hv);
+        }
+    }
+    *itp = it;
+    return true;
+}
+
+/* The calling worker's LRU bump ring, or NULL off the worker threads. */
+struct lru_bump_buf *worker_bump_buf(void) {
+    LIBEVENT_THREAD *me = pthread_getspecific(worker_self_key);
+    return me != NULL ? me->lru_bump_buf : NULL;
+}
+
+/* The calling worker's slab magazines, or NULL off the worker threads. */
+struct slab_mags *worker_slab_mags(void) {
+    LIBEVENT_THREAD *me = pthread_getspecific(worker_self_key);
+    return me != NULL ? me->slab_mags : NULL;
+}
+
+/*
+ * Waits for every worker to leave the optimistic read it's in, if any.
+ * Memory one of them might still be looking at can be reused after this.
+ */
+void item_read_quiesce(void) {
+    unsigned int epoch;
+    int i;
+
+    if (!settings.seqlock_gets || threads == NULL)
+        return;
+    __sync_synchronize();
+    for (i = 0; i < settings.num_threads; i++) {
+        epoch = threads[i].read_epoch;
+        while ((epoch & 1) && threads[i].read_epoch == epoch)
+            sched_yield();
+    }
+}
+#else
+static bool refcount_release(unsigned short *refcount) {
+    return false;
+}
+
+static bool item_get_seqlock(const char *key, const size_t nkey,
+                             const uint32_t hv, item **itp) {
+    return false;
+}
+
+struct lru_bump_buf *worker_bump_buf(void) {
+    return NULL;
+}
+
+struct slab_mags *worker_slab_mags(void) {
+    return NULL;
+}
+
+void item_read_quiesce(void) {
+}
+#endif
+
+/*********************************** NUMA ************************************/
+
+/*
+ * With -o numa the workers are split into contiguous blocks, one per node,
+ * and each is pinned to its node's CPUs. slabs.c keeps an arena and a free
+ * list per node, and an item is put on the node its key hashes to, see
+ * numa_key_node(). Connections are still handed out round-robin, as the
+ * keys they'll ask for aren't known when they're accepted.
+ *
+ * The topology comes from sysfs; with none there is one node.
+ */
+static int numa_nodes = 0;
+#ifdef __linux__
+static cpu_set_t numa_cpus[NUMA_MAX_NODES];
+
+/* Parses a sysfs cpulist such as "0-3,8-11". Returns the CPUs in it. */
+static int numa_parse_cpulist(const char *list, cpu_set_t *set) {
+    char *end;
+    long lo, hi;
+
+    CPU_ZERO(set);
+    while (*list != '\0' && *list != '\n') {
+        lo = hi = strtol(list, &end, 10);
+        if (end == list)
+            break;
+        if (*end == '-')
+            hi = strtol(end + 1, &end, 10);
+        for (; lo <= hi && lo < CPU_SETSIZE; lo++)
+            CPU_SET(lo, set);
+        list = *end == ',' ? end + 1 : end;
+    }
+    return CPU_COUNT(set);
+}
+#endif
+
+/* Finds the nodes with CPUs on them, up to NUMA_MAX_NODES, and fills in
+ * their kernel ids. Returns how many there are, at least one. */
+int numa_init(int *node_ids) {
+    int n = 0;
+#ifdef __linux__
+    char path[64], line[1024];
+    FILE *f;
+    int id;
+
+    for (id = 0; id < NUMA_NODE_IDS && n < NUMA_MAX_NODES; id++) {
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", id);
+        if ((f = fopen(path, "r")) == NULL)
+            continue;
+        if (fgets(line, sizeof(line), f) != NULL &&
+            numa_parse_cpulist(line, &numa_cpus[n]) > 0) {
+            node_ids[n++] = id;
+        }
+        fclose(f);
+    }
+    if (n == 0)
+        CPU_ZERO(&numa_cpus[0]);
+#endif
+    if (n == 0)
+        node_ids[n++] = 0;
+    numa_nodes = n;
+    return n;
+}
+
+/* Pins a worker to the CPUs of its node. */
+static void numa_pin(LIBEVENT_THREAD *me) {
+#ifdef __linux__
+    int ret;
+
+    if (CPU_COUNT(&numa_cpus[me->numa_node]) == 0)
+        return;
+    ret = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t),
+                                 &numa_cpus[me->numa_node]);
+    if (ret != 0) {
+        fprintf(stderr, "Can't pin worker to node %d: %s\n",
+                me->numa_node, strerror(ret));
+    }
+#endif
+}
+
+#ifdef HAVE_GCC_ATOMICS
+/* The node the calling worker allocates slab memory on, -1 off the
+ * worker threads. */
+int numa_node_self(void) {
+    LIBEVENT_THREAD *me;
+
+    if (!settings.numa || (me = pthread_getspecific(worker_self_key)) == NULL)
+        return -1;
+    return me->numa_node;
+}
+
+/* The node a key's items are placed on, -1 without -o numa. The top bits
+ * of its hash pick one of numa_nodes equal slices, so a key lands on the
+ * same node whichever worker stores it. */
+int numa_key_node(const uint32_t hv) {
+    if (!settings.numa)
+        return -1;
+    return (int)(((uint64_t)hv * numa_nodes) >> 32);
+}
+
+/* Counts a hit as on our own node's memory or another's. */
+static void numa_count_hit(const item *it) {
+    LIBEVENT_THREAD *me = pthread_getspecific(worker_self_key);
+    int node;
+
+    if (me == NULL || (node = slabs_node(it)) < 0)
+        return;
+    pthread_mutex_lock(&me->stats.mutex);
+    if (node == me->numa_node)
+        me->stats.numa_local_hits++;
+    else
+        me->stats.numa_remote_hits++;
+    pthread_mutex_unlock(&me->stats.mutex);
+}
+#else
+int numa_node_self(void) {
+    return -1;
+}
+
+int numa_key_node(const uint32_t hv) {
+    return -1;
+}
+
+static void numa_count_hit(const item *it) {
+}
+#endif
+
+/* item_get() once the key is hashed. */
+static item *item_get_hashed(const char *key, const size_t nkey, const uint32_t hv) {
+    item *it;
+
+    if (!settings.seqlock_gets || !item_get_seqlock(key, nkey, hv, &it)) {
+        item_lock(hv);
+        it = do_item_get(key, nkey, hv);
+        item_unlock(hv);
+    }
+    if (settings.numa && it != NULL)
+        numa_count_hit(it);
+    return it;
+}
+
 /********************************* ITEM ACCESS *******************************/
 
 /*
@@ -545,19 +1116,42 @@ item *item_alloc(char *key, size_t nkey, int flags, rel_time_t exptime, int nbyt
  * lazy-expiring as needed.
  */
 item *item_get(const char *key, const size_t nkey) {
-    item *it;
     uint32_t hv;
     hv = hash(key, nkey);
-    item_lock(hv);
-    it = do_item_get(key, nkey, hv);
-    item_unlock(hv);
-    return it;
+    if (settings.lru_admission)
+        lru_admission_record(hv);
+    return item_get_hashed(key, nkey, hv);
+}
+
+/*
+ * item_get() for several keys at once. Every key is hashed and its bucket and
+ * item headers are prefetched before the first one is looked up, so the cache
+ * misses of a multiget overlap instead of being paid one key at a time.
+ */
+void item_get_batch(const char **keys, const size_t *nkeys, item **its, const int count) {
+    uint32_t hv[ITEM_GET_BATCH];
+    int done, n, i;
+
+    for (done = 0; done < count; done += n) {
+        n = count - done < ITEM_GET_BATCH ? count - done : ITEM_GET_BATCH;
+        hash_batch(keys + done, nkeys + done, hv, n);
+        if (settings.lru_admission) {
+            for (i = 0; i < n; i++)
+                lru_admission_record(hv[i]);
+        }
+        if (n > 1)
+            assoc_prefetch(hv, n);
+        for (i = 0; i < n; i++)
+            its[done + i] = item_get_hashed(keys[done + i], nkeys[done + i], hv[i]);
+    }
 }
 
 item *item_touch(const char *key, size_t nkey, uint32_t exptime) {
     item *it;
     uint32_t hv;
     hv = hash(key, nkey);
+    if (settings.lru_admission)
+        lru_admission_record(hv);
     item_lock(hv);
     it = do_item_touch(key, nkey, exptime, hv);
     item_unlock(hv);
@@ -584,8 +1178,11 @@ int item_link(item *item) {
  */
 void item_remove(item *item) {
     uint32_t hv;
-    hv = hash(ITEM_key(item), item->nkey);
 
+    /* Gets don't lock to take their reference, so don't lock to drop it. */
+    if (settings.seqlock_gets && refcount_release(&item->refcount))
+        return;
+    hv = ITEM_hash(item);
     item_lock(hv);
     do_item_remove(item);
     item_unlock(hv);
@@ -605,7 +1202,7 @@ int item_replace(item *old_it, item *new_it, const uint32_t hv) {
  */ //ȡitemLRUhashtableĹ
 void item_unlink(item *item) {
     uint32_t hv;
-    hv = hash(ITEM_key(item), item->nkey);
+    hv = ITEM_hash(item);
     item_lock(hv);
     do_item_unlink(item, hv);
     item_unlock(hv);
@@ -616,8 +1213,12 @@ void item_unlink(item *item) {
  */
 void item_update(item *item) {
     uint32_t hv;
-    hv = hash(ITEM_key(item), item->nkey);
 
+    /* do_item_update() won't bump an item this recent anyway; don't take
+     * the lock to find that out on every hit. */
+    if (settings.seqlock_gets && item->time >= current_time - ITEM_UPDATE_INTERVAL)
+        return;
+    hv = ITEM_hash(item);
     item_lock(hv);
     do_item_update(item);
     item_unlock(hv);
@@ -683,6 +1284,9 @@ void threadlocal_stats_reset(void) {
         threads[ii].stats.conn_yields = 0;
         threads[ii].stats.auth_cmds = 0;
         threads[ii].stats.auth_errors = 0;
+        threads[ii].stats.seqlock_retries = 0;
+        threads[ii].stats.numa_local_hits = 0;
+        threads[ii].stats.numa_remote_hits = 0;
 
         for(sid = 0; sid < MAX_NUMBER_OF_SLAB_CLASSES; sid++) {
             threads[ii].stats.slab_stats[sid].set_cmds = 0;
@@ -723,6 +1327,9 @@ void threadlocal_stats_aggregate(struct thread_stats *stats) {
         stats->conn_yields += threads[ii].stats.conn_yields;
         stats->auth_cmds += threads[ii].stats.auth_cmds;
         stats->auth_errors += threads[ii].stats.auth_errors;
+        stats->seqlock_retries += threads[ii].stats.seqlock_retries;
+        stats->numa_local_hits += threads[ii].stats.numa_local_hits;
+        stats->numa_remote_hits += threads[ii].stats.numa_remote_hits;
 
         for (sid = 0; sid < MAX_NUMBER_OF_SLAB_CLASSES; sid++) {
             stats->slab_stats[sid].set_cmds +=
@@ -813,16 +1420,20 @@ void memcached_thread_init(int nthreads, struct event_base *main_base) {
         exit(1);
     }
 
-    item_lock_count = hashsize(power);
     item_lock_hashpower = power;
+    item_lock_hashpower_max = hashpower - 1;
 
-    item_locks = calloc(item_lock_count, sizeof(pthread_mutex_t));
-    if (! item_locks) {
-        perror("Can't allocate item locks");
+#ifdef HAVE_GCC_ATOMICS
+    if (pthread_key_create(&worker_self_key, NULL) != 0) {
+        perror("Can't create thread-specific data key");
         exit(1);
     }
-    for (i = 0; i < item_lock_count; i++) {
-        pthread_mutex_init(&item_locks[i], NULL);
+#endif
+
+    item_lock_tbl = item_lock_table_new(power);
+    if (! item_lock_tbl) {
+        perror("Can't allocate item locks");
+        exit(1);
     }
 
 	//nthreadsԪصLIBEVENT_THREAD
@@ -847,6 +1458,9 @@ void memcached_thread_init(int nthreads, struct event_base *main_base) {
 
         threads[i].notify_receive_fd = fds[0];
         threads[i].notify_send_fd = fds[1];
+        /* Contiguous blocks of workers per node. */
+        threads[i].numa_node = settings.numa ?
+            (int)((uint64_t)i * numa_nodes / nthreads) : -1;
 		//ÿһ߳һevent_baseeventnotify_receive_fdĶ¼
 		//ͬʱΪ̷߳һconn_queue
         setup_thread(&threads[i]);
@@ -0,0 +1,109 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ * wyhash, by Wang Yi, released into the public domain (final version 4).
+ *
+ * Reads the key eight bytes at a time and mixes with a single 64x64->128 bit
+ * multiply per word, which makes it several times faster than jenkins or
+ * murmur3 on the 30-200 byte keys memcached usually sees. Only the default
+ * secret and a zero seed are used, and the 64 bit result is folded down to
+ * the 32 bits the hash table wants.
+ */
+#include <string.h>
+
+#include "wyhash_hash.h"
+
+#if defined(__SIZEOF_INT128__)
+__extension__ typedef unsigned __int128 wy_u128;
+
+static inline void wymum(uint64_t *a, uint64_t *b) {
+    wy_u128 r = *a;
+    r *= *b;
+    *a = (uint64_t)r;
+    *b = (uint64_t)(r >> 64);
+}
+#else
+/* No 128 bit type (32 bit builds), do the long multiplication by hand. */
+static inline void wymum(uint64_t *a, uint64_t *b) {
+    uint64_t ha = *a >> 32, hb = *b >> 32, la = (uint32_t)*a, lb = (uint32_t)*b;
+    uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    uint64_t t = rl + (rm0 << 32), c = t < rl, lo, hi;
+
+    lo = t + (rm1 << 32);
+    c += lo < t;
+    hi = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+    *a = lo;
+    *b = hi;
+}
+#endif
+
+static inline uint64_t wymix(uint64_t a, uint64_t b) {
+    wymum(&a, &b);
+    return a ^ b;
+}
+
+/* Native byte order: the hash only has to be stable within one process. */
+static inline uint64_t wyr8(const uint8_t *p) {
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return v;
+}
+
+static inline uint64_t wyr4(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static inline uint64_t wyr3(const uint8_t *p, size_t k) {
+    return (((uint64_t)p[0]) << 16) | (((uint64_t)p[k >> 1]) << 8) | p[k - 1];
+}
+
+static const uint64_t wyp[4] = {
+    0x2d358dccaa6c78a5ULL, 0x8bb84b93962eacc9ULL,
+    0x4b33a62ed433d4a3ULL, 0x4d5a2da51de1aa47ULL
+};
+
+uint32_t wyhash_hash(const void *key, size_t length) {
+    const uint8_t *p = key;
+    uint64_t seed = wymix(wyp[0], wyp[1]);
+    uint64_t a, b, h;
+
+    if (length <= 16) {
+        if (length >= 4) {
+            a = (wyr4(p) << 32) | wyr4(p + ((length >> 3) << 2));
+            b = (wyr4(p + length - 4) << 32) |
+                wyr4(p + length - 4 - ((length >> 3) << 2));
+        } else if (length > 0) {
+            a = wyr3(p, length);
+            b = 0;
+        } else {
+            a = b = 0;
+        }
+    } else {
+        size_t i = length;
+
+        if (i > 48) {
+            uint64_t see1 = seed, see2 = seed;
+            do {
+                seed = wymix(wyr8(p) ^ wyp[1], wyr8(p + 8) ^ seed);
+                see1 = wymix(wyr8(p + 16) ^ wyp[2], wyr8(p + 24) ^ see1);
+                see2 = wymix(wyr8(p + 32) ^ wyp[3], wyr8(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= see1 ^ see2;
+        }
+        while (i > 16) {
+            seed = wymix(wyr8(p) ^ wyp[1], wyr8(p + 8) ^ seed);
+            i -= 16;
+            p += 16;
+        }
+        a = wyr8(p + i - 16);
+        b = wyr8(p + i - 8);
+    }
+    a ^= wyp[1];
+    b ^= seed;
+    wymum(&a, &b);
+    h = wymix(a ^ wyp[0] ^ length, b ^ wyp[1]);
+    return (uint32_t)(h ^ (h >> 32));
+}
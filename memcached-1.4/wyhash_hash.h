@@ -0,0 +1,17 @@
+#ifndef WYHASH_HASH_H
+#define    WYHASH_HASH_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef    __cplusplus
+extern "C" {
+#endif
+
+uint32_t wyhash_hash(const void *key, size_t length);
+
+#ifdef    __cplusplus
+}
+#endif
+
+#endif    /* WYHASH_HASH_H */